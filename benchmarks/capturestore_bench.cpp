@@ -0,0 +1,94 @@
+// Compares the capture storage formats on a directory of real camera JPEGs:
+// save latency and size per frame, plus the cost of reading the stitch crop
+// back, which is what the stitcher pays for each format.
+//
+// Usage: capturestore_bench <surface directory> [iterations]
+
+#include "../capturestore.h"
+#include "../tilereader.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QTemporaryDir>
+#include <QTextStream>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    const QStringList args = app.arguments();
+    if (args.size() < 2) {
+        out << "Usage: capturestore_bench <surface directory> [iterations]\n";
+        return 1;
+    }
+
+    QDir dir(args.at(1));
+    const int iterations = args.size() > 2 ? qMax(1, args.at(2).toInt()) : 3;
+    QStringList captures;
+    for (const QString &name : dir.entryList(QStringList() << "image_*.jpg", QDir::Files, QDir::Name)) {
+        if (CaptureStore::isCaptureName(name)) captures.append(name);
+    }
+    if (captures.isEmpty()) {
+        out << "No image_NN.jpg captures found in " << dir.absolutePath() << "\n";
+        return 1;
+    }
+
+    // Camera bytes and decoded frames, as the capture window holds them
+    QList<QByteArray> encodedFrames;
+    QList<QImage> frames;
+    for (const QString &name : captures) {
+        QFile file(dir.filePath(name));
+        if (!file.open(QIODevice::ReadOnly)) continue;
+        encodedFrames.append(file.readAll());
+        frames.append(QImage::fromData(encodedFrames.last()));
+    }
+
+    QTemporaryDir outputDir;
+    if (!outputDir.isValid()) {
+        out << "Could not create a temporary directory\n";
+        return 1;
+    }
+
+    out << frames.size() << " captures x " << iterations << " iterations\n";
+    out << QString("%1 %2 %3 %4\n")
+        .arg("format", -30).arg("save ms", 10).arg("size KB", 10).arg("crop read ms", 14);
+
+    QElapsedTimer timer;
+    for (CaptureStore::Format format : CaptureStore::formats()) {
+        qint64 saveNs = 0;
+        qint64 readNs = 0;
+        qint64 bytes = 0;
+
+        for (int i = 0; i < iterations; ++i) {
+            for (int f = 0; f < frames.size(); ++f) {
+                QString path = CaptureStore::capturePath(outputDir.path(), f + 1, format);
+
+                timer.start();
+                CaptureStore::write(path, format, frames[f], encodedFrames[f]);
+                saveNs += timer.nsecsElapsed();
+
+                timer.start();
+                QImage crop = TileReader::readCenterCrop(path);
+                readNs += timer.nsecsElapsed();
+                if (crop.isNull()) {
+                    out << "Failed to read back " << path << "\n";
+                }
+
+                bytes += QFileInfo(path).size();
+                QFile::remove(path);
+            }
+        }
+
+        const double count = double(iterations) * frames.size();
+        out << QString("%1 %2 %3 %4\n")
+            .arg(CaptureStore::formatLabel(format), -30)
+            .arg(saveNs / 1e6 / count, 10, 'f', 2)
+            .arg(bytes / 1024.0 / count, 10, 'f', 0)
+            .arg(readNs / 1e6 / count, 14, 'f', 2);
+    }
+    return 0;
+}
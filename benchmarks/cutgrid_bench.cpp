@@ -0,0 +1,78 @@
+// Times the cut-grid search over a session: every piece count up to 10 x 10
+// and every grid origin within the trim margin, on one thread and on the pool.
+//
+// Usage: cutgrid_bench <session directory> [trim margin mm] [iterations]
+//
+// Surfaces are the session's surface_* directories with a
+// defect_coordinates.json; the surface is taken to be A3 as in the cutting view.
+
+#include "../cutgridoptimizer.h"
+#include "../defectstore.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QThreadPool>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    const QStringList args = app.arguments();
+    if (args.size() < 2) {
+        out << "Usage: cutgrid_bench <session directory> [trim margin mm] [iterations]\n";
+        return 1;
+    }
+
+    const QString sessionPath = args.at(1);
+    const double margin = args.size() > 2 ? qMax(0.0, args.at(2).toDouble()) : 5.0;
+    const int iterations = args.size() > 3 ? qMax(1, args.at(3).toInt()) : 5;
+
+    QVector<DefectStore> surfaces;
+    int defectCount = 0;
+    const QStringList surfaceDirs = QDir(sessionPath).entryList(QStringList() << "surface_*", QDir::Dirs);
+    for (const QString &surfaceDir : surfaceDirs) {
+        DefectStore defects;
+        if (defects.load(QString("%1/%2/defect_coordinates.json").arg(sessionPath).arg(surfaceDir))) {
+            defectCount += defects.size();
+            surfaces.append(defects);
+        }
+    }
+    if (surfaces.isEmpty()) {
+        out << "No surfaces with defect coordinates in " << sessionPath << "\n";
+        return 1;
+    }
+
+    CutGridOptimizer optimizer(420.0, 297.0);
+    optimizer.setTrimMargin(margin);
+    const int candidateCount = optimizer.candidates().size();
+    out << surfaces.size() << " surfaces, " << defectCount << " defects, "
+        << candidateCount << " candidate grids\n";
+
+    auto time = [&](QThreadPool *pool) {
+        qint64 best = -1;
+        for (int i = 0; i < iterations; ++i) {
+            QElapsedTimer timer;
+            timer.start();
+            optimizer.run(surfaces, pool);
+            qint64 elapsed = timer.elapsed();
+            if (best < 0 || elapsed < best) best = elapsed;
+        }
+        return best;
+    };
+
+    const qint64 serialMs = time(nullptr);
+    const qint64 pooledMs = time(QThreadPool::globalInstance());
+    out << "one thread: " << serialMs << " ms, pool of " << QThreadPool::globalInstance()->maxThreadCount()
+        << ": " << pooledMs << " ms (best of " << iterations << ")\n";
+
+    const QVector<CutGridLayout> layouts = optimizer.layouts();
+    for (int i = 0; i < qMin(5, int(layouts.size())); ++i) {
+        const CutGridLayout &layout = layouts[i];
+        out << "  " << layout.piecesInX << " x " << layout.piecesInY
+            << " at (" << layout.originX << ", " << layout.originY << ") mm: "
+            << layout.freePieces << " of " << layout.totalPieces << " free\n";
+    }
+    return 0;
+}
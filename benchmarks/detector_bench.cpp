@@ -0,0 +1,206 @@
+// Compares the detection backends on one surface: how long each takes to
+// start, the latency of a single tile submitted on its own, and the
+// throughput of the whole surface.
+//
+// The Python runs go from the old behaviour (one worker, one tile per forward
+// pass) through detectBatch() batching to a pool of workers with and without
+// CPU pinning. The native run uses OpenCV DNN in process and is skipped when
+// the benchmark was built without it or there is no model/best.onnx.
+//
+// Run from the build directory, which holds scripts/ and model/. The tiles
+// are copied to a temporary directory first, because detection writes its
+// results next to each image.
+//
+// Usage: detector_bench <surface directory> [max batch] [max wait ms] [workers]
+
+#include "../capturestore.h"
+#include "../defectdetector.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+#include <QTimer>
+
+struct Mode {
+    const char *name;
+    DefectDetector::Backend backend;
+    int workerCount;
+    bool cpuPinning;
+    int maxBatchSize;
+    bool submitAsBatch;
+};
+
+struct Stats {
+    qint64 startupMs = -1;
+    double latencyMs = 0;  // Mean over tiles submitted one at a time
+    qint64 totalMs = -1;   // Whole surface, submitted at once
+    int failures = 0;
+};
+
+// Waits until count answers have arrived, or gives up after timeoutMs
+static bool waitForAnswers(QEventLoop &loop, const int &answered, int count, int timeoutMs)
+{
+    QTimer timeout;
+    timeout.setSingleShot(true);
+    QObject::connect(&timeout, &QTimer::timeout, &loop, &QEventLoop::quit);
+    timeout.start(timeoutMs);
+    while (answered < count && timeout.isActive()) {
+        loop.exec();
+    }
+    return answered >= count;
+}
+
+static Stats runDetection(const QStringList &imagePaths, const Mode &mode, int maxBatchWaitMs)
+{
+    Stats stats;
+    DefectDetector detector;
+    detector.setBackend(mode.backend);
+    detector.setWorkerCount(mode.workerCount);
+    detector.setCpuPinning(mode.cpuPinning);
+    detector.setBatchLimits(mode.maxBatchSize, maxBatchWaitMs);
+    // Every mode sees the same tiles; answers must come from the model
+    detector.setCacheEnabled(false);
+
+    QEventLoop loop;
+    bool ready = false;
+    bool failed = false;
+    QObject::connect(&detector, &DefectDetector::modelInitializationComplete, &loop, [&]() {
+        ready = true;
+        loop.quit();
+    });
+    QObject::connect(&detector, &DefectDetector::modelInitializationFailed, &loop, [&]() {
+        failed = true;
+        loop.quit();
+    });
+
+    QElapsedTimer timer;
+    timer.start();
+    detector.initializeDetectionProcess();
+    if (!ready && !failed) loop.exec();
+    if (!ready || detector.activeBackend() != mode.backend) return stats;
+    stats.startupMs = timer.elapsed();
+
+    int answered = 0;
+    QObject::connect(&detector, &DefectDetector::detectionFinished, &loop, [&]() {
+        ++answered;
+        loop.quit();
+    });
+    QObject::connect(&detector, &DefectDetector::detectionError, &loop, [&]() {
+        ++answered;
+        ++stats.failures;
+        loop.quit();
+    });
+
+    // Single tiles, each waited for, so nothing queues behind anything else
+    const int latencyTiles = qMin(4, int(imagePaths.size()));
+    qint64 latencyTotal = 0;
+    for (int i = 0; i < latencyTiles; ++i) {
+        const int before = answered;
+        timer.start();
+        if (detector.detectImage(imagePaths[i]) == 0) return stats;
+        if (!waitForAnswers(loop, answered, before + 1, 5 * 60 * 1000)) return stats;
+        latencyTotal += timer.elapsed();
+    }
+    stats.latencyMs = latencyTiles > 0 ? double(latencyTotal) / latencyTiles : 0;
+
+    // Then the whole surface at once
+    answered = 0;
+    stats.failures = 0;
+    timer.start();
+    if (mode.submitAsBatch) {
+        if (detector.detectBatch(imagePaths).isEmpty()) return stats;
+    } else {
+        for (const QString &path : imagePaths) {
+            if (detector.detectImage(path) == 0) return stats;
+        }
+    }
+    // Generous, but keeps a wedged worker from hanging the benchmark
+    if (waitForAnswers(loop, answered, imagePaths.size(), 30 * 60 * 1000)) {
+        stats.totalMs = timer.elapsed();
+    }
+    return stats;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    const QStringList args = app.arguments();
+    if (args.size() < 2) {
+        out << "Usage: detector_bench <surface directory> [max batch] [max wait ms] [workers]\n";
+        return 1;
+    }
+
+    QDir dir(args.at(1));
+    const int maxBatchSize = args.size() > 2 ? qMax(1, args.at(2).toInt()) : 8;
+    const int maxBatchWaitMs = args.size() > 3 ? qMax(0, args.at(3).toInt()) : 20;
+    const int workerCount = args.size() > 4 ? qMax(1, args.at(4).toInt()) : qMax(1, QThread::idealThreadCount() / 4);
+
+    QTemporaryDir workDir;
+    if (!workDir.isValid()) {
+        out << "Could not create a temporary directory\n";
+        return 1;
+    }
+
+    QStringList imagePaths;
+    for (const QString &name : dir.entryList(CaptureStore::nameFilters(), QDir::Files, QDir::Name)) {
+        if (!CaptureStore::isCaptureName(name)) continue;
+        QString copy = QDir(workDir.path()).filePath(name);
+        if (QFile::copy(dir.filePath(name), copy)) imagePaths.append(copy);
+    }
+    if (imagePaths.isEmpty()) {
+        out << "No captures found in " << dir.absolutePath() << "\n";
+        return 1;
+    }
+
+    out << imagePaths.size() << " tiles, max batch " << maxBatchSize
+        << ", max wait " << maxBatchWaitMs << " ms, " << workerCount << " workers\n";
+    out << QString("%1 %2 %3 %4 %5 %6\n")
+        .arg("mode", -22).arg("startup ms", 11).arg("latency ms", 11)
+        .arg("total ms", 10).arg("ms/tile", 9).arg("tiles/s", 9);
+    out.flush();
+
+    const Mode modes[] = {
+        { "python, one per pass", DefectDetector::Python, 1, false, 1, false },
+        { "python, batched", DefectDetector::Python, 1, false, maxBatchSize, true },
+        { "python, pool", DefectDetector::Python, workerCount, false, maxBatchSize, true },
+        { "python, pool, pinned", DefectDetector::Python, workerCount, true, maxBatchSize, true },
+        { "native", DefectDetector::Native, workerCount, false, maxBatchSize, true },
+    };
+
+    qint64 baselineMs = 0;
+    for (const Mode &mode : modes) {
+        const Stats stats = runDetection(imagePaths, mode, maxBatchWaitMs);
+        if (stats.startupMs < 0) {
+            out << mode.name << ": backend did not start, skipped\n";
+            out.flush();
+            continue;
+        }
+        if (stats.totalMs < 0) {
+            out << mode.name << ": did not answer every tile\n";
+            return 1;
+        }
+        if (baselineMs == 0) baselineMs = stats.totalMs;
+
+        out << QString("%1 %2 %3 %4 %5 %6")
+            .arg(QString::fromLatin1(mode.name), -22)
+            .arg(stats.startupMs, 11)
+            .arg(stats.latencyMs, 11, 'f', 1)
+            .arg(stats.totalMs, 10)
+            .arg(double(stats.totalMs) / imagePaths.size(), 9, 'f', 1)
+            .arg(imagePaths.size() * 1000.0 / qMax<qint64>(1, stats.totalMs), 9, 'f', 2);
+        if (stats.totalMs != baselineMs) {
+            out << QString("   %1x").arg(double(baselineMs) / qMax<qint64>(1, stats.totalMs), 0, 'f', 2);
+        }
+        if (stats.failures > 0) out << "   (" << stats.failures << " failed)";
+        out << "\n";
+        out.flush();
+    }
+
+    return 0;
+}
@@ -0,0 +1,141 @@
+// Times the guillotine cut planner on every surface of a session and compares
+// its defect-free pieces with those of the uniform grid of the same piece size.
+// Every plan is checked: its pieces must be disjoint, inside the planned area,
+// of the requested size and clear of every defect; the exit code is 2 if not.
+//
+// Usage: guillotine_bench <session directory> [pieces in x] [pieces in y] [trim margin mm]
+//
+// Surfaces are the session's surface_* directories with a
+// defect_coordinates.json; the surface is taken to be A3, and a trim margin
+// shrinks the planned area by that much on every side.
+
+#include "../guillotineplanner.h"
+#include "../cutgridoptimizer.h"
+#include "../defectstore.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QTextStream>
+
+namespace {
+
+// Pieces may be one planner tick short of the requested size
+const double SizeTolerance = 0.011;  // mm
+const double EdgeTolerance = 1e-6;
+
+// Empty if the plan is sound, otherwise what is wrong with it
+QString checkPlan(const GuillotinePlan &plan, const QRectF &area, double pieceWidth, double pieceHeight,
+                  const DefectStore &defects)
+{
+    for (int i = 0; i < plan.pieces.size(); ++i) {
+        const QRectF &piece = plan.pieces[i];
+        if (piece.width() > pieceWidth + EdgeTolerance || piece.width() < pieceWidth - SizeTolerance
+            || piece.height() > pieceHeight + EdgeTolerance || piece.height() < pieceHeight - SizeTolerance) {
+            return QString("piece %1 is %2 x %3 mm").arg(i + 1).arg(piece.width()).arg(piece.height());
+        }
+        if (piece.left() < area.left() - EdgeTolerance || piece.top() < area.top() - EdgeTolerance
+            || piece.right() > area.right() + EdgeTolerance || piece.bottom() > area.bottom() + EdgeTolerance) {
+            return QString("piece %1 leaves the planned area").arg(i + 1);
+        }
+        for (int j = 0; j < i; ++j) {
+            const QRectF &other = plan.pieces[j];
+            if (piece.left() < other.right() - EdgeTolerance && other.left() < piece.right() - EdgeTolerance
+                && piece.top() < other.bottom() - EdgeTolerance && other.top() < piece.bottom() - EdgeTolerance) {
+                return QString("pieces %1 and %2 overlap").arg(j + 1).arg(i + 1);
+            }
+        }
+        // Strict on both sides, so a defect with no extent inside a piece counts
+        for (int d = 0; d < defects.size(); ++d) {
+            const double left = defects.xColumn()[d];
+            const double top = defects.yColumn()[d];
+            const double right = left + defects.widthColumn()[d];
+            const double bottom = top + defects.heightColumn()[d];
+            if (left < piece.right() && right > piece.left() && top < piece.bottom() && bottom > piece.top()) {
+                return QString("piece %1 holds defect %2").arg(i + 1).arg(d + 1);
+            }
+        }
+    }
+    return QString();
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    const QStringList args = app.arguments();
+    if (args.size() < 2) {
+        out << "Usage: guillotine_bench <session directory> [pieces in x] [pieces in y] [trim margin mm]\n";
+        return 1;
+    }
+
+    const QString sessionPath = args.at(1);
+    const int piecesInX = args.size() > 2 ? qMax(1, args.at(2).toInt()) : 4;
+    const int piecesInY = args.size() > 3 ? qMax(1, args.at(3).toInt()) : 2;
+    const double margin = args.size() > 4 ? qBound(0.0, args.at(4).toDouble(), 100.0) : 0.0;
+    const QRectF area(margin, margin, 420.0 - 2 * margin, 297.0 - 2 * margin);
+    const double pieceWidth = area.width() / piecesInX;
+    const double pieceHeight = area.height() / piecesInY;
+
+    QVector<DefectStore> surfaces;
+    QStringList surfaceNames;
+    const QStringList surfaceDirs = QDir(sessionPath).entryList(QStringList() << "surface_*", QDir::Dirs);
+    for (const QString &surfaceDir : surfaceDirs) {
+        DefectStore defects;
+        if (defects.load(QString("%1/%2/defect_coordinates.json").arg(sessionPath).arg(surfaceDir))) {
+            surfaces.append(defects);
+            surfaceNames.append(surfaceDir);
+        }
+    }
+    if (surfaces.isEmpty()) {
+        out << "No surfaces with defect coordinates in " << sessionPath << "\n";
+        return 1;
+    }
+
+    // The grid's count, from the same search the layout suggestions use
+    CutGridOptimizer optimizer(420.0, 297.0);
+    optimizer.setPieceLimits(piecesInX, piecesInY);
+    optimizer.setTrimMargin(margin);
+    optimizer.run(surfaces);
+    int gridFree = 0;
+    for (const CutGridLayout &layout : optimizer.layouts()) {
+        if (layout.piecesInX == piecesInX && layout.piecesInY == piecesInY) {
+            gridFree = layout.freePieces;
+            break;
+        }
+    }
+
+    const GuillotinePlanner planner(area, pieceWidth, pieceHeight);
+    int planned = 0;
+    double totalMs = 0.0;
+    double worstMs = 0.0;
+    int budgetHits = 0;
+    int invalidPlans = 0;
+    for (int i = 0; i < surfaces.size(); ++i) {
+        const GuillotinePlan plan = planner.plan(surfaces[i]);
+        planned += plan.pieces.size();
+        totalMs += plan.elapsedMs;
+        worstMs = qMax(worstMs, plan.elapsedMs);
+        if (!plan.optimal) ++budgetHits;
+        out << "  " << surfaceNames.at(i) << ": " << surfaces[i].size() << " defects, "
+            << plan.pieces.size() << " pieces, " << plan.searchedRects << " rectangles, "
+            << plan.elapsedMs << " ms" << (plan.optimal ? "" : " (budget)") << "\n";
+
+        const QString problem = checkPlan(plan, area, pieceWidth, pieceHeight, surfaces[i]);
+        if (!problem.isEmpty()) {
+            out << "    INVALID PLAN: " << problem << "\n";
+            ++invalidPlans;
+        }
+    }
+
+    out << surfaces.size() << " surfaces, " << pieceWidth << " x " << pieceHeight << " mm pieces: "
+        << planned << " planned vs " << gridFree << " on the grid\n";
+    out << "average " << totalMs / surfaces.size() << " ms, worst " << worstMs << " ms, "
+        << budgetHits << " surfaces reached the search budget\n";
+    if (invalidPlans > 0) {
+        out << invalidPlans << " invalid plans\n";
+        return 2;
+    }
+    return 0;
+}
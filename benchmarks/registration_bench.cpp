@@ -0,0 +1,119 @@
+// Times tile registration of one captured surface: downsampled decode, then
+// phase correlation of every neighbouring pair on one thread and on the pool.
+//
+// Usage: registration_bench <surface directory> [iterations]
+//
+// Grid, sequence and paper size come from the surface's defect_coordinates.json
+// when present; otherwise a 4x4 A4 surface captured in image order is assumed.
+
+#include "../phasecorrelation.h"
+#include "../tilereader.h"
+#include "../tileregistration.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    const QStringList args = app.arguments();
+    if (args.size() < 2) {
+        out << "Usage: registration_bench <surface directory> [iterations]\n";
+        return 1;
+    }
+
+    const QString surfacePath = args.at(1);
+    const int iterations = args.size() > 2 ? qMax(1, args.at(2).toInt()) : 5;
+
+    int imagesInX = 4;
+    int imagesInY = 4;
+    double actualWidth = 297.0;
+    double actualHeight = 210.0;
+    QVector<int> sequence;
+
+    QFile layoutFile(QString("%1/defect_coordinates.json").arg(surfacePath));
+    if (layoutFile.open(QIODevice::ReadOnly)) {
+        QJsonObject layout = QJsonDocument::fromJson(layoutFile.readAll()).object();
+        imagesInX = layout["grid_x"].toInt(imagesInX);
+        imagesInY = layout["grid_y"].toInt(imagesInY);
+        actualWidth = layout["surface_width"].toDouble(actualWidth);
+        actualHeight = layout["surface_height"].toDouble(actualHeight);
+        for (const QJsonValue &value : layout["sequence"].toArray()) {
+            sequence.append(value.toInt());
+        }
+    }
+    if (sequence.size() != imagesInX * imagesInY) {
+        sequence.clear();
+        for (int i = 1; i <= imagesInX * imagesInY; ++i) sequence.append(i);
+    }
+
+    // Same canvas geometry as ImageStitcher::getCanvasSize()
+    const int canvasWidth = 4400;
+    const int canvasHeight = static_cast<int>(canvasWidth / (actualWidth / actualHeight));
+    const QSize cellSize(canvasWidth / imagesInX, canvasHeight / imagesInY);
+    const int downsample = TileRegistration::defaultDownsample();
+
+    QVector<int> positions;
+    for (int position = 0; position < sequence.size(); ++position) positions.append(position);
+    auto tilePath = [&](int position) {
+        return QString("%1/image_%2.jpg").arg(surfacePath).arg(sequence[position], 2, 10, QChar('0'));
+    };
+
+    QThreadPool pool;
+    qint64 decodeNs = 0;
+    qint64 serialNs = 0;
+    qint64 parallelNs = 0;
+    QElapsedTimer timer;
+    TileRegistration registration(imagesInX, imagesInY, cellSize, downsample);
+
+    for (int i = 0; i < iterations; ++i) {
+        timer.start();
+        const QList<QImage> thumbnails = QtConcurrent::blockingMapped<QList<QImage>>(&pool, positions,
+            [&](int position) { return TileReader::readDownsampled(tilePath(position), downsample); });
+        decodeNs += timer.nsecsElapsed();
+
+        for (int position = 0; position < thumbnails.size(); ++position) {
+            registration.setTile(position, thumbnails[position]);
+        }
+
+        timer.start();
+        registration.run();
+        serialNs += timer.nsecsElapsed();
+
+        timer.start();
+        registration.run(&pool);
+        parallelNs += timer.nsecsElapsed();
+    }
+
+    int accepted = 0;
+    for (const TileRegistration::PairOffset &pair : registration.pairs()) {
+        if (pair.accepted) ++accepted;
+        out << QString("pair %1-%2: dx %3 dy %4 peak %5%6\n")
+                   .arg(pair.from).arg(pair.to)
+                   .arg(pair.offset.x(), 0, 'f', 1).arg(pair.offset.y(), 0, 'f', 1)
+                   .arg(pair.peak, 0, 'f', 3)
+                   .arg(pair.accepted ? "" : " (rejected)");
+    }
+
+    const QVector<QPoint> corrections = registration.corrections();
+    for (int position = 0; position < corrections.size(); ++position) {
+        out << QString("tile %1: %2, %3\n").arg(position).arg(corrections[position].x()).arg(corrections[position].y());
+    }
+
+    out << imagesInX << "x" << imagesInY << " grid, " << accepted << " of " << registration.pairs().size()
+        << " pairs accepted, " << (PhaseCorrelator::usesSimd() ? "SIMD" : "scalar") << " kernels, "
+        << pool.maxThreadCount() << " threads\n";
+    out << QString("downsampled decode: %1 ms\n").arg(decodeNs / 1e6 / iterations, 0, 'f', 2);
+    out << QString("register, 1 thread: %1 ms\n").arg(serialNs / 1e6 / iterations, 0, 'f', 2);
+    out << QString("register, pool:     %1 ms\n").arg(parallelNs / 1e6 / iterations, 0, 'f', 2);
+    return 0;
+}
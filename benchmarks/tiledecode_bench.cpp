@@ -0,0 +1,66 @@
+// Compares full-frame decode + crop against region-of-interest decode of the
+// stitch crop on a directory of real captures.
+//
+// Usage: tiledecode_bench <surface directory> [iterations]
+
+#include "../tilereader.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QRegularExpression>
+#include <QImage>
+#include <QTextStream>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    const QStringList args = app.arguments();
+    if (args.size() < 2) {
+        out << "Usage: tiledecode_bench <surface directory> [iterations]\n";
+        return 1;
+    }
+
+    QDir dir(args.at(1));
+    const int iterations = args.size() > 2 ? qMax(1, args.at(2).toInt()) : 5;
+    QStringList captures = dir.entryList(QStringList() << "image_*.jpg", QDir::Files, QDir::Name);
+    captures = captures.filter(QRegularExpression("^image_\\d+\\.jpg$"));
+    if (captures.isEmpty()) {
+        out << "No image_NN.jpg captures found in " << dir.absolutePath() << "\n";
+        return 1;
+    }
+
+    const QSize cropSize = TileReader::defaultCropSize();
+    qint64 fullNs = 0;
+    qint64 roiNs = 0;
+    QElapsedTimer timer;
+
+    for (int i = 0; i < iterations; ++i) {
+        for (const QString &name : captures) {
+            const QString path = dir.filePath(name);
+
+            timer.start();
+            QImage full(path);
+            QImage cropped = full.copy(TileReader::centerCropRect(full.size(), cropSize));
+            fullNs += timer.nsecsElapsed();
+
+            timer.start();
+            QImage roi = TileReader::readCenterCrop(path, cropSize);
+            roiNs += timer.nsecsElapsed();
+
+            if (cropped.size() != roi.size()) {
+                out << "Size mismatch for " << name << "\n";
+            }
+        }
+    }
+
+    const double decodes = double(iterations) * captures.size();
+    const double fullMs = fullNs / 1e6 / decodes;
+    const double roiMs = roiNs / 1e6 / decodes;
+    out << captures.size() << " captures x " << iterations << " iterations\n";
+    out << QString("full decode + crop: %1 ms/tile\n").arg(fullMs, 0, 'f', 2);
+    out << QString("ROI decode:         %1 ms/tile\n").arg(roiMs, 0, 'f', 2);
+    out << QString("speedup:            %1x\n").arg(fullMs / roiMs, 0, 'f', 2);
+    return 0;
+}
@@ -0,0 +1,519 @@
+#include "capturestore.h"
+#include <QBuffer>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtEndian>
+#include <QDebug>
+#include <cstring>
+
+namespace {
+
+const char rawMagic[4] = { 'C', 'Q', 'R', 'W' };
+const quint32 rawVersion = 1;
+
+const char qoiMagic[4] = { 'q', 'o', 'i', 'f' };
+const int qoiHeaderSize = 14;
+const int qoiPaddingSize = 8;  // Seven zero bytes and a one
+const quint64 maximumPixels = 400000000;  // Guards against corrupt headers
+
+enum : uchar {
+    QoiOpIndex = 0x00,
+    QoiOpDiff = 0x40,
+    QoiOpLuma = 0x80,
+    QoiOpRun = 0xc0,
+    QoiOpRgb = 0xfe,
+    QoiOpRgba = 0xff,
+    QoiMask = 0xc0
+};
+
+struct Pixel {
+    uchar r, g, b, a;
+    bool operator==(const Pixel &other) const {
+        return r == other.r && g == other.g && b == other.b && a == other.a;
+    }
+};
+
+inline int qoiHash(const Pixel &px)
+{
+    return (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+}
+
+QString stationConfigPath()
+{
+    return QString("%1/capture_storage.json")
+        .arg(QStandardPaths::writableLocation(QStandardPaths::AppConfigLocation));
+}
+
+bool writeBytes(const QString &path, const QByteArray &data)
+{
+    // Readers poll for new captures, so never expose a half-written file
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Failed to open capture for writing:" << path << file.errorString();
+        return false;
+    }
+    if (file.write(data) != data.size() || !file.commit()) {
+        qDebug() << "Failed to write capture:" << path << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+struct RawHeader {
+    int width = 0;
+    int height = 0;
+    int bytesPerLine = 0;
+};
+
+bool parseRawHeader(const char *data, qsizetype size, RawHeader &header)
+{
+    if (size < CaptureStore::rawHeaderSize() || std::memcmp(data, rawMagic, 4) != 0) return false;
+
+    const uchar *fields = reinterpret_cast<const uchar *>(data) + 4;
+    quint32 version = qFromLittleEndian<quint32>(fields);
+    quint32 width = qFromLittleEndian<quint32>(fields + 4);
+    quint32 height = qFromLittleEndian<quint32>(fields + 8);
+    quint32 channels = qFromLittleEndian<quint32>(fields + 12);
+    quint32 bytesPerLine = qFromLittleEndian<quint32>(fields + 16);
+
+    if (version != rawVersion || channels != 3 || width == 0 || height == 0
+        || quint64(width) * height > maximumPixels || bytesPerLine < width * 3) {
+        return false;
+    }
+
+    header.width = int(width);
+    header.height = int(height);
+    header.bytesPerLine = int(bytesPerLine);
+    return true;
+}
+
+bool readRawHeader(QFile &file, RawHeader &header)
+{
+    QByteArray bytes = file.read(CaptureStore::rawHeaderSize());
+    return parseRawHeader(bytes.constData(), bytes.size(), header);
+}
+
+} // namespace
+
+QString CaptureStore::formatName(Format format)
+{
+    switch (format) {
+    case PassThrough: return "passthrough";
+    case Qoi: return "qoi";
+    case Raw: return "raw";
+    case Jpeg: return "jpeg";
+    }
+    return "jpeg";
+}
+
+QString CaptureStore::formatLabel(Format format)
+{
+    switch (format) {
+    case PassThrough: return "Camera JPEG (no re-encode)";
+    case Qoi: return "QOI (lossless, fast)";
+    case Raw: return "Raw RGB (lossless, largest)";
+    case Jpeg: return "JPEG re-encode (quality 100)";
+    }
+    return QString();
+}
+
+CaptureStore::Format CaptureStore::formatFromName(const QString &name, Format fallback)
+{
+    for (Format format : formats()) {
+        if (formatName(format) == name) return format;
+    }
+    return fallback;
+}
+
+QString CaptureStore::extension(Format format)
+{
+    switch (format) {
+    case Qoi: return "qoi";
+    case Raw: return "raw";
+    case PassThrough:
+    case Jpeg:
+        break;
+    }
+    return "jpg";
+}
+
+CaptureStore::Format CaptureStore::stationFormat()
+{
+    QFile file(stationConfigPath());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return PassThrough;
+    }
+
+    QJsonObject config = QJsonDocument::fromJson(file.readAll()).object();
+    file.close();
+    return formatFromName(config["format"].toString(), PassThrough);
+}
+
+bool CaptureStore::setStationFormat(Format format)
+{
+    QString path = stationConfigPath();
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    QJsonObject config;
+    config["format"] = formatName(format);
+
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Failed to save capture storage format to" << path;
+        return false;
+    }
+    file.write(QJsonDocument(config).toJson());
+    file.close();
+    return true;
+}
+
+QString CaptureStore::capturePath(const QString &surfacePath, int imageNumber, Format format)
+{
+    return QString("%1/image_%2.%3").arg(surfacePath).arg(imageNumber, 2, 10, QChar('0')).arg(extension(format));
+}
+
+QString CaptureStore::findCapture(const QString &surfacePath, int imageNumber)
+{
+    for (Format format : { Jpeg, Qoi, Raw }) {
+        QString path = capturePath(surfacePath, imageNumber, format);
+        if (QFile::exists(path)) return path;
+    }
+    return capturePath(surfacePath, imageNumber, Jpeg);
+}
+
+QStringList CaptureStore::nameFilters()
+{
+    return QStringList() << "image_*.jpg" << "image_*.qoi" << "image_*.raw";
+}
+
+bool CaptureStore::isCaptureName(const QString &fileName)
+{
+    return imageNumber(fileName) >= 0;
+}
+
+int CaptureStore::imageNumber(const QString &fileName)
+{
+    static const QRegularExpression namePattern("^image_(\\d+)\\.(jpg|qoi|raw)$");
+    QRegularExpressionMatch match = namePattern.match(fileName);
+    return match.hasMatch() ? match.captured(1).toInt() : -1;
+}
+
+QString CaptureStore::sidecarPath(const QString &imagePath, const QString &suffix)
+{
+    QFileInfo info(imagePath);
+    return QString("%1/%2%3").arg(info.path()).arg(info.completeBaseName()).arg(suffix);
+}
+
+bool CaptureStore::isNativeFormat(const QString &imagePath)
+{
+    QString suffix = QFileInfo(imagePath).suffix().toLower();
+    return suffix == "qoi" || suffix == "raw";
+}
+
+bool CaptureStore::write(const QString &path, Format format, const QImage &frame,
+                         const QByteArray &encoded, int jpegQuality)
+{
+    switch (format) {
+    case PassThrough:
+        if (isJpegData(encoded)) {
+            return writeBytes(path, encoded);
+        }
+        qDebug() << "No camera JPEG bytes for pass-through capture, re-encoding" << path;
+        break;
+    case Qoi:
+        return writeBytes(path, encodeQoi(frame));
+    case Raw:
+        return writeBytes(path, encodeRaw(frame));
+    case Jpeg:
+        break;
+    }
+
+    // Encoded in memory so the file still appears in one piece
+    QByteArray jpeg;
+    QBuffer buffer(&jpeg);
+    if (!buffer.open(QIODevice::WriteOnly) || !frame.save(&buffer, "JPG", jpegQuality)) {
+        qDebug() << "Failed to encode capture:" << path;
+        return false;
+    }
+    return writeBytes(path, jpeg);
+}
+
+bool CaptureStore::isJpegData(const QByteArray &data)
+{
+    // SOI marker; anything else would end up misnamed as .jpg
+    return data.size() > 2 && uchar(data[0]) == 0xff && uchar(data[1]) == 0xd8;
+}
+
+QImage CaptureStore::read(const QString &path)
+{
+    if (!isNativeFormat(path)) {
+        QImageReader reader(path);
+        QImage image = reader.read();
+        if (image.isNull()) {
+            qDebug() << "Failed to read capture:" << path << reader.errorString();
+        }
+        return image;
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug() << "Failed to open capture:" << path;
+        return QImage();
+    }
+    QByteArray data = file.readAll();
+    file.close();
+
+    QImage image = path.endsWith(".raw", Qt::CaseInsensitive) ? decodeRaw(data) : decodeQoi(data);
+    if (image.isNull()) {
+        qDebug() << "Corrupt capture:" << path;
+    }
+    return image;
+}
+
+QSize CaptureStore::readSize(const QString &path)
+{
+    if (!isNativeFormat(path)) {
+        return QImageReader(path).size();
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return QSize();
+
+    if (path.endsWith(".raw", Qt::CaseInsensitive)) {
+        RawHeader header;
+        return readRawHeader(file, header) ? QSize(header.width, header.height) : QSize();
+    }
+
+    QByteArray header = file.read(qoiHeaderSize);
+    if (header.size() < qoiHeaderSize || std::memcmp(header.constData(), qoiMagic, 4) != 0) return QSize();
+    const uchar *fields = reinterpret_cast<const uchar *>(header.constData()) + 4;
+    return QSize(int(qFromBigEndian<quint32>(fields)), int(qFromBigEndian<quint32>(fields + 4)));
+}
+
+QImage CaptureStore::readRegion(const QString &path, const QRect &region)
+{
+    if (!path.endsWith(".raw", Qt::CaseInsensitive)) {
+        // QOI is a sequential stream: decode it all, then copy the region
+        QImage image = read(path);
+        return image.isNull() ? image : image.copy(region.intersected(image.rect()));
+    }
+
+    // Raw rows are at fixed offsets, so only the rows of the region are read
+    QFile file(path);
+    RawHeader header;
+    if (!file.open(QIODevice::ReadOnly) || !readRawHeader(file, header)) {
+        qDebug() << "Failed to read raw capture header:" << path;
+        return QImage();
+    }
+
+    QRect clip = region.intersected(QRect(0, 0, header.width, header.height));
+    if (clip.isEmpty()) return QImage();
+
+    QImage image(clip.size(), QImage::Format_RGB888);
+    for (int y = 0; y < clip.height(); ++y) {
+        qint64 offset = rawHeaderSize() + qint64(clip.y() + y) * header.bytesPerLine + qint64(clip.x()) * 3;
+        if (!file.seek(offset)
+            || file.read(reinterpret_cast<char *>(image.scanLine(y)), qint64(clip.width()) * 3) != clip.width() * 3) {
+            qDebug() << "Truncated raw capture:" << path;
+            return QImage();
+        }
+    }
+    return image;
+}
+
+QByteArray CaptureStore::encodeRaw(const QImage &image)
+{
+    QImage rgb = image.convertToFormat(QImage::Format_RGB888);
+    const int width = rgb.width();
+    const int height = rgb.height();
+    const int bytesPerLine = width * 3;
+
+    QByteArray data(rawHeaderSize() + qsizetype(bytesPerLine) * height, Qt::Uninitialized);
+    uchar *out = reinterpret_cast<uchar *>(data.data());
+    std::memcpy(out, rawMagic, 4);
+    qToLittleEndian<quint32>(rawVersion, out + 4);
+    qToLittleEndian<quint32>(quint32(width), out + 8);
+    qToLittleEndian<quint32>(quint32(height), out + 12);
+    qToLittleEndian<quint32>(3, out + 16);
+    qToLittleEndian<quint32>(quint32(bytesPerLine), out + 20);
+
+    // QImage rows are 4-byte aligned; the file rows are packed
+    out += rawHeaderSize();
+    for (int y = 0; y < height; ++y) {
+        std::memcpy(out + qsizetype(y) * bytesPerLine, rgb.constScanLine(y), size_t(bytesPerLine));
+    }
+    return data;
+}
+
+QImage CaptureStore::decodeRaw(const QByteArray &data)
+{
+    RawHeader header;
+    if (!parseRawHeader(data.constData(), data.size(), header)) return QImage();
+    if (data.size() < rawHeaderSize() + qint64(header.bytesPerLine) * header.height) return QImage();
+
+    QImage image(header.width, header.height, QImage::Format_RGB888);
+    const uchar *rows = reinterpret_cast<const uchar *>(data.constData()) + rawHeaderSize();
+    for (int y = 0; y < header.height; ++y) {
+        std::memcpy(image.scanLine(y), rows + qsizetype(y) * header.bytesPerLine, size_t(header.width) * 3);
+    }
+    return image;
+}
+
+QByteArray CaptureStore::encodeQoi(const QImage &image)
+{
+    QImage rgb = image.convertToFormat(QImage::Format_RGB888);
+    const int width = rgb.width();
+    const int height = rgb.height();
+
+    // Worst case is one RGB op (4 bytes) per pixel
+    QByteArray data(qoiHeaderSize + qsizetype(width) * height * 4 + qoiPaddingSize, Qt::Uninitialized);
+    uchar *out = reinterpret_cast<uchar *>(data.data());
+    std::memcpy(out, qoiMagic, 4);
+    qToBigEndian<quint32>(quint32(width), out + 4);
+    qToBigEndian<quint32>(quint32(height), out + 8);
+    out[12] = 3;  // RGB
+    out[13] = 0;  // sRGB with linear alpha
+    qsizetype p = qoiHeaderSize;
+
+    Pixel index[64];
+    std::memset(index, 0, sizeof(index));
+    Pixel previous = { 0, 0, 0, 255 };
+    int run = 0;
+
+    for (int y = 0; y < height; ++y) {
+        const uchar *row = rgb.constScanLine(y);
+        for (int x = 0; x < width; ++x) {
+            Pixel px = { row[x * 3], row[x * 3 + 1], row[x * 3 + 2], 255 };
+
+            if (px == previous) {
+                ++run;
+                if (run == 62) {
+                    out[p++] = QoiOpRun | (run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+
+            if (run > 0) {
+                out[p++] = QoiOpRun | (run - 1);
+                run = 0;
+            }
+
+            int hash = qoiHash(px);
+            if (index[hash] == px) {
+                out[p++] = QoiOpIndex | hash;
+            } else {
+                index[hash] = px;
+
+                signed char dr = static_cast<signed char>(px.r - previous.r);
+                signed char dg = static_cast<signed char>(px.g - previous.g);
+                signed char db = static_cast<signed char>(px.b - previous.b);
+                signed char drDg = static_cast<signed char>(dr - dg);
+                signed char dbDg = static_cast<signed char>(db - dg);
+
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                    out[p++] = QoiOpDiff | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2);
+                } else if (dg >= -32 && dg <= 31 && drDg >= -8 && drDg <= 7 && dbDg >= -8 && dbDg <= 7) {
+                    out[p++] = QoiOpLuma | (dg + 32);
+                    out[p++] = ((drDg + 8) << 4) | (dbDg + 8);
+                } else {
+                    out[p++] = QoiOpRgb;
+                    out[p++] = px.r;
+                    out[p++] = px.g;
+                    out[p++] = px.b;
+                }
+            }
+            previous = px;
+        }
+    }
+
+    if (run > 0) {
+        out[p++] = QoiOpRun | (run - 1);
+    }
+
+    std::memset(out + p, 0, qoiPaddingSize - 1);
+    p += qoiPaddingSize - 1;
+    out[p++] = 1;
+
+    data.truncate(p);
+    return data;
+}
+
+QImage CaptureStore::decodeQoi(const QByteArray &data)
+{
+    if (data.size() < qoiHeaderSize + qoiPaddingSize || std::memcmp(data.constData(), qoiMagic, 4) != 0) {
+        return QImage();
+    }
+
+    const uchar *in = reinterpret_cast<const uchar *>(data.constData());
+    const quint32 width = qFromBigEndian<quint32>(in + 4);
+    const quint32 height = qFromBigEndian<quint32>(in + 8);
+    const int channels = in[12];
+    if (width == 0 || height == 0 || quint64(width) * height > maximumPixels || (channels != 3 && channels != 4)) {
+        return QImage();
+    }
+
+    QImage image(int(width), int(height), QImage::Format_RGB888);
+    if (image.isNull()) return QImage();
+
+    Pixel index[64];
+    std::memset(index, 0, sizeof(index));
+    Pixel px = { 0, 0, 0, 255 };
+    int run = 0;
+    qsizetype p = qoiHeaderSize;
+    const qsizetype end = data.size() - qoiPaddingSize;
+
+    for (quint32 y = 0; y < height; ++y) {
+        uchar *row = image.scanLine(int(y));
+        for (quint32 x = 0; x < width; ++x) {
+            if (run > 0) {
+                --run;
+            } else if (p < end) {
+                const uchar op = in[p++];
+                if (op == QoiOpRgb) {
+                    if (p + 3 > end) return QImage();
+                    px.r = in[p];
+                    px.g = in[p + 1];
+                    px.b = in[p + 2];
+                    p += 3;
+                } else if (op == QoiOpRgba) {
+                    if (p + 4 > end) return QImage();
+                    px.r = in[p];
+                    px.g = in[p + 1];
+                    px.b = in[p + 2];
+                    px.a = in[p + 3];
+                    p += 4;
+                } else if ((op & QoiMask) == QoiOpIndex) {
+                    px = index[op];
+                } else if ((op & QoiMask) == QoiOpDiff) {
+                    px.r += ((op >> 4) & 0x03) - 2;
+                    px.g += ((op >> 2) & 0x03) - 2;
+                    px.b += (op & 0x03) - 2;
+                } else if ((op & QoiMask) == QoiOpLuma) {
+                    if (p + 1 > end) return QImage();
+                    const uchar next = in[p++];
+                    const int dg = (op & 0x3f) - 32;
+                    px.r += dg - 8 + ((next >> 4) & 0x0f);
+                    px.g += dg;
+                    px.b += dg - 8 + (next & 0x0f);
+                } else {
+                    run = op & 0x3f;
+                }
+                index[qoiHash(px)] = px;
+            }
+
+            row[x * 3] = px.r;
+            row[x * 3 + 1] = px.g;
+            row[x * 3 + 2] = px.b;
+        }
+    }
+
+    return image;
+}
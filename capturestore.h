@@ -0,0 +1,79 @@
+#ifndef CAPTURESTORE_H
+#define CAPTURESTORE_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QRect>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+
+// How captured frames are written to a surface directory. The camera already
+// delivers JPEG, so re-encoding at quality 100 costs a full encode per frame
+// and loses quality on top of the camera's own compression. The other formats
+// trade disk space against save latency:
+//
+//   PassThrough  camera bytes as received (image_NN.jpg), no encode at all
+//   Qoi          lossless QOI of the decoded frame (image_NN.qoi)
+//   Raw          uncompressed RGB888 behind a small header (image_NN.raw)
+//   Jpeg         decoded frame re-encoded as JPEG (image_NN.jpg), the old behaviour
+//
+// PassThrough is the default: a capture is then a plain write of bytes the
+// camera window already holds, with no encode between captures and no
+// generational loss. Every format is written atomically, so a reader that
+// sees the file can read all of it.
+//
+// Readers never need to know the format: findCapture() locates a capture
+// whatever it was stored as, and read()/readRegion() decode all of them.
+class CaptureStore
+{
+public:
+    enum Format {
+        PassThrough,
+        Qoi,
+        Raw,
+        Jpeg
+    };
+
+    static QList<Format> formats() { return { PassThrough, Qoi, Raw, Jpeg }; }
+    static QString formatName(Format format);   // Stable name stored in JSON
+    static QString formatLabel(Format format);  // For the settings dialog
+    static Format formatFromName(const QString &name, Format fallback = Jpeg);
+    static QString extension(Format format);
+
+    // Format chosen for this station, kept in the user's config directory;
+    // PassThrough until one is chosen
+    static Format stationFormat();
+    static bool setStationFormat(Format format);
+
+    static QString capturePath(const QString &surfacePath, int imageNumber, Format format);
+    static QString findCapture(const QString &surfacePath, int imageNumber);
+    static QStringList nameFilters();
+    static bool isCaptureName(const QString &fileName);
+    static int imageNumber(const QString &fileName);  // -1 if not a capture name
+
+    // Files written next to a capture, e.g. sidecarPath(path, "_detections.json")
+    static QString sidecarPath(const QString &imagePath, const QString &suffix);
+
+    // True for the formats Qt's image plugins cannot read
+    static bool isNativeFormat(const QString &imagePath);
+
+    // encoded holds the camera's bytes; PassThrough falls back to Jpeg unless they are a JPEG
+    static bool write(const QString &path, Format format, const QImage &frame,
+                      const QByteArray &encoded = QByteArray(), int jpegQuality = 100);
+    static bool isJpegData(const QByteArray &data);
+
+    // Any capture format; QOI and raw are decoded here, the rest through QImageReader
+    static QImage read(const QString &path);
+    static QSize readSize(const QString &path);
+    static QImage readRegion(const QString &path, const QRect &region);
+
+    static QByteArray encodeQoi(const QImage &image);
+    static QImage decodeQoi(const QByteArray &data);
+    static QByteArray encodeRaw(const QImage &image);
+    static QImage decodeRaw(const QByteArray &data);
+
+    static int rawHeaderSize() { return 24; }
+};
+
+#endif // CAPTURESTORE_H
@@ -6,7 +6,10 @@
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QFile>
+#include <QFileInfo>
 #include <QDateTime>
+#include <QElapsedTimer>
+#include <QDebug>
 #include <QPaintEvent>
 
 CaptureWindow::CaptureWindow(QWidget *parent, const QString &surfacePath,
@@ -18,6 +21,7 @@ CaptureWindow::CaptureWindow(QWidget *parent, const QString &surfacePath,
     , imagesInY(imagesInY)
     , sequence(sequence)
     , currentCaptureIndex(0)
+    , storageFormat(CaptureStore::stationFormat())
     , cameraConnected(false)
 {
     setWindowTitle("Surface Capture");
@@ -163,6 +167,7 @@ void CaptureWindow::handleNetworkReply(QNetworkReply *reply)
         
         if (!image.isNull()) {
             lastFrame = image;
+            lastFrameData = imageData;
             cameraConnected = true;
             
             // Create a copy for display with reference box
@@ -222,15 +227,25 @@ void CaptureWindow::captureImage()
         return;
     }
 
-    lastSavedImagePath = QString("%1/image_%2.jpg")
-        .arg(surfacePath)
-        .arg(currentCaptureIndex + 1, 2, 10, QChar('0'));
-    
-    saveImage(lastFrame);
+    lastSavedImagePath = CaptureStore::capturePath(surfacePath, currentCaptureIndex + 1, storageFormat);
+
+    // With pass-through storage this writes the snapshot exactly as the camera
+    // sent it; nothing is encoded between captures
+    QElapsedTimer saveTimer;
+    saveTimer.start();
+    bool saved = saveImage(lastFrame, lastFrameData);
+    qDebug() << "Saved" << lastSavedImagePath << "as" << CaptureStore::formatName(storageFormat)
+             << "in" << saveTimer.elapsed() << "ms";
+    if (!saved) {
+        statusLabel->setText(QString("Failed to save %1").arg(QFileInfo(lastSavedImagePath).fileName()));
+        return;
+    }
     capturedImages.append(lastSavedImagePath);
     
     // Emit signal for the newly captured image
     emit imageCaptured(lastSavedImagePath);
+    // The decoded frame too, so detection does not have to read the file back
+    emit frameCaptured(lastSavedImagePath, lastFrame);
     
     currentCaptureIndex++;
     updateStatusLabel();
@@ -240,9 +255,9 @@ void CaptureWindow::captureImage()
     }
 }
 
-void CaptureWindow::saveImage(const QImage &image)
+bool CaptureWindow::saveImage(const QImage &image, const QByteArray &encoded)
 {
-    image.save(lastSavedImagePath, "JPG", 100);
+    return CaptureStore::write(lastSavedImagePath, storageFormat, image, encoded);
 }
 
 QString CaptureWindow::getCurrentCoordinates() const
@@ -284,6 +299,7 @@ void CaptureWindow::saveSettings()
         sequenceArray.append(num);
     }
     settings["sequence"] = sequenceArray;
+    settings["capture_format"] = CaptureStore::formatName(storageFormat);
 
     QJsonDocument doc(settings);
     QString filename = surfacePath + "/settings.json";
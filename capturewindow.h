@@ -9,6 +9,7 @@
 #include <QTimer>
 #include <QKeyEvent>
 #include <QDir>
+#include "capturestore.h"
 
 class CaptureWindow : public QDialog
 {
@@ -24,8 +25,12 @@ public:
 
     QStringList getCapturedImages() const { return capturedImages; }
 
+    void setStorageFormat(CaptureStore::Format format) { storageFormat = format; }
+    CaptureStore::Format getStorageFormat() const { return storageFormat; }
+
 signals:
     void imageCaptured(const QString &imagePath);
+    void frameCaptured(const QString &imagePath, const QImage &frame);
 
 protected:
     void keyPressEvent(QKeyEvent *event) override;
@@ -42,7 +47,7 @@ private:
     void connectToCamera();
     void updateStatusLabel();
     QString getCurrentCoordinates() const;
-    void saveImage(const QImage &image);
+    bool saveImage(const QImage &image, const QByteArray &encoded);
     void saveSettings();
     void drawReferenceBox(QPainter &painter);
 
@@ -60,6 +65,8 @@ private:
     QVector<int> sequence;
     int currentCaptureIndex;
     QImage lastFrame;
+    QByteArray lastFrameData;  // lastFrame as the camera sent it, for pass-through captures
+    CaptureStore::Format storageFormat;
     
     // TODO: Change camera url
     const QString cameraUrl = "http://192.168.0.7:8080/shot.jpg";
@@ -0,0 +1,245 @@
+#include "cutgridoptimizer.h"
+#include <QElapsedTimer>
+#include <QDebug>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
+
+CutGridLayout CutGridLayout::uniform(int piecesInX, int piecesInY, double surfaceWidth, double surfaceHeight)
+{
+    CutGridLayout layout;
+    layout.piecesInX = piecesInX;
+    layout.piecesInY = piecesInY;
+    layout.pieceWidth = surfaceWidth / piecesInX;
+    layout.pieceHeight = surfaceHeight / piecesInY;
+    return layout;
+}
+
+CutGridOptimizer::CutGridOptimizer(double surfaceWidth, double surfaceHeight, double resolution)
+    : surfaceWidth(surfaceWidth)
+    , surfaceHeight(surfaceHeight)
+    , resolution(resolution > 0.0 ? resolution : defaultResolution())
+    , maxPiecesInX(10)
+    , maxPiecesInY(10)
+    , trimMargin(0.0)
+    , offsetStep(1.0)
+    , lastElapsedMs(0)
+{
+    cellsX = qMax(1, int(std::ceil(surfaceWidth / this->resolution)));
+    cellsY = qMax(1, int(std::ceil(surfaceHeight / this->resolution)));
+}
+
+void CutGridOptimizer::setPieceLimits(int maxPiecesInX, int maxPiecesInY)
+{
+    this->maxPiecesInX = qMax(1, maxPiecesInX);
+    this->maxPiecesInY = qMax(1, maxPiecesInY);
+}
+
+void CutGridOptimizer::setTrimMargin(double margin, double offsetStep)
+{
+    // Leave at least one cell of surface to cut
+    trimMargin = qBound(0.0, margin, qMin(surfaceWidth, surfaceHeight) - resolution);
+    this->offsetStep = offsetStep;
+}
+
+QVector<CutGridLayout> CutGridOptimizer::candidates() const
+{
+    QVector<double> offsets;
+    const int steps = offsetStep > 0.0 ? int(std::floor(trimMargin / offsetStep + 1e-9)) : 0;
+    for (int step = 0; step <= steps; ++step) {
+        offsets.append(step * offsetStep);
+    }
+
+    const double gridWidth = surfaceWidth - trimMargin;
+    const double gridHeight = surfaceHeight - trimMargin;
+
+    QVector<CutGridLayout> grids;
+    grids.reserve(maxPiecesInX * maxPiecesInY * offsets.size() * offsets.size());
+    for (int piecesInX = 1; piecesInX <= maxPiecesInX; ++piecesInX) {
+        for (int piecesInY = 1; piecesInY <= maxPiecesInY; ++piecesInY) {
+            for (double originX : std::as_const(offsets)) {
+                for (double originY : std::as_const(offsets)) {
+                    CutGridLayout grid = CutGridLayout::uniform(piecesInX, piecesInY, gridWidth, gridHeight);
+                    grid.originX = originX;
+                    grid.originY = originY;
+                    grids.append(grid);
+                }
+            }
+        }
+    }
+    return grids;
+}
+
+void CutGridOptimizer::run(const QStringList &surfacePaths, QThreadPool *pool)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const QVector<CutGridLayout> grids = candidates();
+    auto evaluate = [this, &grids](const QString &surfacePath) {
+        DefectStore defects;
+        if (!defects.load(QString("%1/defect_coordinates.json").arg(surfacePath))) {
+            return QVector<int>();  // Not detected yet; left out of the totals
+        }
+        return countFreePieces(defects, grids);
+    };
+
+    QVector<QVector<int>> surfaceCounts;
+    if (pool) {
+        surfaceCounts = QtConcurrent::blockingMapped<QVector<QVector<int>>>(pool, surfacePaths, evaluate);
+    } else {
+        for (const QString &surfacePath : surfacePaths) {
+            surfaceCounts.append(evaluate(surfacePath));
+        }
+    }
+
+    rank(grids, surfaceCounts);
+    lastElapsedMs = timer.elapsed();
+    qDebug() << "Evaluated" << grids.size() << "cutting grids on" << surfacePaths.size()
+             << "surfaces in" << lastElapsedMs << "ms";
+}
+
+void CutGridOptimizer::run(const QVector<DefectStore> &surfaces, QThreadPool *pool)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const QVector<CutGridLayout> grids = candidates();
+    auto evaluate = [this, &grids](const DefectStore &defects) {
+        return countFreePieces(defects, grids);
+    };
+
+    QVector<QVector<int>> surfaceCounts;
+    if (pool) {
+        surfaceCounts = QtConcurrent::blockingMapped<QVector<QVector<int>>>(pool, surfaces, evaluate);
+    } else {
+        for (const DefectStore &defects : surfaces) {
+            surfaceCounts.append(evaluate(defects));
+        }
+    }
+
+    rank(grids, surfaceCounts);
+    lastElapsedMs = timer.elapsed();
+    qDebug() << "Evaluated" << grids.size() << "cutting grids on" << surfaces.size()
+             << "surfaces in" << lastElapsedMs << "ms";
+}
+
+QVector<int> CutGridOptimizer::occupancyTable(const DefectStore &defects) const
+{
+    const int stride = cellsX + 1;
+
+    // Mark each defect's cells in a 2D difference array: +1 and -1 at the
+    // corners of its block, so the cost is per defect, not per covered cell
+    QVector<int> difference(stride * (cellsY + 1), 0);
+    const float *xs = defects.xColumn().constData();
+    const float *ys = defects.yColumn().constData();
+    const float *widths = defects.widthColumn().constData();
+    const float *heights = defects.heightColumn().constData();
+    for (int i = 0; i < defects.size(); ++i) {
+        double left = xs[i];
+        double top = ys[i];
+        double right = left + widths[i];
+        double bottom = top + heights[i];
+
+        // Clipped to the surface as in CuttingAnalyzer::pieceRange()
+        if (right < 0 || left > surfaceWidth || bottom < 0 || top > surfaceHeight) {
+            continue;
+        }
+        const int firstX = qBound(0, int(std::floor(qMax(left, 0.0) / resolution)), cellsX - 1);
+        const int firstY = qBound(0, int(std::floor(qMax(top, 0.0) / resolution)), cellsY - 1);
+        const int lastX = qBound(firstX, int(std::ceil(qMin(right, surfaceWidth) / resolution)) - 1, cellsX - 1);
+        const int lastY = qBound(firstY, int(std::ceil(qMin(bottom, surfaceHeight) / resolution)) - 1, cellsY - 1);
+
+        difference[firstY * stride + firstX] += 1;
+        difference[firstY * stride + lastX + 1] -= 1;
+        difference[(lastY + 1) * stride + firstX] -= 1;
+        difference[(lastY + 1) * stride + lastX + 1] += 1;
+    }
+
+    // One sweep turns the differences into coverage counts and those into the
+    // summed-area table of occupied cells; row 0 and column 0 stay zero
+    QVector<int> table(stride * (cellsY + 1), 0);
+    QVector<int> coverage(cellsX, 0);
+    for (int y = 0; y < cellsY; ++y) {
+        const int *differenceRow = difference.constData() + y * stride;
+        const int *above = table.constData() + y * stride;
+        int *row = table.data() + (y + 1) * stride;
+        int rowDifference = 0;
+        int rowOccupied = 0;
+        for (int x = 0; x < cellsX; ++x) {
+            rowDifference += differenceRow[x];
+            coverage[x] += rowDifference;
+            rowOccupied += coverage[x] > 0;
+            row[x + 1] = above[x + 1] + rowOccupied;
+        }
+    }
+    return table;
+}
+
+QVector<int> CutGridOptimizer::countFreePieces(const DefectStore &defects, const QVector<CutGridLayout> &grids) const
+{
+    QVector<int> counts(grids.size());
+    if (defects.isEmpty()) {
+        for (int g = 0; g < grids.size(); ++g) {
+            counts[g] = grids[g].piecesInX * grids[g].piecesInY;
+        }
+        return counts;
+    }
+
+    const QVector<int> table = occupancyTable(defects);
+    const int stride = cellsX + 1;
+
+    // Cell bounds of the columns and rows, [first, end) in table coordinates
+    QVector<int> columnFirst(maxPiecesInX), columnEnd(maxPiecesInX);
+    QVector<int> rowFirst(maxPiecesInY), rowEnd(maxPiecesInY);
+
+    for (int g = 0; g < grids.size(); ++g) {
+        const CutGridLayout &grid = grids[g];
+        for (int x = 0; x < grid.piecesInX; ++x) {
+            const double left = grid.originX + x * grid.pieceWidth;
+            columnFirst[x] = qBound(0, int(std::floor(left / resolution)), cellsX - 1);
+            columnEnd[x] = qBound(columnFirst[x] + 1, int(std::ceil((left + grid.pieceWidth) / resolution)), cellsX);
+        }
+        for (int y = 0; y < grid.piecesInY; ++y) {
+            const double top = grid.originY + y * grid.pieceHeight;
+            rowFirst[y] = qBound(0, int(std::floor(top / resolution)), cellsY - 1);
+            rowEnd[y] = qBound(rowFirst[y] + 1, int(std::ceil((top + grid.pieceHeight) / resolution)), cellsY);
+        }
+
+        // Four reads per piece, no branches in the inner loop
+        const int *firsts = columnFirst.constData();
+        const int *ends = columnEnd.constData();
+        int free = 0;
+        for (int y = 0; y < grid.piecesInY; ++y) {
+            const int *top = table.constData() + rowFirst[y] * stride;
+            const int *bottom = table.constData() + rowEnd[y] * stride;
+            for (int x = 0; x < grid.piecesInX; ++x) {
+                free += (bottom[ends[x]] - bottom[firsts[x]] - top[ends[x]] + top[firsts[x]]) == 0;
+            }
+        }
+        counts[g] = free;
+    }
+    return counts;
+}
+
+void CutGridOptimizer::rank(QVector<CutGridLayout> grids, const QVector<QVector<int>> &surfaceCounts)
+{
+    int surfaces = 0;
+    for (const QVector<int> &counts : surfaceCounts) {
+        if (counts.size() != grids.size()) continue;
+        ++surfaces;
+        for (int g = 0; g < grids.size(); ++g) {
+            grids[g].freePieces += counts[g];
+        }
+    }
+    for (CutGridLayout &grid : grids) {
+        grid.totalPieces = grid.piecesInX * grid.piecesInY * surfaces;
+    }
+
+    std::stable_sort(grids.begin(), grids.end(), [](const CutGridLayout &a, const CutGridLayout &b) {
+        if (a.freePieces != b.freePieces) return a.freePieces > b.freePieces;
+        if (a.totalPieces != b.totalPieces) return a.totalPieces < b.totalPieces;
+        return a.originX + a.originY < b.originX + b.originY;
+    });
+    rankedLayouts = grids;
+}
@@ -0,0 +1,85 @@
+#ifndef CUTGRIDOPTIMIZER_H
+#define CUTGRIDOPTIMIZER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "defectstore.h"
+
+class QThreadPool;
+
+// One uniform cutting grid: piecesInX x piecesInY pieces of the same size,
+// with the grid's top left corner at the origin. The default grid covers the
+// whole surface; a grid inside a trim margin may sit anywhere within it.
+struct CutGridLayout {
+    int piecesInX = 1;
+    int piecesInY = 1;
+    double originX = 0.0;      // mm from the surface's top left
+    double originY = 0.0;
+    double pieceWidth = 0.0;   // mm
+    double pieceHeight = 0.0;
+    int freePieces = 0;        // Defect-free pieces over every evaluated surface
+    int totalPieces = 0;
+
+    static CutGridLayout uniform(int piecesInX, int piecesInY, double surfaceWidth, double surfaceHeight);
+    double yield() const { return totalPieces > 0 ? double(freePieces) / totalPieces : 0.0; }
+};
+
+// Searches cutting grids for the most defect-free pieces over a session.
+//
+// Every combination of piece counts and grid origin within the trim margin is
+// a candidate, typically thousands of them. Each surface's defects are
+// rasterized once into an occupancy grid and turned into a summed-area table,
+// so testing a piece is four table reads however many defects there are; the
+// surfaces are evaluated concurrently on pool when given.
+//
+// A raster cell counts as occupied when a defect reaches into it, and a piece
+// is tested against every cell it touches, so a piece is never reported free
+// when CuttingAnalyzer would find a defect in it. Near cuts the test can be
+// stricter than the analyzer by up to one cell, hence the fine default raster
+// (about 2 MB of table per surface being evaluated).
+class CutGridOptimizer
+{
+public:
+    CutGridOptimizer(double surfaceWidth, double surfaceHeight,
+                     double resolution = defaultResolution());
+
+    static double defaultResolution() { return 0.5; }  // mm per raster cell
+
+    void setPieceLimits(int maxPiecesInX, int maxPiecesInY);
+    // The grid gives up margin mm in each direction and may be moved within
+    // it in steps of offsetStep mm. A zero margin only tries the full surface.
+    void setTrimMargin(double margin, double offsetStep = 1.0);
+
+    QVector<CutGridLayout> candidates() const;
+
+    // Reads defect_coordinates.json of every surface in the worker
+    void run(const QStringList &surfacePaths, QThreadPool *pool = nullptr);
+    void run(const QVector<DefectStore> &surfaces, QThreadPool *pool = nullptr);
+
+    // Best first: most defect-free pieces, then the fewest pieces overall
+    // (larger pieces), then the grid closest to the surface's corner
+    QVector<CutGridLayout> layouts() const { return rankedLayouts; }
+    qint64 elapsedMs() const { return lastElapsedMs; }
+
+private:
+    // Summed-area table of occupied cells, (cellsX + 1) x (cellsY + 1)
+    QVector<int> occupancyTable(const DefectStore &defects) const;
+    // Defect-free pieces of every candidate on one surface
+    QVector<int> countFreePieces(const DefectStore &defects, const QVector<CutGridLayout> &grids) const;
+    void rank(QVector<CutGridLayout> grids, const QVector<QVector<int>> &surfaceCounts);
+
+    double surfaceWidth;
+    double surfaceHeight;
+    double resolution;
+    int cellsX;
+    int cellsY;
+    int maxPiecesInX;
+    int maxPiecesInY;
+    double trimMargin;
+    double offsetStep;
+    QVector<CutGridLayout> rankedLayouts;
+    qint64 lastElapsedMs;
+};
+
+#endif // CUTGRIDOPTIMIZER_H
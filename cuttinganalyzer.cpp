@@ -3,7 +3,7 @@
 #include <QFile>
 #include <QJsonDocument>
 #include <QDebug>
-#include <QPointF>
+#include <cmath>
 
 CuttingAnalyzer::CuttingAnalyzer(const QString &sessionPath,
                                int piecesInX,
@@ -14,7 +14,10 @@ CuttingAnalyzer::CuttingAnalyzer(const QString &sessionPath,
       piecesInX(piecesInX),
       piecesInY(piecesInY),
       surfaceWidth(surfaceWidth),
-      surfaceHeight(surfaceHeight)
+      surfaceHeight(surfaceHeight),
+      originX(0.0),
+      originY(0.0),
+      surfaceIndex(1)
 {
     qDebug() << "Initializing CuttingAnalyzer:";
     qDebug() << "  Session path:" << sessionPath;
@@ -26,32 +29,29 @@ CuttingAnalyzer::CuttingAnalyzer(const QString &sessionPath,
     pieceHeight = surfaceHeight / piecesInY;
     qDebug() << "  Piece dimensions:" << pieceWidth << "x" << pieceHeight << "mm";
 
-    // Initialize pieces vector with correct dimensions
-    pieces.resize(piecesInX);
+    // One flat grid of pieces
+    pieces.resize(piecesInX * piecesInY);
     for (int x = 0; x < piecesInX; ++x) {
-        pieces[x].resize(piecesInY);
         for (int y = 0; y < piecesInY; ++y) {
-            pieces[x][y].x = x + 1;  // 1-based indexing
-            pieces[x][y].y = y + 1;  // 1-based indexing
+            pieces[pieceIndex(x, y)].x = x + 1;  // 1-based indexing
+            pieces[pieceIndex(x, y)].y = y + 1;  // 1-based indexing
         }
     }
 }
 
+void CuttingAnalyzer::setGrid(double originX, double originY, double pieceWidth, double pieceHeight)
+{
+    this->originX = originX;
+    this->originY = originY;
+    this->pieceWidth = pieceWidth;
+    this->pieceHeight = pieceHeight;
+    qDebug() << "  Grid origin:" << originX << "," << originY << "mm, pieces:"
+             << pieceWidth << "x" << pieceHeight << "mm";
+}
+
 bool CuttingAnalyzer::analyzeSurfaces()
 {
-    qDebug() << "\nAnalyzing surface at path:" << sessionPath;
-    
-    // Clear any previous analysis
-    for (auto &column : pieces) {
-        for (auto &piece : column) {
-            piece.defects.clear();
-        }
-    }
-    outsideDefects = QJsonArray();
-    
-    // Analyze the surface
-    if (!analyzeDefectsInSurface(sessionPath, 1)) {
-        qWarning() << "Failed to analyze defects in surface";
+    if (!analyze()) {
         return false;
     }
 
@@ -71,94 +71,137 @@ bool CuttingAnalyzer::analyzeSurfaces()
     return true;
 }
 
-bool CuttingAnalyzer::analyzeDefectsInSurface(const QString &surfacePath, int surfaceIndex)
+bool CuttingAnalyzer::analyze()
 {
-    QString coordFile = QString("%1/defect_coordinates.json").arg(surfacePath);
-    qDebug() << "Reading defect coordinates from:" << coordFile;
+    qDebug() << "\nAnalyzing surface at path:" << sessionPath;
+    
+    // Clear any previous analysis
+    for (CutPiece &piece : pieces) {
+        piece.firstDefect = 0;
+        piece.defectCount = 0;
+    }
+    pieceDefects.clear();
+    outsideDefects.clear();
     
-    QFile file(coordFile);
-    if (!file.open(QIODevice::ReadOnly)) {
-        qWarning() << "Could not open defect coordinates file:" << coordFile;
+    // Analyze the surface
+    if (!analyzeDefectsInSurface(sessionPath, 1)) {
+        qWarning() << "Failed to analyze defects in surface";
         return false;
     }
+    return true;
+}
 
-    QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
-    file.close();
+bool CuttingAnalyzer::analyzeDefectsInSurface(const QString &surfacePath, int surfaceIndex)
+{
+    QString coordFile = QString("%1/defect_coordinates.json").arg(surfacePath);
+    qDebug() << "Reading defect coordinates from:" << coordFile;
 
-    if (!doc.isObject()) {
-        qWarning() << "Invalid JSON format in file:" << coordFile;
+    if (!defects.load(coordFile)) {
         return false;
     }
-
-    QJsonArray defects = doc.object()["defects"].toArray();
+    this->surfaceIndex = surfaceIndex;
     qDebug() << "Found" << defects.size() << "defects in surface" << surfaceIndex;
 
-    for (const QJsonValue &defectValue : defects) {
-        QJsonObject defect = defectValue.toObject();
-        QJsonObject physicalPos = defect["physical_position"].toObject();
-
-        // Get defect position and size
-        double x = physicalPos["x"].toDouble();
-        double y = physicalPos["y"].toDouble();
-        double width = physicalPos["width"].toDouble();
-        double height = physicalPos["height"].toDouble();
-
-        qDebug() << "Processing defect at:" << x << "," << y << "with size:" << width << "x" << height << "mm";
-
-        // Add surface index to the defect object
-        QJsonObject enrichedDefect = defect;
-        enrichedDefect["surface_index"] = surfaceIndex;
-
-        // Check all corners of the defect to determine affected pieces
-        QVector<QPair<int, int>> affectedPieces;
-        QVector<QPointF> corners;
-        corners.append(QPointF(x, y));                       // Top-left
-        corners.append(QPointF(x + width, y));               // Top-right
-        corners.append(QPointF(x, y + height));              // Bottom-left
-        corners.append(QPointF(x + width, y + height));      // Bottom-right
-        corners.append(QPointF(x + width/2, y + height/2));  // Center
-
-        bool isOutside = true;
-        for (const QPointF &corner : corners) {
-            // Skip if point is outside surface bounds
-            if (corner.x() < 0 || corner.x() > surfaceWidth ||
-                corner.y() < 0 || corner.y() > surfaceHeight) {
-                continue;
+    // Record every (piece, defect) hit, counting per piece as we go
+    const int defectCount = defects.size();
+    QVector<int> hitPieces;
+    QVector<int> hitDefects;
+    hitPieces.reserve(defectCount * 2);
+    hitDefects.reserve(defectCount * 2);
+    for (int i = 0; i < defectCount; ++i) {
+        int firstX, lastX, firstY, lastY;
+        if (!pieceRange(i, firstX, lastX, firstY, lastY)) {
+            outsideDefects.append(i);
+            continue;
+        }
+        for (int x = firstX; x <= lastX; ++x) {
+            for (int y = firstY; y <= lastY; ++y) {
+                const int index = pieceIndex(x, y);
+                ++pieces[index].defectCount;
+                hitPieces.append(index);
+                hitDefects.append(i);
             }
+        }
+    }
 
-            // Calculate which piece this point belongs to
-            int pieceX = qMin(static_cast<int>(corner.x() / pieceWidth) + 1, piecesInX);
-            int pieceY = qMin(static_cast<int>(corner.y() / pieceHeight) + 1, piecesInY);
+    // Then lay the hits out as one contiguous run per piece, defects in
+    // file order within each
+    int offset = 0;
+    for (CutPiece &piece : pieces) {
+        piece.firstDefect = offset;
+        offset += piece.defectCount;
+        piece.defectCount = 0;
+    }
+    pieceDefects.resize(offset);
+    for (int h = 0; h < hitPieces.size(); ++h) {
+        CutPiece &piece = pieces[hitPieces[h]];
+        pieceDefects[piece.firstDefect + piece.defectCount++] = hitDefects[h];
+    }
 
-            // Add to affected pieces if not already included
-            QPair<int, int> piece(pieceX, pieceY);
-            if (!affectedPieces.contains(piece)) {
-                affectedPieces.append(piece);
-                isOutside = false;
-                qDebug() << "  Affects piece:" << pieceX << "," << pieceY;
-            }
-        }
+    qDebug() << offset << "piece hits," << outsideDefects.size() << "defects outside the surface";
+    return true;
+}
 
-        if (isOutside) {
-            qDebug() << "  Defect is outside surface bounds";
-            outsideDefects.append(enrichedDefect);
-        } else {
-            addDefectToPieces(enrichedDefect, affectedPieces);
-        }
+QRectF CuttingAnalyzer::gridRect() const
+{
+    return QRectF(originX, originY,
+                  qMin(piecesInX * pieceWidth, surfaceWidth - originX),
+                  qMin(piecesInY * pieceHeight, surfaceHeight - originY));
+}
+
+bool CuttingAnalyzer::pieceRange(int defect, int &firstX, int &lastX, int &firstY, int &lastY) const
+{
+    // Relative to the grid's corner
+    double left = defects.xColumn()[defect] - originX;
+    double top = defects.yColumn()[defect] - originY;
+    double right = left + defects.widthColumn()[defect];
+    double bottom = top + defects.heightColumn()[defect];
+    const QRectF grid = gridRect();
+    const double gridWidth = grid.width();
+    const double gridHeight = grid.height();
+
+    // Entirely off the grid: off the surface or in the trim
+    if (right < 0 || left > gridWidth || bottom < 0 || top > gridHeight) {
+        return false;
     }
 
+    // Partly off: only the part on the grid counts
+    left = qMax(left, 0.0);
+    top = qMax(top, 0.0);
+    right = qMin(right, gridWidth);
+    bottom = qMin(bottom, gridHeight);
+
+    // An edge lying exactly on a cut does not reach into the next piece; a
+    // defect with no extent still falls in the piece holding it
+    firstX = qBound(0, int(std::floor(left / pieceWidth)), piecesInX - 1);
+    firstY = qBound(0, int(std::floor(top / pieceHeight)), piecesInY - 1);
+    lastX = qBound(firstX, int(std::ceil(right / pieceWidth)) - 1, piecesInX - 1);
+    lastY = qBound(firstY, int(std::ceil(bottom / pieceHeight)) - 1, piecesInY - 1);
     return true;
 }
 
-void CuttingAnalyzer::addDefectToPieces(const QJsonObject &defect, const QVector<QPair<int, int>> &affectedPieces)
+QJsonObject CuttingAnalyzer::defectObject(int defect) const
+{
+    QJsonObject object = defects.sourceObject(defect);
+    object["surface_index"] = surfaceIndex;
+    return object;
+}
+
+QVector<int> CuttingAnalyzer::defectsInPiece(int x, int y) const
 {
-    for (const auto &piece : affectedPieces) {
-        int x = piece.first - 1;   // Convert to 0-based index
-        int y = piece.second - 1;  // Convert to 0-based index
-        if (x >= 0 && x < piecesInX && y >= 0 && y < piecesInY) {
-            pieces[x][y].defects.append(defect);
+    const CutPiece &cut = piece(x, y);
+    return pieceDefects.mid(cut.firstDefect, cut.defectCount);
+}
+
+QStringList CuttingAnalyzer::piecesWithDefects() const
+{
+    QStringList pieceIds;
+    for (const CutPiece &cut : pieces) {
+        if (cut.defectCount > 0) {
+            pieceIds.append(QString("x%1y%2").arg(cut.x).arg(cut.y));
         }
     }
+    return pieceIds;
 }
 
 bool CuttingAnalyzer::saveAnalysis(const QString &outputPath, const QString &surfaceName)
@@ -177,6 +220,8 @@ bool CuttingAnalyzer::saveAnalysis(const QString &outputPath, const QString &sur
     metadata["pieces_in_y"] = piecesInY;
     metadata["surface_width"] = surfaceWidth;
     metadata["surface_height"] = surfaceHeight;
+    metadata["origin_x"] = originX;
+    metadata["origin_y"] = originY;
     metadata["piece_width"] = pieceWidth;
     metadata["piece_height"] = pieceHeight;
     root["metadata"] = metadata;
@@ -192,32 +237,35 @@ bool CuttingAnalyzer::saveAnalysis(const QString &outputPath, const QString &sur
     for (int x = 0; x < piecesInX; ++x) {
         for (int y = 0; y < piecesInY; ++y) {
             totalPieces++;
+            const CutPiece &piece = pieces[pieceIndex(x, y)];
             QJsonObject pieceObj;
-            pieceObj["x"] = pieces[x][y].x;
-            pieceObj["y"] = pieces[x][y].y;
-            
-            // Convert defects to JSON array
+            pieceObj["x"] = piece.x;
+            pieceObj["y"] = piece.y;
+
+            // Defects go back to JSON only here
             QJsonArray defectsArray;
-            for (const QJsonObject &defect : pieces[x][y].defects) {
-                defectsArray.append(defect);
+            for (int k = 0; k < piece.defectCount; ++k) {
+                defectsArray.append(defectObject(pieceDefects[piece.firstDefect + k]));
             }
             pieceObj["defects"] = defectsArray;
-            
+
             // If this piece has defects, add it to the tracking array
-            if (!pieces[x][y].defects.isEmpty()) {
-                QString pieceId = QString("x%1y%2").arg(pieces[x][y].x).arg(pieces[x][y].y);
+            if (piece.defectCount > 0) {
+                QString pieceId = QString("x%1y%2").arg(piece.x).arg(piece.y);
                 piecesWithDefects.append(pieceId);
                 piecesWithDefectsCount++;
-                qDebug() << "Found piece with defects:" << pieceId 
-                        << "(" << pieces[x][y].defects.size() << "defects)";
             }
-            
+
             piecesArray.append(pieceObj);
         }
     }
+    QJsonArray outsideArray;
+    for (int defect : std::as_const(outsideDefects)) {
+        outsideArray.append(defectObject(defect));
+    }
     root["pieces"] = piecesArray;
     root["pieces_with_defects"] = piecesWithDefects;
-    root["outside_defects"] = outsideDefects;
+    root["outside_defects"] = outsideArray;
 
     qDebug() << "Pieces summary:";
     qDebug() << "- Total pieces:" << totalPieces;
@@ -4,13 +4,16 @@
 #include <QString>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QRectF>
+#include <QStringList>
 #include <QVector>
-#include <QPair>
+#include "defectstore.h"
 
 struct CutPiece {
     int x;  // x-index of the piece (1-based)
     int y;  // y-index of the piece (1-based)
-    QVector<QJsonObject> defects;  // defects located in this piece
+    int firstDefect = 0;  // This piece's run in CuttingAnalyzer::pieceDefects
+    int defectCount = 0;
 };
 
 class CuttingAnalyzer {
@@ -21,24 +24,52 @@ public:
                     double surfaceWidth,
                     double surfaceHeight);
 
-    bool analyzeSurfaces();
+    // Moves the grid off the surface's corner, with pieces of the given size;
+    // defects in the trim around it belong to no piece. Call before analyzing.
+    void setGrid(double originX, double originY, double pieceWidth, double pieceHeight);
+    // The part of the surface the grid covers, in mm; pieces cut off by the
+    // surface's edge end with it
+    QRectF gridRect() const;
+
+    bool analyzeSurfaces();  // analyze(), then writes cutting_analysis.json
+    bool analyze();          // Only fills in the results below
     bool saveAnalysis(const QString &outputPath, const QString &surfaceName);
 
+    // Results. Pieces are addressed 1-based, as in the piece ids ("x1y2").
+    QString surfacePath() const { return sessionPath; }
+    const CutPiece &piece(int x, int y) const { return pieces[pieceIndex(x - 1, y - 1)]; }
+    bool hasDefects(int x, int y) const { return piece(x, y).defectCount > 0; }
+    QVector<int> defectsInPiece(int x, int y) const;  // Indices into defectStore()
+    QStringList piecesWithDefects() const;            // In saved (x-major) order
+    const QVector<int> &defectsOutside() const { return outsideDefects; }
+    const DefectStore &defectStore() const { return defects; }
+
 private:
     bool analyzeDefectsInSurface(const QString &surfacePath, int surfaceIndex);
-    bool isDefectInPiece(const QJsonObject &defect, int pieceX, int pieceY);
-    bool isPointInPiece(double x, double y, int pieceX, int pieceY);
-    void addDefectToPieces(const QJsonObject &defect, const QVector<QPair<int, int>> &affectedPieces);
+    // Flat index of a piece, 0-based coordinates; x-major like the saved order
+    int pieceIndex(int x, int y) const { return x * piecesInY + y; }
+    // The 0-based columns and rows of the pieces the defect overlaps, after
+    // clipping it to the grid; false if nothing of it is on the grid
+    bool pieceRange(int defect, int &firstX, int &lastX, int &firstY, int &lastY) const;
+    QJsonObject defectObject(int defect) const;  // As loaded, plus surface_index
 
     QString sessionPath;
     int piecesInX;
     int piecesInY;
     double surfaceWidth;
     double surfaceHeight;
+    double originX;
+    double originY;
     double pieceWidth;
     double pieceHeight;
-    QVector<QVector<CutPiece>> pieces;  // 2D vector of pieces [x][y]
-    QJsonArray outsideDefects;  // defects that fall outside the surface
+    int surfaceIndex;
+
+    // Defects are held once, in the store; pieces and the outside list only
+    // refer to them by index
+    DefectStore defects;
+    QVector<CutPiece> pieces;     // piecesInX * piecesInY, see pieceIndex()
+    QVector<int> pieceDefects;    // Defect indices grouped by piece
+    QVector<int> outsideDefects;  // Defects that fall outside the grid
 };
 
 #endif // CUTTINGANALYZER_H 
\ No newline at end of file
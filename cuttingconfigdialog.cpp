@@ -3,6 +3,7 @@
 #include <QHBoxLayout>
 #include <QGroupBox>
 #include <QDialogButtonBox>
+#include <QtConcurrent>
 
 CuttingConfigDialog::CuttingConfigDialog(QWidget *parent,
                                        double surfaceWidth,
@@ -19,6 +20,36 @@ CuttingConfigDialog::CuttingConfigDialog(QWidget *parent,
 {
     setWindowTitle("Cutting Configuration");
     setupUI();
+
+    connect(&optimizerWatcher, &QFutureWatcher<QVector<CutGridLayout>>::finished,
+            this, &CuttingConfigDialog::onSuggestionsReady);
+}
+
+CuttingConfigDialog::~CuttingConfigDialog()
+{
+    // The search has its own copies of everything it reads
+    optimizerWatcher.waitForFinished();
+}
+
+void CuttingConfigDialog::setSurfacePaths(const QStringList &paths)
+{
+    surfacePaths = paths;
+    suggestButton->setEnabled(!surfacePaths.isEmpty());
+}
+
+bool CuttingConfigDialog::hasSelectedLayout() const
+{
+    int row = layoutList->currentRow();
+    if (row < 0 || row >= suggestions.size()) return false;
+    return suggestions[row].piecesInX == getPiecesInX() && suggestions[row].piecesInY == getPiecesInY();
+}
+
+CutGridLayout CuttingConfigDialog::getSelectedLayout() const
+{
+    if (!hasSelectedLayout()) {
+        return CutGridLayout::uniform(getPiecesInX(), getPiecesInY(), surfaceWidth, surfaceHeight);
+    }
+    return suggestions[layoutList->currentRow()];
 }
 
 void CuttingConfigDialog::setupUI()
@@ -80,8 +111,43 @@ void CuttingConfigDialog::setupUI()
     totalPiecesAllLabel = new QLabel(this);
     configLayout->addWidget(totalPiecesLabel);
     configLayout->addWidget(totalPiecesAllLabel);
+
+    // Instead of the grid, plan cuts per surface that avoid its defects
+    guillotineCheckBox = new QCheckBox("Cut around defects (guillotine)", this);
+    guillotineCheckBox->setToolTip("Cut each surface into as many defect-free pieces of the grid's "
+                                   "piece size as fit between its defects");
+    configLayout->addWidget(guillotineCheckBox);
     
     mainLayout->addWidget(configGroup);
+
+    // Layout suggestions from the session's defects
+    QGroupBox *suggestGroup = new QGroupBox("Suggested Layouts", this);
+    QVBoxLayout *suggestLayout = new QVBoxLayout(suggestGroup);
+
+    QHBoxLayout *trimLayout = new QHBoxLayout();
+    QLabel *trimLabel = new QLabel("Trim margin:", this);
+    trimMarginSpinBox = new QDoubleSpinBox(this);
+    trimMarginSpinBox->setRange(0.0, 20.0);
+    trimMarginSpinBox->setSingleStep(0.5);
+    trimMarginSpinBox->setDecimals(1);
+    trimMarginSpinBox->setSuffix(" mm");
+    trimMarginSpinBox->setValue(0.0);
+    suggestButton = new QPushButton("Suggest Layouts", this);
+    suggestButton->setEnabled(false);
+    trimLayout->addWidget(trimLabel);
+    trimLayout->addWidget(trimMarginSpinBox);
+    trimLayout->addStretch();
+    trimLayout->addWidget(suggestButton);
+    suggestLayout->addLayout(trimLayout);
+
+    layoutList = new QListWidget(this);
+    layoutList->setMinimumHeight(120);
+    suggestLayout->addWidget(layoutList);
+
+    suggestStatusLabel = new QLabel(this);
+    suggestLayout->addWidget(suggestStatusLabel);
+
+    mainLayout->addWidget(suggestGroup);
     
     // Create stacking method group
     QGroupBox *stackingGroup = new QGroupBox("Stacking Method", this);
@@ -112,6 +178,8 @@ void CuttingConfigDialog::setupUI()
             this, &CuttingConfigDialog::onPiecesChanged);
     connect(piecesInYSpinBox, QOverload<int>::of(&QSpinBox::valueChanged),
             this, &CuttingConfigDialog::onPiecesChanged);
+    connect(suggestButton, &QPushButton::clicked, this, &CuttingConfigDialog::onSuggestLayouts);
+    connect(layoutList, &QListWidget::currentRowChanged, this, &CuttingConfigDialog::onLayoutSelected);
     
     // Initial update
     onPiecesChanged();
@@ -126,4 +194,66 @@ void CuttingConfigDialog::onPiecesChanged()
         .arg(piecesPerSurface));
     totalPiecesAllLabel->setText(QString("Total pieces across all surfaces: %1")
         .arg(totalPieces));
-} 
\ No newline at end of file
+}
+
+void CuttingConfigDialog::onSuggestLayouts()
+{
+    if (surfacePaths.isEmpty() || optimizerWatcher.isRunning()) return;
+
+    suggestButton->setEnabled(false);
+    suggestStatusLabel->setText("Searching layouts...");
+
+    const QStringList paths = surfacePaths;
+    const double width = surfaceWidth;
+    const double height = surfaceHeight;
+    const double margin = trimMarginSpinBox->value();
+    const int maxPiecesInX = piecesInXSpinBox->maximum();
+    const int maxPiecesInY = piecesInYSpinBox->maximum();
+    QThreadPool *pool = &optimizerPool;
+    optimizerWatcher.setFuture(QtConcurrent::run([=]() {
+        CutGridOptimizer optimizer(width, height);
+        optimizer.setPieceLimits(maxPiecesInX, maxPiecesInY);
+        optimizer.setTrimMargin(margin);
+        optimizer.run(paths, pool);
+        return optimizer.layouts();
+    }));
+}
+
+void CuttingConfigDialog::onSuggestionsReady()
+{
+    const QVector<CutGridLayout> layouts = optimizerWatcher.result();
+    suggestButton->setEnabled(!surfacePaths.isEmpty());
+
+    // Only the best few are worth reading through
+    const int shown = qMin(int(layouts.size()), 20);
+    suggestions = layouts.mid(0, shown);
+
+    layoutList->blockSignals(true);
+    layoutList->clear();
+    for (const CutGridLayout &layout : std::as_const(suggestions)) {
+        layoutList->addItem(QString("%1 × %2 pieces of %3 × %4 mm at (%5, %6) mm: %7 of %8 free (%9%)")
+            .arg(layout.piecesInX)
+            .arg(layout.piecesInY)
+            .arg(layout.pieceWidth, 0, 'f', 1)
+            .arg(layout.pieceHeight, 0, 'f', 1)
+            .arg(layout.originX, 0, 'f', 1)
+            .arg(layout.originY, 0, 'f', 1)
+            .arg(layout.freePieces)
+            .arg(layout.totalPieces)
+            .arg(layout.yield() * 100, 0, 'f', 1));
+    }
+    layoutList->setCurrentRow(-1);  // Nothing is applied until the operator picks one
+    layoutList->blockSignals(false);
+
+    suggestStatusLabel->setText(QString("Evaluated %1 layouts").arg(layouts.size()));
+}
+
+void CuttingConfigDialog::onLayoutSelected()
+{
+    int row = layoutList->currentRow();
+    if (row < 0 || row >= suggestions.size()) return;
+
+    // The counts go to the spin boxes; origin and piece size come with getSelectedLayout()
+    piecesInXSpinBox->setValue(suggestions[row].piecesInX);
+    piecesInYSpinBox->setValue(suggestions[row].piecesInY);
+}
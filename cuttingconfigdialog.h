@@ -5,7 +5,15 @@
 #include <QLabel>
 #include <QSpinBox>
 #include <QRadioButton>
+#include <QCheckBox>
 #include <QPushButton>
+#include <QDoubleSpinBox>
+#include <QListWidget>
+#include <QStringList>
+#include <QVector>
+#include <QFutureWatcher>
+#include <QThreadPool>
+#include "cutgridoptimizer.h"
 
 class CuttingConfigDialog : public QDialog
 {
@@ -18,10 +26,19 @@ public:
                                double captureWidth = 140.0,
                                double captureHeight = 99.0,
                                int surfaceCount = 1);
+    ~CuttingConfigDialog();
+
+    // Surfaces whose defects the layout suggestions are computed from
+    void setSurfacePaths(const QStringList &paths);
     
     int getPiecesInX() const { return piecesInXSpinBox->value(); }
     int getPiecesInY() const { return piecesInYSpinBox->value(); }
     bool isXAxisStacking() const { return xAxisStackingRadio->isChecked(); }
+    // Pieces of the grid's size, cut around each surface's defects
+    bool isGuillotineCutting() const { return guillotineCheckBox->isChecked(); }
+    // A suggested layout is chosen and its piece counts were not changed since
+    bool hasSelectedLayout() const;
+    CutGridLayout getSelectedLayout() const;
 
 private:
     void setupUI();
@@ -34,8 +51,13 @@ private:
     QSpinBox *piecesInYSpinBox;
     QLabel *totalPiecesLabel;
     QLabel *totalPiecesAllLabel;
+    QCheckBox *guillotineCheckBox;
     QRadioButton *xAxisStackingRadio;
     QRadioButton *singleStackRadio;
+    QDoubleSpinBox *trimMarginSpinBox;
+    QPushButton *suggestButton;
+    QListWidget *layoutList;
+    QLabel *suggestStatusLabel;
     QPushButton *okButton;
     QPushButton *cancelButton;
 
@@ -44,9 +66,16 @@ private:
     double captureWidth;
     double captureHeight;
     int surfaceCount;
+    QStringList surfacePaths;
+    QVector<CutGridLayout> suggestions;  // Best first, as listed
+    QThreadPool optimizerPool;
+    QFutureWatcher<QVector<CutGridLayout>> optimizerWatcher;
 
 private slots:
     void onPiecesChanged();
+    void onSuggestLayouts();
+    void onSuggestionsReady();
+    void onLayoutSelected();
 };
 
 #endif // CUTTINGCONFIGDIALOG_H 
\ No newline at end of file
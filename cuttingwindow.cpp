@@ -1,5 +1,7 @@
 #include "cuttingwindow.h"
 #include "cuttinganalyzer.h"
+#include "tilepyramid.h"
+#include "defectoverlay.h"
 #include <QDir>
 #include <QFile>
 #include <QJsonDocument>
@@ -9,22 +11,36 @@
 #include <QFileInfo>
 #include <QDebug>
 #include <QPainter>
+#include <QPainterPath>
 #include <QFont>
 #include <QPen>
 #include <QRectF>
+#include <cmath>
 
 CuttingWindow::CuttingWindow(QWidget *parent, 
                            const QString &sessionPath,
                            int piecesInX,
                            int piecesInY,
-                           bool useXAxisStacking)
+                           bool useXAxisStacking,
+                           double surfaceWidth,
+                           double surfaceHeight)
     : QDialog(parent),
       sessionPath(sessionPath),
       piecesInX(piecesInX),
       piecesInY(piecesInY),
       useXAxisStacking(useXAxisStacking),
-      analyzer(nullptr)
+      surfaceWidth(surfaceWidth),
+      surfaceHeight(surfaceHeight),
+      gridOriginX(0.0),
+      gridOriginY(0.0),
+      pieceWidth(surfaceWidth / piecesInX),
+      pieceHeight(surfaceHeight / piecesInY),
+      guillotineCutting(false),
+      sessionAnalyzer(new SessionAnalyzer(piecesInX, piecesInY, surfaceWidth, surfaceHeight, this))
 {
+    connect(sessionAnalyzer, &SessionAnalyzer::progress, this, &CuttingWindow::onAnalysisProgress);
+    connect(sessionAnalyzer, &SessionAnalyzer::finished, this, &CuttingWindow::onAnalysisFinished);
+
     setupUI();
     loadSurfaces();
     // Note: performCuttingAnalysis() will be called after user confirms configuration
@@ -32,7 +48,30 @@ CuttingWindow::CuttingWindow(QWidget *parent,
 
 CuttingWindow::~CuttingWindow()
 {
-    delete analyzer;
+}
+
+void CuttingWindow::setCutGrid(const CutGridLayout &layout)
+{
+    // Only the placement and size of the pieces; their counts are fixed
+    gridOriginX = layout.originX;
+    gridOriginY = layout.originY;
+    pieceWidth = layout.pieceWidth;
+    pieceHeight = layout.pieceHeight;
+    sessionAnalyzer->setGrid(gridOriginX, gridOriginY, pieceWidth, pieceHeight);
+    updateSummaryText();
+}
+
+void CuttingWindow::setGuillotineCutting(bool enabled)
+{
+    guillotineCutting = enabled;
+    sessionAnalyzer->setGuillotinePlanning(enabled);
+    updateSummaryText();
+}
+
+QRectF CuttingWindow::pieceRect(int x, int y) const
+{
+    return QRectF(gridOriginX + (x - 1) * pieceWidth, gridOriginY + (y - 1) * pieceHeight,
+                  pieceWidth, pieceHeight);
 }
 
 void CuttingWindow::performCuttingAnalysis()
@@ -41,8 +80,9 @@ void CuttingWindow::performCuttingAnalysis()
     qDebug() << "Session path:" << sessionPath;
     qDebug() << "Configuration:";
     qDebug() << "- Pieces:" << piecesInX << "x" << piecesInY;
-    qDebug() << "- Surface dimensions: 420.0 x 297.0 mm (A3)";
+    qDebug() << "- Surface dimensions:" << surfaceWidth << "x" << surfaceHeight << "mm";
     qDebug() << "- Stacking method:" << (useXAxisStacking ? "X-axis" : "Single Stack");
+    qDebug() << "- Cutting method:" << (guillotineCutting ? "Guillotine around defects" : "Grid");
 
     QStringList surfacePaths;
     QDir dir(sessionPath);
@@ -62,35 +102,53 @@ void CuttingWindow::performCuttingAnalysis()
 
     qDebug() << "Found" << surfacePaths.size() << "surfaces to analyze";
 
-    for (const QString &surfacePath : surfacePaths) {
-        qDebug() << "\n--- Processing Surface:" << QDir(surfacePath).dirName() << "---";
-        qDebug() << "Surface path:" << surfacePath;
-
-        // Create a new analyzer for this surface
-        qDebug() << "Creating new CuttingAnalyzer instance...";
-        delete analyzer; // Delete previous analyzer if it exists
-        analyzer = new CuttingAnalyzer(surfacePath, piecesInX, piecesInY, 420.0, 297.0); // Standard A3 size
+    // The surfaces are analyzed on a thread pool; the window shows up right
+    // away and fills in the pieces when the session result arrives
+    sessionAnalyzer->start(surfacePaths);
+}
 
-        // Perform the analysis for this surface
-        qDebug() << "Starting surface analysis...";
-        if (!analyzer->analyzeSurfaces()) {
-            qWarning() << "Failed to analyze surface:" << QDir(surfacePath).dirName();
-        } else {
-            qDebug() << "Successfully analyzed surface:" << QDir(surfacePath).dirName();
-        }
-        qDebug() << "--- Finished Processing Surface:" << QDir(surfacePath).dirName() << "---\n";
-    }
+void CuttingWindow::onAnalysisProgress(int analyzed, int total)
+{
+    summaryLabel->setText(QString("Analyzing surfaces: %1 of %2...").arg(analyzed).arg(total));
+}
 
+void CuttingWindow::onAnalysisFinished()
+{
     qDebug() << "Refreshing UI with analysis results...";
     // Refresh the UI to show the analysis results
     if (surfaceList->topLevelItemCount() > 0) {
-        surfaceList->setCurrentItem(surfaceList->topLevelItem(0));
+        if (!surfaceList->currentItem()) {
+            surfaceList->setCurrentItem(surfaceList->topLevelItem(0));
+        }
         onSurfaceSelectionChanged();
-        updateStackPreview();
     }
     qDebug() << "=== Cutting Analysis Process Complete ===\n";
 }
 
+const CuttingAnalyzer *CuttingWindow::surfaceAnalysis(int surfaceRow) const
+{
+    QTreeWidgetItem *item = surfaceList->topLevelItem(surfaceRow);
+    return item ? sessionAnalyzer->session().surface(item->text(0)) : nullptr;
+}
+
+const CuttingAnalyzer *CuttingWindow::currentAnalysis() const
+{
+    QTreeWidgetItem *currentItem = surfaceList->currentItem();
+    return currentItem ? sessionAnalyzer->session().surface(currentItem->text(0)) : nullptr;
+}
+
+const GuillotinePlan *CuttingWindow::surfacePlan(int surfaceRow) const
+{
+    QTreeWidgetItem *item = surfaceList->topLevelItem(surfaceRow);
+    return item ? sessionAnalyzer->session().plan(item->text(0)) : nullptr;
+}
+
+const GuillotinePlan *CuttingWindow::currentPlan() const
+{
+    QTreeWidgetItem *currentItem = surfaceList->currentItem();
+    return currentItem ? sessionAnalyzer->session().plan(currentItem->text(0)) : nullptr;
+}
+
 void CuttingWindow::setupUI()
 {
     setWindowTitle("Surface Cutting Preview");
@@ -140,11 +198,9 @@ void CuttingWindow::setupSurfaceColumn()
     defectScroll->setMinimumHeight(350);
     defectScroll->setMaximumHeight(350);
     
-    defectPreview = new QLabel;
+    defectPreview = new PyramidViewer;
     defectPreview->setMinimumSize(500, 350);
     defectPreview->setMaximumHeight(350);
-    defectPreview->setAlignment(Qt::AlignCenter);
-    defectPreview->setStyleSheet("QLabel { background-color: black; color: white; }");
     defectPreview->setText("No defects to display");
     
     defectScroll->setWidget(defectPreview);
@@ -260,79 +316,79 @@ void CuttingWindow::drawCuttingGrid(QLabel *label, const QPixmap &baseImage)
     QPixmap workingImage = baseImage.scaled(label->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
     QPainter painter(&workingImage);
     
-    // Get current surface path
-    QTreeWidgetItem *currentItem = surfaceList->currentItem();
-    if (!currentItem) return;
-    QString surfacePath = QString("%1/%2").arg(sessionPath).arg(currentItem->text(0));
-    
-    // Load cutting analysis file
-    QString analysisPath = QString("%1/cutting_analysis.json").arg(surfacePath);
-    QFile file(analysisPath);
-    QStringList piecesWithDefects;
-    
-    if (file.open(QIODevice::ReadOnly)) {
-        QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
-        QJsonObject root = doc.object();
-        QJsonArray defectPieces = root["pieces_with_defects"].toArray();
-        
-        for (const QJsonValue &value : defectPieces) {
-            piecesWithDefects.append(value.toString());
-        }
-        file.close();
-    }
+    // Pieces of the current surface; none are marked until its analysis is in
+    if (!surfaceList->currentItem()) return;
+    const CuttingAnalyzer *analysis = currentAnalysis();
 
-    // Calculate grid dimensions
-    int width = workingImage.width();
-    int height = workingImage.height();
-    int cellWidth = width / piecesInX;
-    int cellHeight = height / piecesInY;
+    // Pieces are placed in mm on the surface
+    const QTransform toImage = QTransform::fromScale(workingImage.width() / surfaceWidth,
+                                                     workingImage.height() / surfaceHeight);
 
     // Set up the pen for grid lines
     QPen pen(Qt::red);
     pen.setWidth(2);
     painter.setPen(pen);
 
+    if (guillotineCutting) {
+        // Outline the planned pieces and fill everything around them, the
+        // offcuts that take the defects
+        if (const GuillotinePlan *plan = currentPlan()) {
+            QPainterPath waste;
+            waste.setFillRule(Qt::OddEvenFill);
+            waste.addRect(toImage.mapRect(QRectF(0, 0, surfaceWidth, surfaceHeight)));
+            for (const QRectF &piece : plan->pieces) {
+                waste.addRect(toImage.mapRect(piece));
+            }
+            painter.fillPath(waste, QColor(255, 0, 0, 128));
+
+            for (const QRectF &piece : plan->pieces) {
+                painter.drawRect(toImage.mapRect(piece).adjusted(0, 0, -1, -1));
+            }
+        }
+        label->setPixmap(workingImage);
+        return;
+    }
+
     // Draw grid and fill pieces with defects
-    for (int x = 0; x < piecesInX; ++x) {
-        for (int y = 0; y < piecesInY; ++y) {
+    for (int x = 1; x <= piecesInX; ++x) {
+        for (int y = 1; y <= piecesInY; ++y) {
+            QRectF cell = toImage.mapRect(pieceRect(x, y));
+
             // Check if this piece has defects
-            QString pieceId = QString("x%1y%2").arg(x + 1).arg(y + 1);
-            if (piecesWithDefects.contains(pieceId)) {
+            if (analysis && analysis->hasDefects(x, y)) {
                 // Fill piece with semi-transparent red
                 QColor fillColor(255, 0, 0, 128); // Red with 50% opacity
-                painter.fillRect(x * cellWidth, y * cellHeight, cellWidth, cellHeight, fillColor);
+                painter.fillRect(cell, fillColor);
             }
             
-            // Draw grid lines
-            if (x > 0) {
-                painter.drawLine(x * cellWidth, 0, x * cellWidth, height);
-            }
-            if (y > 0) {
-                painter.drawLine(0, y * cellHeight, width, y * cellHeight);
-            }
+            // Outline the piece; together they give the cuts and, without a
+            // trim margin, the outer border
+            painter.drawRect(cell.adjusted(0, 0, -1, -1));
         }
     }
 
-    // Draw outer border
-    painter.drawRect(0, 0, width - 1, height - 1);
-
     // Update the label with the grid overlay
     label->setPixmap(workingImage);
 }
 
 void CuttingWindow::updateDefectPreview(const QString &surfacePath)
 {
-    // Load and display the labeled image
-    QString stitchedImagePath = QString("%1/stitched_labeled.jpg").arg(surfacePath);
-    QPixmap pixmap(stitchedImagePath);
-    
-    if (!pixmap.isNull()) {
-        // Update defect preview
-        QSize labelSize = defectPreview->size();
-        defectPreview->setPixmap(pixmap.scaled(labelSize, Qt::KeepAspectRatio, Qt::SmoothTransformation));
-
-        // Update cutting preview with grid
-        drawCuttingGrid(cuttingPreview, pixmap);
+    // Load and display the stitched surface with its defects as an overlay;
+    // only the visible pyramid tiles are decoded
+    if (defectPreview->setSurface(surfacePath)) {
+        DefectOverlay defects = DefectOverlay::load(surfacePath);
+        defectPreview->setOverlay(defects);
+
+        // Update cutting preview with grid, from an overview about the label's size
+        QImage overview = TilePyramid::readSurfaceOverview(surfacePath, "stitched", cuttingPreview->size())
+            .convertToFormat(QImage::Format_RGB32);
+        QSize fullSize = defectPreview->imageSize();
+        if (!overview.isNull() && !fullSize.isEmpty()) {
+            QPainter painter(&overview);
+            defects.paint(painter, QTransform::fromScale(double(overview.width()) / fullSize.width(),
+                                                         double(overview.height()) / fullSize.height()));
+        }
+        drawCuttingGrid(cuttingPreview, QPixmap::fromImage(overview));
     } else {
         defectPreview->setText("Failed to load surface preview");
         cuttingPreview->setText("No cutting preview available");
@@ -512,7 +568,32 @@ void CuttingWindow::updateStackPreview()
     const int maxPiecesPerStack = 50;
     const int totalSurfaces = surfaces.size();
     
-    if (useXAxisStacking) {
+    if (guillotineCutting) {
+        // Planned pieces have no grid rows to stack by; each surface's pieces
+        // follow the previous one's, top to bottom and left to right
+        StackWidget* currentStack = nullptr;
+        int currentPieceCount = 0;
+        int stackCount = 0;
+
+        for (int surfaceIndex = 0; surfaceIndex < totalSurfaces; surfaceIndex++) {
+            const GuillotinePlan *plan = surfacePlan(surfaceIndex);
+            if (!plan) {
+                continue;
+            }
+
+            for (int i = 0; i < plan->pieces.size(); i++) {
+                if (currentStack == nullptr || currentPieceCount >= maxPiecesPerStack) {
+                    stackCount++;
+                    currentStack = new StackWidget(QString("Stack %1").arg(stackCount), maxPiecesPerStack);
+                    stackGrid->addWidget(currentStack);
+                    currentPieceCount = 0;
+                }
+
+                currentStack->addPiece(surfaceIndex + 1, QString("p%1").arg(i + 1), false);
+                currentPieceCount++;
+            }
+        }
+    } else if (useXAxisStacking) {
         // Original X-axis stacking logic
         int piecesPerSurface = piecesInX;
         int totalPiecesPerY = totalSurfaces * piecesPerSurface;
@@ -535,34 +616,15 @@ void CuttingWindow::updateStackPreview()
                 
                 // Add pieces to this stack from bottom to top
                 for (int surfaceIndex = startSurface; surfaceIndex < endSurface; surfaceIndex++) {
-                    QString surfacePath = QString("%1/%2").arg(sessionPath).arg(surfaces[surfaceIndex]->text(0));
-                    QString analysisPath = QString("%1/cutting_analysis.json").arg(surfacePath);
-                    QFile file(analysisPath);
-                    
-                    if (!file.open(QIODevice::ReadOnly)) {
-                        qDebug() << "Failed to open analysis file:" << analysisPath;
+                    const CuttingAnalyzer *analysis = surfaceAnalysis(surfaceIndex);
+                    if (!analysis) {
                         continue;
                     }
 
-                    QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
-                    QJsonObject root = doc.object();
-                    QJsonArray defectPieces = root["pieces_with_defects"].toArray();
-                    file.close();
-
                     // Add pieces from this surface in order (x1 at bottom)
                     for (int x = 1; x <= piecesInX; x++) {
                         QString pieceId = QString("x%1y%2").arg(x).arg(y);
-                        
-                        // Check if piece has defects
-                        bool hasDefect = false;
-                        for (const QJsonValue &value : defectPieces) {
-                            if (value.toString() == pieceId) {
-                                hasDefect = true;
-                                break;
-                            }
-                        }
-
-                        stack->addPiece(surfaceIndex + 1, pieceId, hasDefect);
+                        stack->addPiece(surfaceIndex + 1, pieceId, analysis->hasDefects(x, y));
                     }
                 }
 
@@ -583,20 +645,11 @@ void CuttingWindow::updateStackPreview()
 
         // Process each surface
         for (int surfaceIndex = 0; surfaceIndex < totalSurfaces; surfaceIndex++) {
-            QString surfacePath = QString("%1/%2").arg(sessionPath).arg(surfaces[surfaceIndex]->text(0));
-            QString analysisPath = QString("%1/cutting_analysis.json").arg(surfacePath);
-            QFile file(analysisPath);
-            
-            if (!file.open(QIODevice::ReadOnly)) {
-                qDebug() << "Failed to open analysis file:" << analysisPath;
+            const CuttingAnalyzer *analysis = surfaceAnalysis(surfaceIndex);
+            if (!analysis) {
                 continue;
             }
 
-            QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
-            QJsonObject root = doc.object();
-            QJsonArray defectPieces = root["pieces_with_defects"].toArray();
-            file.close();
-
             // For each Y value (y1 first, then y2)
             for (int y = 1; y <= piecesInY; y++) {
                 // For each X position
@@ -611,15 +664,7 @@ void CuttingWindow::updateStackPreview()
 
                     // Add piece to current stack
                     QString pieceId = QString("x%1y%2").arg(x).arg(y);
-                    bool hasDefect = false;
-                    for (const QJsonValue &value : defectPieces) {
-                        if (value.toString() == pieceId) {
-                            hasDefect = true;
-                            break;
-                        }
-                    }
-
-                    currentStack->addPiece(surfaceIndex + 1, pieceId, hasDefect);
+                    currentStack->addPiece(surfaceIndex + 1, pieceId, analysis->hasDefects(x, y));
                     currentPieceCount++;
                 }
             }
@@ -663,6 +708,10 @@ void CuttingWindow::setupSummaryColumn()
 void CuttingWindow::updateSummaryText()
 {
     if (!summaryLabel) return;
+    if (guillotineCutting) {
+        updateGuillotineSummary();
+        return;
+    }
 
     // Calculate total pieces and stack information
     const int maxPiecesPerStack = 50;
@@ -686,16 +735,22 @@ void CuttingWindow::updateSummaryText()
     
     const int fullStacks = totalPieces / maxPiecesPerStack;
     
-    // Calculate piece size (A3 paper size: 420x297mm)
-    const double pieceWidth = 420.0 / piecesInX;
-    const double pieceHeight = 297.0 / piecesInY;
+    // A grid moved within a trim margin says where it sits
+    QString gridText;
+    if (gridOriginX > 0 || gridOriginY > 0
+        || piecesInX * pieceWidth < surfaceWidth - 0.05 || piecesInY * pieceHeight < surfaceHeight - 0.05) {
+        gridText = QString("• Grid origin: %1, %2 mm (trimmed)\n")
+            .arg(gridOriginX, 0, 'f', 1)
+            .arg(gridOriginY, 0, 'f', 1);
+    }
 
     // Build the basic summary text
     QString summaryText = QString(
         "Cutting Configuration:\n\n"
         "• Pieces per surface: %1 × %2\n"
-        "• Surface size: 420.0 × 297.0 mm (A3)\n"
+        "• Surface size: %11 × %12 mm\n"
         "• Cut piece size: %3 × %4 mm\n"
+        "%10"
         "• Stacking method: %5\n"
         "• Total surfaces: %6\n"
         "• Total pieces: %7\n"
@@ -710,7 +765,10 @@ void CuttingWindow::updateSummaryText()
         .arg(totalSurfaces)
         .arg(totalPieces)
         .arg(totalStacks)
-        .arg(fullStacks);
+        .arg(fullStacks)
+        .arg(gridText)
+        .arg(surfaceWidth, 0, 'f', 1)
+        .arg(surfaceHeight, 0, 'f', 1);
 
     // Add defective pieces information by stack
     QStringList defectiveByStack;
@@ -723,21 +781,9 @@ void CuttingWindow::updateSummaryText()
         
         // Process each surface to find defective pieces
         for (int i = 0; i < surfaceList->topLevelItemCount(); i++) {
-            QTreeWidgetItem* item = surfaceList->topLevelItem(i);
-            QString surfacePath = QString("%1/%2").arg(sessionPath).arg(item->text(0));
-            QString analysisPath = QString("%1/cutting_analysis.json").arg(surfacePath);
-            QFile file(analysisPath);
-            
-            if (file.open(QIODevice::ReadOnly)) {
-                QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
-                QJsonObject root = doc.object();
-                QJsonArray defectPieces = root["pieces_with_defects"].toArray();
-                file.close();
-
+            if (const CuttingAnalyzer *analysis = surfaceAnalysis(i)) {
                 // Process defective pieces
-                for (const QJsonValue &value : defectPieces) {
-                    QString pieceId = value.toString();
-                    
+                for (const QString &pieceId : analysis->piecesWithDefects()) {
                     // Extract x and y from pieceId (format: "x1y2")
                     int x = pieceId.mid(1, pieceId.indexOf('y') - 1).toInt();
                     int y = pieceId.mid(pieceId.indexOf('y') + 1).toInt();
@@ -766,20 +812,9 @@ void CuttingWindow::updateSummaryText()
 
         // Process each surface to find defective pieces
         for (int i = 0; i < surfaceList->topLevelItemCount(); i++) {
-            QTreeWidgetItem* item = surfaceList->topLevelItem(i);
-            QString surfacePath = QString("%1/%2").arg(sessionPath).arg(item->text(0));
-            QString analysisPath = QString("%1/cutting_analysis.json").arg(surfacePath);
-            QFile file(analysisPath);
-            
-            if (file.open(QIODevice::ReadOnly)) {
-                QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
-                QJsonObject root = doc.object();
-                QJsonArray defectPieces = root["pieces_with_defects"].toArray();
-                file.close();
-
+            if (const CuttingAnalyzer *analysis = surfaceAnalysis(i)) {
                 // Process defective pieces
-                for (const QJsonValue &value : defectPieces) {
-                    QString pieceId = value.toString();
+                for (const QString &pieceId : analysis->piecesWithDefects()) {
                     int stackPosition = pieceInStack + 1;
                     
                     // Add to defect list with stack position
@@ -816,21 +851,82 @@ void CuttingWindow::updateSummaryText()
     summaryLabel->setText(summaryText);
 }
 
+void CuttingWindow::updateGuillotineSummary()
+{
+    const int maxPiecesPerStack = 50;
+    const int totalSurfaces = surfaceList->topLevelItemCount();
+
+    // Planned pieces against the defect-free pieces the grid would give
+    int plannedPieces = 0;
+    int gridFreePieces = 0;
+    QStringList piecesBySurface;
+    for (int i = 0; i < totalSurfaces; i++) {
+        const CuttingAnalyzer *analysis = surfaceAnalysis(i);
+        const GuillotinePlan *plan = surfacePlan(i);
+        if (!analysis || !plan) {
+            continue;
+        }
+
+        const int gridFree = piecesInX * piecesInY - int(analysis->piecesWithDefects().size());
+        plannedPieces += plan->pieces.size();
+        gridFreePieces += gridFree;
+        piecesBySurface.append(QString("s%1: %2 pieces (grid: %3)%4")
+            .arg(i + 1)
+            .arg(plan->pieces.size())
+            .arg(gridFree)
+            .arg(plan->optimal ? "" : ", search limit reached"));
+    }
+
+    const int totalStacks = (plannedPieces + maxPiecesPerStack - 1) / maxPiecesPerStack;
+    const int fullStacks = plannedPieces / maxPiecesPerStack;
+
+    QString summaryText = QString(
+        "Cutting Configuration:\n\n"
+        "• Cutting method: Guillotine (cut around defects)\n"
+        "• Surface size: %8 × %9 mm\n"
+        "• Cut piece size: %1 × %2 mm\n"
+        "• Stacking method: Sequential\n"
+        "• Total surfaces: %3\n"
+        "• Defect-free pieces: %4 (grid: %5)\n"
+        "• Number of stacks: %6\n"
+        "• Full stacks (50 pieces): %7\n\n"
+        "Pieces by Surface:\n")
+        .arg(pieceWidth, 0, 'f', 1)
+        .arg(pieceHeight, 0, 'f', 1)
+        .arg(totalSurfaces)
+        .arg(plannedPieces)
+        .arg(gridFreePieces)
+        .arg(totalStacks)
+        .arg(fullStacks)
+        .arg(surfaceWidth, 0, 'f', 1)
+        .arg(surfaceHeight, 0, 'f', 1);
+
+    if (piecesBySurface.isEmpty()) {
+        summaryText += "No surfaces planned yet.";
+    } else {
+        summaryText += piecesBySurface.join("\n");
+    }
+
+    summaryLabel->setText(summaryText);
+}
+
 void CuttingWindow::onCuttingPreviewClicked(QPoint pos)
 {
+    // Planned pieces are defect-free; there is nothing to list for them
+    if (guillotineCutting) return;
+
     // Get the current pixmap
     QPixmap pixmap = cuttingPreview->pixmap(Qt::ReturnByValue);
     if (pixmap.isNull()) return;
 
-    // Calculate the grid cell size
-    int width = pixmap.width();
-    int height = pixmap.height();
-    int cellWidth = width / piecesInX;
-    int cellHeight = height / piecesInY;
+    // Back to mm on the surface, as the grid was drawn
+    double surfaceX = pos.x() * surfaceWidth / pixmap.width();
+    double surfaceY = pos.y() * surfaceHeight / pixmap.height();
 
-    // Calculate which piece was clicked (1-based indexing)
-    int pieceX = (pos.x() / cellWidth) + 1;
-    int pieceY = (pos.y() / cellHeight) + 1;
+    // Calculate which piece was clicked (1-based indexing); clicks in the
+    // trim fall outside the grid
+    int pieceX = int(std::floor((surfaceX - gridOriginX) / pieceWidth)) + 1;
+    int pieceY = int(std::floor((surfaceY - gridOriginY) / pieceHeight)) + 1;
 
     // Ensure we're within bounds
     if (pieceX > 0 && pieceX <= piecesInX && pieceY > 0 && pieceY <= piecesInY) {
@@ -840,73 +936,52 @@ void CuttingWindow::onCuttingPreviewClicked(QPoint pos)
 
 void CuttingWindow::showPieceDefects(int pieceX, int pieceY)
 {
-    // Get current surface path
-    QTreeWidgetItem *currentItem = surfaceList->currentItem();
-    if (!currentItem) return;
-    QString surfacePath = QString("%1/%2").arg(sessionPath).arg(currentItem->text(0));
-    
-    // Load cutting analysis file
-    QString analysisPath = QString("%1/cutting_analysis.json").arg(surfacePath);
-    QFile file(analysisPath);
-    
-    if (!file.open(QIODevice::ReadOnly)) return;
-
-    QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
-    QJsonObject root = doc.object();
-    QJsonArray pieces = root["pieces"].toArray();
-    
-    // Find the selected piece
-    for (const QJsonValue &pieceValue : pieces) {
-        QJsonObject piece = pieceValue.toObject();
-        if (piece["x"].toInt() == pieceX && piece["y"].toInt() == pieceY) {
-            QJsonArray defects = piece["defects"].toArray();
-            
-            // Update defect table with only this piece's defects
-            defectTable->setRowCount(defects.size());
-            for (int i = 0; i < defects.size(); ++i) {
-                QJsonObject defect = defects[i].toObject();
-                
-                // Number
-                QTableWidgetItem *numberItem = new QTableWidgetItem(QString::number(i + 1));
-                numberItem->setTextAlignment(Qt::AlignCenter);
-                defectTable->setItem(i, 0, numberItem);
-
-                // Type
-                QTableWidgetItem *typeItem = new QTableWidgetItem(defect["type"].toString());
-                typeItem->setTextAlignment(Qt::AlignCenter);
-                defectTable->setItem(i, 1, typeItem);
-
-                // Confidence
-                double confidence = defect["confidence"].toDouble();
-                if (confidence > 1) {
-                    confidence = confidence / 100.0;
-                }
-                QTableWidgetItem *confItem = new QTableWidgetItem(
-                    QString("%1%").arg(confidence * 100, 0, 'f', 1));
-                confItem->setTextAlignment(Qt::AlignCenter);
-                defectTable->setItem(i, 2, confItem);
-
-                // Physical position
-                QJsonObject physicalPos = defect["physical_position"].toObject();
-                
-                // Location (x, y) in mm
-                QString location = QString("(%1, %2) mm")
-                    .arg(physicalPos["x"].toDouble(), 0, 'f', 1)
-                    .arg(physicalPos["y"].toDouble(), 0, 'f', 1);
-                QTableWidgetItem *locItem = new QTableWidgetItem(location);
-                locItem->setTextAlignment(Qt::AlignCenter);
-                defectTable->setItem(i, 3, locItem);
-
-                // Size (width × height) in mm
-                QString size = QString("%1 × %2 mm")
-                    .arg(physicalPos["width"].toDouble(), 0, 'f', 1)
-                    .arg(physicalPos["height"].toDouble(), 0, 'f', 1);
-                QTableWidgetItem *sizeItem = new QTableWidgetItem(size);
-                sizeItem->setTextAlignment(Qt::AlignCenter);
-                defectTable->setItem(i, 4, sizeItem);
-            }
-            break;
+    const CuttingAnalyzer *analysis = currentAnalysis();
+    if (!analysis) return;
+
+    // Update defect table with only this piece's defects
+    const QVector<int> defects = analysis->defectsInPiece(pieceX, pieceY);
+    defectTable->setRowCount(defects.size());
+    for (int i = 0; i < defects.size(); ++i) {
+        QJsonObject defect = analysis->defectStore().sourceObject(defects[i]);
+        
+        // Number
+        QTableWidgetItem *numberItem = new QTableWidgetItem(QString::number(i + 1));
+        numberItem->setTextAlignment(Qt::AlignCenter);
+        defectTable->setItem(i, 0, numberItem);
+
+        // Type
+        QTableWidgetItem *typeItem = new QTableWidgetItem(defect["type"].toString());
+        typeItem->setTextAlignment(Qt::AlignCenter);
+        defectTable->setItem(i, 1, typeItem);
+
+        // Confidence
+        double confidence = defect["confidence"].toDouble();
+        if (confidence > 1) {
+            confidence = confidence / 100.0;
         }
+        QTableWidgetItem *confItem = new QTableWidgetItem(
+            QString("%1%").arg(confidence * 100, 0, 'f', 1));
+        confItem->setTextAlignment(Qt::AlignCenter);
+        defectTable->setItem(i, 2, confItem);
+
+        // Physical position
+        QJsonObject physicalPos = defect["physical_position"].toObject();
+        
+        // Location (x, y) in mm
+        QString location = QString("(%1, %2) mm")
+            .arg(physicalPos["x"].toDouble(), 0, 'f', 1)
+            .arg(physicalPos["y"].toDouble(), 0, 'f', 1);
+        QTableWidgetItem *locItem = new QTableWidgetItem(location);
+        locItem->setTextAlignment(Qt::AlignCenter);
+        defectTable->setItem(i, 3, locItem);
+
+        // Size (width × height) in mm
+        QString size = QString("%1 × %2 mm")
+            .arg(physicalPos["width"].toDouble(), 0, 'f', 1)
+            .arg(physicalPos["height"].toDouble(), 0, 'f', 1);
+        QTableWidgetItem *sizeItem = new QTableWidgetItem(size);
+        sizeItem->setTextAlignment(Qt::AlignCenter);
+        defectTable->setItem(i, 4, sizeItem);
     }
-    file.close();
-} 
\ No newline at end of file
+}
@@ -12,6 +12,9 @@
 #include <QScrollArea>
 #include <QMouseEvent>
 #include "cuttinganalyzer.h"
+#include "sessionanalyzer.h"
+#include "cutgridoptimizer.h"
+#include "pyramidviewer.h"
 #include <QFrame>
 #include <QSpacerItem>
 #include <QSizePolicy>
@@ -147,9 +150,17 @@ public:
                  const QString &sessionPath,
                  int piecesInX,
                  int piecesInY,
-                 bool useXAxisStacking);
+                 bool useXAxisStacking,
+                 double surfaceWidth = 420.0,
+                 double surfaceHeight = 297.0);
     ~CuttingWindow();
     
+    // A grid chosen with CutGridOptimizer; call before performCuttingAnalysis()
+    void setCutGrid(const CutGridLayout &layout);
+    // Cut pieces of the grid's size around the defects instead of along the
+    // grid; call before performCuttingAnalysis()
+    void setGuillotineCutting(bool enabled);
+
     // Make this public so it can be called after configuration is confirmed
     void performCuttingAnalysis();
 
@@ -161,6 +172,8 @@ private slots:
     void updateNavigationButtons();
     void onCuttingPreviewClicked(QPoint pos);
     void showPieceDefects(int pieceX, int pieceY);
+    void onAnalysisProgress(int analyzed, int total);
+    void onAnalysisFinished();
 
 private:
     void setupUI();
@@ -170,19 +183,32 @@ private:
     void setupSummaryColumn();
     void loadSurfaces();
     void drawCuttingGrid(QLabel *label, const QPixmap &baseImage);
+    QRectF pieceRect(int x, int y) const;  // 1-based piece, in mm on the surface
     void updateStackPreview();
     void updateSummaryText();
+    void updateGuillotineSummary();
+    const CuttingAnalyzer *surfaceAnalysis(int surfaceRow) const;
+    const CuttingAnalyzer *currentAnalysis() const;
+    const GuillotinePlan *surfacePlan(int surfaceRow) const;
+    const GuillotinePlan *currentPlan() const;
 
     QString sessionPath;
     int piecesInX;
     int piecesInY;
     bool useXAxisStacking;
-    CuttingAnalyzer *analyzer;
+    double surfaceWidth;  // mm, as in the session's dimensions
+    double surfaceHeight;
+    double gridOriginX;  // mm; the grid covers the whole surface unless trimmed
+    double gridOriginY;
+    double pieceWidth;
+    double pieceHeight;
+    bool guillotineCutting;  // Pieces come from each surface's GuillotinePlan
+    SessionAnalyzer *sessionAnalyzer;
 
     // UI Components
     QTreeWidget *surfaceList;
     QLabel *surfacePreview;
-    QLabel *defectPreview;
+    PyramidViewer *defectPreview;
     ClickableLabel *cuttingPreview;  // Changed to ClickableLabel
     QTableWidget *defectTable;
     QLabel *stackPreview;
@@ -1,34 +1,291 @@
 #include "defectdetector.h"
+#include "capturestore.h"
+#include "defectoverlay.h"
+#include "tilereader.h"
+#include <QtCore/QDateTime>
 #include <QtCore/QDir>
 #include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QProcessEnvironment>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
+#include <QtConcurrent>
+#include <QtGui/QPainter>
+#include <algorithm>
+
+#ifdef Q_OS_LINUX
+#include <sched.h>
+#endif
+
+namespace {
+
+// Supervision of the Python workers
+const int FirstRestartDelayMs = 1000;
+const int MaxRestartDelayMs = 30000;
+const int StableUptimeMs = 60000;     // Running this long resets the backoff
+const int MaxFailedRestarts = 6;      // Quick failures in a row before a worker is given up
+const int MaxReplayAttempts = 3;      // Crashes an image may be in flight for
+
+QString stationConfigPath()
+{
+    return QString("%1/detector.json")
+        .arg(QStandardPaths::writableLocation(QStandardPaths::AppConfigLocation));
+}
+
+// One request's trip through the cache, made on cachePool
+struct CacheKeying {
+    quint64 requestId = 0;
+    QString imagePath;
+    QImage frame;
+    QString key;
+    bool hit = false;
+    QJsonArray detections;
+};
+
+struct NativeResult {
+    bool succeeded = false;
+    bool cancelled = false;
+    QJsonArray detections;
+    QRect region;
+    QString error;
+    qint64 inferenceMs = 0;
+};
+
+// Writes the _detections.json the Python worker does; region is the crop
+// detection ran on, if any
+bool saveDetectionFile(const QString &imagePath, const QRect &region, const QJsonArray &detections)
+{
+    QJsonObject data;
+    data["timestamp"] = QDateTime::currentDateTime().toString(Qt::ISODateWithMs);
+    data["image_file"] = QFileInfo(imagePath).fileName();
+    if (!region.isNull()) {
+        QJsonObject crop;
+        crop["x"] = region.x();
+        crop["y"] = region.y();
+        crop["width"] = region.width();
+        crop["height"] = region.height();
+        data["crop"] = crop;
+    }
+    data["detections"] = detections;
+
+    QSaveFile jsonFile(CaptureStore::sidecarPath(imagePath, "_detections.json"));
+    if (!jsonFile.open(QIODevice::WriteOnly)) return false;
+    jsonFile.write(QJsonDocument(data).toJson());
+    return jsonFile.commit();
+}
+
+// Writes _detections.json and _detected.jpg, as the Python worker does with --annotate.
+// image is what detection ran on: the crop, if region is set.
+bool saveDetectionResults(const QString &imagePath, const QImage &image, const QRect &region,
+                          const QJsonArray &detections)
+{
+    if (!saveDetectionFile(imagePath, region, detections)) return false;
+
+    QImage annotated = image.convertToFormat(QImage::Format_RGB32);
+    QPainter painter(&annotated);
+    QFont font = painter.font();
+    font.setPixelSize(qMax(12, annotated.height() / 60));
+    painter.setFont(font);
+    for (const QJsonValue &value : detections) {
+        const QJsonObject detection = value.toObject();
+        const QJsonArray xyxy = detection["xyxy"].toArray();
+        const QRect box(QPoint(xyxy[0].toInt(), xyxy[1].toInt()), QPoint(xyxy[2].toInt(), xyxy[3].toInt()));
+        const QString type = detection["class_name"].toString();
+        const QColor color = DefectOverlay::colorFor(type);
+
+        painter.setPen(QPen(color, 3));
+        painter.setBrush(Qt::NoBrush);
+        painter.drawRect(box);
+
+        const QString label = QString("%1 %2").arg(type).arg(detection["confidence"].toDouble() / 100, 0, 'f', 2);
+        QRect labelRect = painter.fontMetrics().boundingRect(label).adjusted(-3, -2, 3, 2);
+        labelRect.moveBottomLeft(box.topLeft());
+        painter.fillRect(labelRect, color);
+        painter.setPen(Qt::white);
+        painter.drawText(labelRect, Qt::AlignCenter, label);
+    }
+    painter.end();
+    return annotated.save(CaptureStore::sidecarPath(imagePath, "_detected.jpg"), "JPG", 90);
+}
+
+}
 
 DefectDetector::DefectDetector(QObject *parent)
     : QObject(parent)
-    , detectionProcess(nullptr)
+    , backend(Native)
+    , runningBackend(Python)
+    , startGeneration(0)
+    , workerCount(qBound(1, QThread::idealThreadCount() / 4, 4))
+    , cpuPinning(false)
+    , intraOpThreads(0)
+    , startingWorkers(0)
     , modelInitialized(false)
+    , maxBatchSize(8)
+    , maxBatchWaitMs(20)
+    , cropOnly(true)
+    , cropSize(TileReader::defaultCropSize())
+    , annotate(false)
+    , nextRequestId(1)
+    , restarts(0)
 {
     pythonScriptPath = QDir::currentPath() + "/scripts/defect_detector.py";
+    // Hashing is bound by memory and disk rather than the cores
+    cachePool.setMaxThreadCount(2);
+    loadStationConfig();
 }
 
 DefectDetector::~DefectDetector()
 {
-    if (detectionProcess) {
-        detectionProcess->close();
-        delete detectionProcess;
+    stopWorkers();
+}
+
+void DefectDetector::loadStationConfig()
+{
+    // Optional per-station overrides, e.g. {"backend": "python", "workers": 4, "pin_cpus": true}
+    QFile file(stationConfigPath());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    QJsonObject config = QJsonDocument::fromJson(file.readAll()).object();
+    file.close();
+
+    if (config.contains("backend")) {
+        setBackend(config["backend"].toString() == backendName(Python) ? Python : Native);
+    }
+    if (config.contains("workers")) setWorkerCount(config["workers"].toInt());
+    if (config.contains("pin_cpus")) setCpuPinning(config["pin_cpus"].toBool());
+    if (config.contains("intra_op_threads")) setIntraOpThreads(config["intra_op_threads"].toInt());
+    if (config.contains("input_size")) nativeDetector.setInputSize(config["input_size"].toInt());
+    if (config.contains("crop_only")) setCropOnly(config["crop_only"].toBool());
+    if (config.contains("cache")) setCacheEnabled(config["cache"].toBool());
+    if (config.contains("annotate")) setAnnotate(config["annotate"].toBool());
+    setBatchLimits(config["max_batch"].toInt(maxBatchSize), config["max_wait_ms"].toInt(maxBatchWaitMs));
+}
+
+void DefectDetector::setBatchLimits(int maxBatchSize, int maxBatchWaitMs)
+{
+    this->maxBatchSize = qMax(1, maxBatchSize);
+    this->maxBatchWaitMs = qMax(0, maxBatchWaitMs);
+}
+
+QString DefectDetector::backendName(Backend backend)
+{
+    return backend == Native ? QString("native") : QString("python");
+}
+
+void DefectDetector::setCropOnly(bool enabled)
+{
+    cropOnly = enabled;
+    // Results of the other crop mode are filed under another context
+    if (modelInitialized) updateCacheContext();
+}
+
+void DefectDetector::setCropSize(const QSize &size)
+{
+    cropSize = size;
+    if (modelInitialized) updateCacheContext();
+}
+
+void DefectDetector::setWorkerCount(int count)
+{
+    workerCount = qMax(1, count);
+}
+
+void DefectDetector::stopWorkers()
+{
+    // Native jobs reference the loaded nets; let them drain first
+    ++startGeneration;
+    nativeLoad.waitForFinished();
+    nativePool.waitForDone();
+    nativeDetector.unload();
+    runningBackend = Python;
+
+    for (Worker &worker : workers) {
+        if (!worker.process) continue;
+        // Closing waits for the process; its exit is not a failure here
+        disconnect(worker.process, nullptr, this, nullptr);
+        worker.process->close();
+        delete worker.process;
+        worker.process = nullptr;
     }
+    workers.clear();
+    startingWorkers = 0;
+    modelInitialized = false;
+
+    // Nothing sent to the old workers will be answered
+    for (const Request &request : std::as_const(requests)) {
+        frameRing.release(request.slot);
+    }
+    requests.clear();
+    surfaceOrder.clear();
+    awaitingReplay.clear();
+    nativeCancelled.clear();
 }
 
 void DefectDetector::initializeDetectionProcess()
 {
-    if (detectionProcess) {
-        detectionProcess->close();
-        delete detectionProcess;
+    stopWorkers();
+    lastStartupError.clear();
+    startupTimer.start();
+
+    if (backend == Native && startNative()) return;
+    startPython();
+}
+
+bool DefectDetector::startNative()
+{
+    const QString modelPath = NativeDetector::defaultModelPath();
+    if (!NativeDetector::isAvailable()) {
+        emit statusMessage("Native inference was not built in (no OpenCV DNN); using Python workers");
+        return false;
+    }
+    if (!QFile::exists(modelPath)) {
+        emit statusMessage(QString("No ONNX model at %1 (export it with scripts/export_onnx.py); using Python workers")
+                           .arg(modelPath));
+        return false;
     }
 
-    detectionProcess = new QProcess(this);
-    detectionProcess->setProgram("/usr/local/bin/python3");
-    detectionProcess->setProcessChannelMode(QProcess::MergedChannels);
+    runningBackend = Native;
+    nativePool.setMaxThreadCount(workerCount);
+    emit statusMessage(QString("Loading %1 with OpenCV DNN on %2 thread(s)").arg(modelPath).arg(workerCount));
+
+    // Loading takes a moment; keep it off the UI thread like the Python start
+    const quint64 generation = startGeneration;
+    const int instances = workerCount;
+    auto *watcher = new QFutureWatcher<QString>(this);
+    connect(watcher, &QFutureWatcher<QString>::finished, this, [this, watcher, generation]() {
+        const QString error = watcher->result();
+        watcher->deleteLater();
+        if (generation != startGeneration) return;
 
+        if (!error.isEmpty()) {
+            emit statusMessage(QString("[ERROR] %1; falling back to Python workers").arg(error));
+            runningBackend = Python;
+            startPython();
+            return;
+        }
+        modelInitialized = true;
+        updateCacheContext();
+        emit statusMessage(QString("[SUCCESS] Model loaded successfully and ready for inference! "
+                                   "(native, %1 ms)").arg(startupTimer.elapsed()));
+        emit modelInitializationComplete();
+    });
+    nativeLoad = QtConcurrent::run([this, modelPath, instances]() {
+        QString error;
+        nativeDetector.load(modelPath, instances, &error);
+        return error;
+    });
+    watcher->setFuture(nativeLoad);
+    return true;
+}
+
+void DefectDetector::startPython()
+{
     // Check if the Python script exists
     if (!QFile::exists(pythonScriptPath)) {
         QString error = "Python script not found at: " + pythonScriptPath;
@@ -37,58 +294,226 @@ void DefectDetector::initializeDetectionProcess()
         return;
     }
 
-    emit statusMessage("Starting Python process with script: " + pythonScriptPath);
+    // A couple of frames in flight per worker; more fall back to paths
+    const int slotCount = qMax(8, workerCount * 2);
+    if (frameRing.slotCount() != slotCount) {
+        frameRing.create(slotCount, SharedFrameRing::defaultSlotSize());
+    }
+
+    emit statusMessage(QString("Starting %1 Python worker(s) with script: %2").arg(workerCount).arg(pythonScriptPath));
+
+    workers.resize(workerCount);
+    startingWorkers = workerCount;
+    for (int i = 0; i < workerCount; ++i) {
+        startWorker(i);
+    }
+}
+
+void DefectDetector::startWorker(int index, bool restart)
+{
+    Worker &worker = workers[index];
+    const int crashes = worker.crashes;
+    worker = Worker();
+    worker.crashes = crashes;
+    worker.restarted = restart;
+    worker.process = new QProcess(this);
+    worker.process->setProgram("/usr/local/bin/python3");
+    // stdout carries only protocol frames; library chatter goes to stderr
+    worker.process->setProcessChannelMode(QProcess::SeparateChannels);
+
+    // Split the cores between workers; left alone, every worker's torch and
+    // OpenMP pools would size themselves to the whole machine and contend
+    const int cores = qMax(1, QThread::idealThreadCount());
+    const int coresPerWorker = qMax(1, cores / workers.size());
 
-    // Set up process arguments
     QStringList arguments;
-    arguments << pythonScriptPath;
-    detectionProcess->setArguments(arguments);
+    arguments << pythonScriptPath
+              << "--max-batch" << QString::number(maxBatchSize)
+              << "--max-wait-ms" << QString::number(maxBatchWaitMs)
+              << "--input-size" << QString::number(nativeDetector.getInputSize())
+              << "--intra-op-threads" << QString::number(intraOpThreads > 0 ? intraOpThreads : coresPerWorker);
+    if (annotate) arguments << "--annotate";
+    worker.process->setArguments(arguments);
+    QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    environment.insert("OMP_NUM_THREADS", QString::number(coresPerWorker));
+    environment.insert("MKL_NUM_THREADS", QString::number(coresPerWorker));
+    worker.process->setProcessEnvironment(environment);
+
+#ifdef Q_OS_LINUX
+    if (cpuPinning) {
+        const int firstCore = (index * coresPerWorker) % cores;
+        worker.process->setChildProcessModifier([firstCore, coresPerWorker, cores]() {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int core = firstCore; core < firstCore + coresPerWorker; ++core) {
+                CPU_SET(core % cores, &set);
+            }
+            sched_setaffinity(0, sizeof(set), &set);
+        });
+        emit statusMessage(QString("%1 pinned to cores %2-%3")
+                           .arg(workerLabel(index)).arg(firstCore).arg(firstCore + coresPerWorker - 1));
+    }
+#endif
 
     // Connect signals
-    connect(detectionProcess, &QProcess::readyRead, this, &DefectDetector::handleProcessOutput);
-    connect(detectionProcess, &QProcess::errorOccurred, this, &DefectDetector::handleProcessError);
-    connect(detectionProcess, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
-            this, &DefectDetector::handleProcessFinished);
-
-    // Start the process
-    detectionProcess->start();
-    
-    if (!detectionProcess->waitForStarted()) {
-        QString error = "Failed to start detection process";
-        emit statusMessage(error);
-        emit modelInitializationFailed(error);
-        return;
+    QProcess *process = worker.process;
+    connect(process, &QProcess::readyReadStandardOutput, this, [this, index]() { handleProcessOutput(index); });
+    connect(process, &QProcess::readyReadStandardError, this, [this, index]() { handleProcessLog(index); });
+    connect(process, &QProcess::errorOccurred, this, [this, index](QProcess::ProcessError error) {
+        handleProcessError(index, error);
+    });
+    connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+            this, [this, index](int exitCode, QProcess::ExitStatus exitStatus) {
+                handleProcessFinished(index, exitCode, exitStatus);
+            });
+
+    worker.starting = true;
+
+    // Start the process; a failure to start arrives through errorOccurred
+    process->start();
+}
+
+QString DefectDetector::workerLabel(int index) const
+{
+    return QString("Worker %1").arg(index + 1);
+}
+
+int DefectDetector::readyWorkerCount() const
+{
+    int count = 0;
+    for (const Worker &worker : workers) {
+        if (worker.ready) ++count;
     }
+    return count;
 }
 
-void DefectDetector::handleProcessOutput()
+void DefectDetector::handleProcessOutput(int index)
 {
-    if (!detectionProcess) return;
+    Worker &worker = workers[index];
+    if (!worker.process) return;
 
-    QString output = QString::fromUtf8(detectionProcess->readAll()).trimmed();
-    emit statusMessage(output);  // Emit all output as status messages
-    qDebug() << "Python output:" << output;
+    // A chunk may end mid-line or hold several lines; only complete lines are frames.
+    // Handlers can restart the pool, so the worker is looked up again each line
+    worker.outputBuffer.append(worker.process->readAllStandardOutput());
+    qsizetype newline;
+    while (index < workers.size() && (newline = workers[index].outputBuffer.indexOf('\n')) >= 0) {
+        QByteArray &buffer = workers[index].outputBuffer;
+        QByteArray line = buffer.left(newline).trimmed();
+        buffer.remove(0, newline + 1);
+        if (line.isEmpty()) continue;
 
-    if (output.contains("[SUCCESS] Model loaded successfully")) {
-        modelInitialized = true;
-        emit modelInitializationComplete();
+        QJsonParseError parseError;
+        QJsonDocument doc = QJsonDocument::fromJson(line, &parseError);
+        if (parseError.error != QJsonParseError::NoError || !doc.isObject()) {
+            qDebug() << "Malformed detector frame:" << line;
+            emit statusMessage(QString::fromUtf8(line));
+            continue;
+        }
+        handleMessage(index, doc.object());
     }
-    else if (output.contains("[ERROR]")) {
-        emit modelInitializationFailed(output);
+}
+
+void DefectDetector::handleProcessLog(int index)
+{
+    Worker &worker = workers[index];
+    if (!worker.process) return;
+
+    worker.logBuffer.append(worker.process->readAllStandardError());
+    qsizetype newline;
+    while (index < workers.size() && (newline = workers[index].logBuffer.indexOf('\n')) >= 0) {
+        QByteArray &buffer = workers[index].logBuffer;
+        QString line = QString::fromUtf8(buffer.left(newline)).trimmed();
+        buffer.remove(0, newline + 1);
+        if (!line.isEmpty()) {
+            if (workers.size() > 1) line = QString("%1: %2").arg(workerLabel(index), line);
+            qDebug() << "Python output:" << line;
+            emit statusMessage(line);
+        }
+    }
+}
+
+void DefectDetector::handleMessage(int index, const QJsonObject &message)
+{
+    const QString type = message["type"].toString();
+    const quint64 requestId = quint64(message["id"].toInteger());
+    const QString imagePath = message["path"].toString();
+    const QString prefix = workers.size() > 1 ? workerLabel(index) + ": " : QString();
+
+    if (type == "log") {
+        QString text = QString("[%1] %2%3").arg(message["level"].toString().toUpper(), prefix, message["message"].toString());
+        qDebug() << "Python output:" << text;
+        emit statusMessage(text);
     }
-    else if (output.contains("[SUCCESS] Detection results saved")) {
-        // Parse and emit detection results
-        QStringList results;
-        for (const QString &line : output.split('\n')) {
-            if (line.contains("[INFO]")) {
-                results.append(line.mid(line.indexOf("[INFO]") + 7));
+    else if (type == "ready") {
+        Worker &worker = workers[index];
+        if (worker.starting) {
+            worker.starting = false;
+            worker.ready = true;
+            worker.upSince.start();
+            if (worker.restarted) {
+                emit statusMessage(QString("[SUCCESS] %1 restarted (%2 restart(s) so far); %3 image(s) to replay")
+                                   .arg(workerLabel(index)).arg(restarts).arg(awaitingReplay.size()));
+                emit workerRestarted(index, restarts);
+                replayRequests();
+            } else {
+                --startingWorkers;
+                finishStartup();
             }
         }
-        emit detectionComplete(results);
+    }
+    else if (type == "fatal") {
+        // The worker exits next; its exit settles startup
+        lastStartupError = message["message"].toString();
+        emit statusMessage("[ERROR] " + prefix + lastStartupError);
+    }
+    else if (type == "queued") {
+        emit statusMessage(QString("[STATUS] %1Queued image for detection: %2").arg(prefix, imagePath));
+    }
+    else if (type == "started") {
+        emit statusMessage(QString("[STATUS] %1Processing image: %2").arg(prefix, imagePath));
+        // A request cancelled in flight gets no further signals
+        auto it = requests.constFind(requestId);
+        if (it != requests.constEnd() && !it->cancelled) {
+            emit detectionStarted(requestId, imagePath);
+        }
+    }
+    else if (type == "cancelled") {
+        completeRequest(requestId, false, QJsonArray(), "Cancelled");
+    }
+    else if (type == "result") {
+        QJsonArray detections = message["detections"].toArray();
+        emit statusMessage(QString("[SUCCESS] %1Detection results saved for %2 (%3 defects)")
+                           .arg(prefix, imagePath).arg(detections.size()));
+        completeRequest(requestId, true, detections, QString());
+    }
+    else if (type == "error") {
+        emit statusMessage(QString("[ERROR] %1%2").arg(prefix, message["message"].toString()));
+        completeRequest(requestId, false, QJsonArray(), message["message"].toString());
+    }
+    else {
+        qDebug() << "Unknown detector message type:" << type;
     }
 }
 
-void DefectDetector::handleProcessError(QProcess::ProcessError error)
+void DefectDetector::finishStartup()
+{
+    if (startingWorkers > 0) return;
+
+    const int ready = readyWorkerCount();
+    if (ready > 0) {
+        modelInitialized = true;
+        updateCacheContext();
+        emit statusMessage(QString("[SUCCESS] Model loaded successfully and ready for inference! "
+                                   "(python, %1 of %2 workers, %3 ms)")
+                           .arg(ready).arg(workers.size()).arg(startupTimer.elapsed()));
+        emit modelInitializationComplete();
+    } else {
+        QString error = lastStartupError.isEmpty() ? QString("No detector worker started") : lastStartupError;
+        emit modelInitializationFailed(error);
+    }
+}
+
+void DefectDetector::handleProcessError(int index, QProcess::ProcessError error)
 {
     QString errorMessage;
     switch (error) {
@@ -110,38 +535,677 @@ void DefectDetector::handleProcessError(QProcess::ProcessError error)
         default:
             errorMessage = "Unknown error occurred";
     }
+    if (workers.size() > 1) errorMessage = QString("%1: %2").arg(workerLabel(index), errorMessage);
     emit statusMessage(errorMessage);
-    emit modelInitializationFailed(errorMessage);
+
+    // A process that never started will not report finished
+    if (error == QProcess::FailedToStart) {
+        workerExited(index, errorMessage);
+    }
 }
 
-void DefectDetector::handleProcessFinished(int exitCode, QProcess::ExitStatus exitStatus)
+void DefectDetector::handleProcessFinished(int index, int exitCode, QProcess::ExitStatus exitStatus)
 {
+    QString reason = "Detection process exited";
     if (exitStatus == QProcess::CrashExit || exitCode != 0) {
-        modelInitialized = false;
-        QString error = "Process terminated unexpectedly";
-        emit statusMessage(error);
-        emit modelInitializationFailed(error);
+        reason = "Process terminated unexpectedly";
+        emit statusMessage(workers.size() > 1 ? QString("%1: %2").arg(workerLabel(index), reason) : reason);
     }
+    workerExited(index, reason);
 }
 
-void DefectDetector::writeToProcess(const QString &command)
+void DefectDetector::workerExited(int index, const QString &reason)
 {
-    if (!detectionProcess || !modelInitialized) {
-        emit statusMessage("Cannot send command - process not ready");
+    Worker &worker = workers[index];
+    if (!worker.process) return;
+
+    worker.process->deleteLater();
+    worker.process = nullptr;
+    worker.outputBuffer.clear();
+    worker.logBuffer.clear();
+    const bool wasStarting = worker.starting;
+    const bool wasRestart = worker.restarted;
+    worker.starting = false;
+    worker.ready = false;
+
+    // Nothing in flight on this worker can complete here any more; it goes
+    // to another worker, or waits for this one to come back
+    QList<quint64> lost = worker.inFlight.values();
+    worker.inFlight.clear();
+    std::sort(lost.begin(), lost.end());
+    for (quint64 requestId : lost) {
+        requeueRequest(requestId, reason);
+    }
+
+    if (wasStarting && !wasRestart) {
+        // Failing to start at all (no model, no Python) is not retried
+        if (lastStartupError.isEmpty()) lastStartupError = reason;
+        --startingWorkers;
+        finishStartup();
         return;
     }
 
-    detectionProcess->write((command + "\n").toUtf8());
-    detectionProcess->waitForBytesWritten();
+    scheduleRestart(index, wasStarting);
+    replayRequests();
 }
 
-void DefectDetector::detectImage(const QString &imagePath)
+void DefectDetector::scheduleRestart(int index, bool failedStart)
 {
-    if (!modelInitialized) {
-        emit statusMessage("Model not initialized - cannot detect defects");
+    Worker &worker = workers[index];
+
+    // A worker that ran for a while gets restarted quickly; one that keeps
+    // dying backs off, and is given up after enough failures in a row
+    if (failedStart || !worker.upSince.isValid() || worker.upSince.elapsed() < StableUptimeMs) {
+        ++worker.crashes;
+    } else {
+        worker.crashes = 1;
+    }
+
+    if (worker.crashes > MaxFailedRestarts) {
+        emit statusMessage(QString("[ERROR] %1 failed %2 times in a row; not restarting it")
+                           .arg(workerLabel(index)).arg(worker.crashes));
+        if (liveWorkerCount() == 0) {
+            // Nothing left to replay to
+            modelInitialized = false;
+            const QList<quint64> stranded = awaitingReplay;
+            awaitingReplay.clear();
+            for (quint64 requestId : stranded) {
+                completeRequest(requestId, false, QJsonArray(), "All detector workers exited");
+            }
+            emit modelInitializationFailed("All detector workers exited");
+        }
+        return;
+    }
+
+    const int delayMs = qMin(MaxRestartDelayMs, FirstRestartDelayMs << (worker.crashes - 1));
+    worker.restartPending = true;
+    emit statusMessage(QString("[WARNING] %1 exited; restarting in %2 ms (%3 image(s) waiting)")
+                       .arg(workerLabel(index)).arg(delayMs).arg(awaitingReplay.size()));
+
+    const quint64 generation = startGeneration;
+    QTimer::singleShot(delayMs, this, [this, index, generation]() {
+        // Stopped or restarted from scratch in the meantime
+        if (generation != startGeneration || index >= workers.size()) return;
+        ++restarts;
+        startWorker(index, true);
+    });
+}
+
+int DefectDetector::liveWorkerCount() const
+{
+    int count = 0;
+    for (const Worker &worker : workers) {
+        if (worker.process || worker.restartPending) ++count;
+    }
+    return count;
+}
+
+void DefectDetector::requeueRequest(quint64 requestId, const QString &reason)
+{
+    auto it = requests.find(requestId);
+    if (it == requests.end() || it->done) return;
+
+    it->worker = -1;
+    if (it->cancelled) {
+        dropRequest(requestId);
+        return;
+    }
+    if (++it->attempts >= MaxReplayAttempts) {
+        // Likely the image itself takes the worker down
+        completeRequest(requestId, false, QJsonArray(),
+                        QString("%1 (%2 attempts)").arg(reason).arg(it->attempts));
+        return;
+    }
+    awaitingReplay.append(requestId);
+}
+
+void DefectDetector::replayRequests()
+{
+    if (awaitingReplay.isEmpty() || leastLoadedWorker() < 0) return;
+
+    // Spread over the ready workers like a fresh batch; the frames are
+    // still in their ring slots, which are only released on an answer
+    QHash<int, QJsonArray> itemsByWorker;
+    QHash<int, QList<quint64>> idsByWorker;
+    // Focus surface first; the worker queues by priority too, but only what it has
+    QList<quint64> waiting = awaitingReplay;
+    awaitingReplay.clear();
+    std::stable_sort(waiting.begin(), waiting.end(), [this](quint64 a, quint64 b) {
+        return requests.value(a).priority > requests.value(b).priority;
+    });
+    for (quint64 requestId : waiting) {
+        auto it = requests.find(requestId);
+        if (it == requests.end() || it->done) continue;
+
+        const int index = leastLoadedWorker();
+        it->worker = index;
+        workers[index].inFlight.insert(requestId);
+        itemsByWorker[index].append(it->item);
+        idsByWorker[index].append(requestId);
+    }
+
+    for (auto it = itemsByWorker.constBegin(); it != itemsByWorker.constEnd(); ++it) {
+        QJsonObject request;
+        request["cmd"] = "detect_batch";
+        request["items"] = it.value();
+        if (!sendRequest(it.key(), request)) {
+            for (quint64 requestId : idsByWorker.value(it.key())) {
+                completeRequest(requestId, false, QJsonArray(), "Failed to send request to detector");
+            }
+        }
+    }
+}
+
+QRect DefectDetector::detectionRegion(const QString &imagePath, const QImage &frame) const
+{
+    if (!cropOnly) return QRect();
+
+    // The header is enough when there is no frame in memory
+    const QSize size = frame.isNull() ? CaptureStore::readSize(imagePath) : frame.size();
+    if (!size.isValid()) return QRect();
+
+    // Captures smaller than the crop are scaled by the stitcher; detect them whole
+    const QRect crop = TileReader::centerCropRect(size, cropSize);
+    return QRect(QPoint(0, 0), size).contains(crop) ? crop : QRect();
+}
+
+void DefectDetector::updateCacheContext()
+{
+    // Everything that can change the detections of identical image bytes
+    const QString modelPath = runningBackend == Native
+        ? NativeDetector::defaultModelPath()
+        : QDir::currentPath() + "/model/best.pt";
+    const QString settings = QString("%1|conf=%2|iou=%3|input=%4|crop=%5|%6x%7")
+        .arg(backendName(runningBackend))
+        .arg(nativeDetector.getConfidenceThreshold())
+        .arg(nativeDetector.getIouThreshold())
+        .arg(nativeDetector.getInputSize())
+        .arg(cropOnly ? "centre" : "full")
+        .arg(cropSize.width()).arg(cropSize.height());
+    cache.setContext(modelPath, settings);
+}
+
+void DefectDetector::answerFromCache(quint64 requestId, const QJsonArray &detections)
+{
+    auto it = requests.find(requestId);
+    if (it == requests.end()) return;
+
+    it->done = true;
+    it->succeeded = true;
+    it->detections = detections;
+    it->region = detectionRegion(it->imagePath, QImage());
+
+    // The stitcher reads the results file; an archived session may lack it and
+    // an earlier run with other crop settings may have left one that no longer matches
+    if (!saveDetectionFile(it->imagePath, it->region, detections)) {
+        qDebug() << "Failed to save cached detection results for" << it->imagePath;
+    }
+
+    emit statusMessage(QString("[SUCCESS] Cached detection results for %1 (%2 defects)")
+                       .arg(it->imagePath).arg(detections.size()));
+}
+
+int DefectDetector::priorityFor(const QString &surface) const
+{
+    return !focusSurface.isEmpty() && surface == focusSurface ? 1 : 0;
+}
+
+void DefectDetector::setFocusSurface(const QString &surfacePath)
+{
+    const QString surface = surfacePath.isEmpty() ? QString() : QDir(surfacePath).absolutePath();
+    if (surface == focusSurface) return;
+
+    const QString previous = focusSurface;
+    focusSurface = surface;
+    reprioritizeSurface(previous);
+    reprioritizeSurface(surface);
+}
+
+void DefectDetector::reprioritizeSurface(const QString &surface)
+{
+    if (surface.isEmpty()) return;
+
+    const int priority = priorityFor(surface);
+    QHash<int, QJsonArray> idsByWorker;
+    for (quint64 requestId : surfaceOrder.value(surface)) {
+        auto it = requests.find(requestId);
+        if (it == requests.end() || it->done || it->priority == priority) continue;
+        it->priority = priority;
+        it->item["priority"] = priority;
+        if (runningBackend == Python && it->worker >= 0) {
+            idsByWorker[it->worker].append(qint64(requestId));
+        }
+    }
+
+    // Only requests still waiting in a worker move; the rest are under way
+    for (auto it = idsByWorker.constBegin(); it != idsByWorker.constEnd(); ++it) {
+        QJsonObject request;
+        request["cmd"] = "prioritize";
+        request["ids"] = it.value();
+        request["priority"] = priority;
+        sendRequest(it.key(), request);
+    }
+}
+
+int DefectDetector::cancelSurface(const QString &surfacePath)
+{
+    return cancelRequests(surfaceOrder.value(QDir(surfacePath).absolutePath()));
+}
+
+bool DefectDetector::cancelRequest(quint64 requestId)
+{
+    return cancelRequests({ requestId }) > 0;
+}
+
+int DefectDetector::cancelRequests(const QList<quint64> &requestIds)
+{
+    int cancelled = 0;
+    QSet<QString> surfaces;
+    QHash<int, QJsonArray> idsByWorker;
+    for (quint64 requestId : requestIds) {
+        auto it = requests.find(requestId);
+        if (it == requests.end() || it->cancelled) continue;
+        ++cancelled;
+        surfaces.insert(it->surface);
+
+        if (it->done || it->keying || awaitingReplay.contains(requestId)) {
+            // Answered and held back for ordering, or not sent anywhere yet
+            dropRequest(requestId);
+            continue;
+        }
+
+        // Under way; forgotten here, and released when the worker answers
+        it->cancelled = true;
+        QList<quint64> &order = surfaceOrder[it->surface];
+        order.removeOne(requestId);
+        if (order.isEmpty()) surfaceOrder.remove(it->surface);
+
+        if (runningBackend == Native) {
+            QMutexLocker locker(&nativeCancelMutex);
+            nativeCancelled.insert(requestId);
+        } else {
+            idsByWorker[it->worker].append(qint64(requestId));
+        }
+    }
+
+    for (auto it = idsByWorker.constBegin(); it != idsByWorker.constEnd(); ++it) {
+        QJsonObject request;
+        request["cmd"] = "cancel";
+        request["ids"] = it.value();
+        sendRequest(it.key(), request);
+    }
+
+    // Later images of a surface may have been waiting on a cancelled one
+    for (const QString &surface : std::as_const(surfaces)) {
+        emitCompleted(surface);
+    }
+    if (cancelled > 0) {
+        emit statusMessage(QString("Cancelled %1 detection request(s)").arg(cancelled));
+    }
+    return cancelled;
+}
+
+int DefectDetector::leastLoadedWorker() const
+{
+    int best = -1;
+    for (int i = 0; i < workers.size(); ++i) {
+        if (!workers[i].ready) continue;
+        if (best < 0 || workers[i].inFlight.size() < workers[best].inFlight.size()) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+quint64 DefectDetector::newRequest(const QString &imagePath)
+{
+    const quint64 requestId = nextRequestId++;
+    Request entry;
+    entry.imagePath = imagePath;
+    entry.surface = QFileInfo(imagePath).absolutePath();
+    entry.priority = priorityFor(entry.surface);
+    surfaceOrder[entry.surface].append(requestId);
+    requests.insert(requestId, entry);
+    return requestId;
+}
+
+void DefectDetector::keyRequests(const QList<quint64> &requestIds, const QList<QImage> &frames)
+{
+    if (!cache.isEnabled() || !cache.hasContext()) {
+        dispatchRequests(requestIds, frames);
+        return;
+    }
+
+    // A key hashes every byte of the image, so keys and lookups are made on
+    // cachePool; the requests wait here, unsent, in the meantime
+    QList<CacheKeying> jobs;
+    for (int i = 0; i < requestIds.size(); ++i) {
+        auto it = requests.find(requestIds[i]);
+        if (it == requests.end()) continue;
+        it->keying = true;
+
+        CacheKeying job;
+        job.requestId = requestIds[i];
+        job.imagePath = it->imagePath;
+        job.frame = frames.value(i);
+        jobs.append(job);
+    }
+
+    const DetectionCache snapshot = cache;
+    auto *watcher = new QFutureWatcher<CacheKeying>(this);
+    connect(watcher, &QFutureWatcher<CacheKeying>::finished, this, [this, watcher, contextId = snapshot.contextId()]() {
+        const QList<CacheKeying> keyed = watcher->future().results();
+        watcher->deleteLater();
+
+        QList<quint64> misses;
+        QList<QImage> missFrames;
+        QSet<QString> answered;
+        for (const CacheKeying &job : keyed) {
+            // Cancelled, or dropped by a restart, while it was being hashed
+            auto it = requests.find(job.requestId);
+            if (it == requests.end() || !it->keying) continue;
+            it->keying = false;
+
+            if (job.hit) {
+                answered.insert(it->surface);
+                answerFromCache(job.requestId, job.detections);
+                continue;
+            }
+            // A key made under settings changed since would file new results as old ones
+            if (contextId == cache.contextId()) it->cacheKey = job.key;
+            misses.append(job.requestId);
+            missFrames.append(job.frame);
+        }
+
+        dispatchRequests(misses, missFrames);
+        for (const QString &surface : std::as_const(answered)) {
+            emitCompleted(surface);
+        }
+    });
+    watcher->setFuture(QtConcurrent::mapped(&cachePool, jobs, [snapshot](const CacheKeying &pending) {
+        CacheKeying job = pending;
+        job.key = job.frame.isNull() ? snapshot.keyFor(job.imagePath) : snapshot.keyFor(job.frame);
+        job.hit = snapshot.lookup(job.key, job.detections);
+        return job;
+    }));
+}
+
+void DefectDetector::dispatchRequests(const QList<quint64> &requestIds, const QList<QImage> &frames)
+{
+    // The native thread pool already runs as many tiles at once as it has nets
+    if (runningBackend == Native) {
+        for (int i = 0; i < requestIds.size(); ++i) {
+            runNative(requestIds[i], frames.value(i));
+        }
+        return;
+    }
+
+    // Spread over the pool; each pick counts the ones already assigned, so a
+    // surface splits evenly across idle workers
+    QHash<int, QJsonArray> itemsByWorker;
+    QHash<int, QList<quint64>> idsByWorker;
+    for (int i = 0; i < requestIds.size(); ++i) {
+        if (liveWorkerCount() == 0) {
+            // Every worker was given up while the request was being keyed
+            completeRequest(requestIds[i], false, QJsonArray(), "All detector workers exited");
+            continue;
+        }
+
+        const int index = leastLoadedWorker();
+        QJsonObject item;
+        assignWorker(requestIds[i], index, frames.value(i), item);
+        if (index >= 0) {
+            itemsByWorker[index].append(item);
+            idsByWorker[index].append(requestIds[i]);
+        }
+    }
+
+    for (auto it = itemsByWorker.constBegin(); it != itemsByWorker.constEnd(); ++it) {
+        QJsonObject request;
+        request["cmd"] = "detect_batch";
+        request["items"] = it.value();
+        if (!sendRequest(it.key(), request)) {
+            for (quint64 requestId : idsByWorker.value(it.key())) {
+                completeRequest(requestId, false, QJsonArray(), "Failed to send request to detector");
+            }
+        }
+    }
+}
+
+void DefectDetector::assignWorker(quint64 requestId, int index, const QImage &frame, QJsonObject &item)
+{
+    auto entry = requests.find(requestId);
+    if (entry == requests.end()) return;
+
+    item["id"] = qint64(requestId);
+    item["path"] = entry->imagePath;
+    item["priority"] = entry->priority;
+    entry->worker = index;
+
+    // Only the stitched crop is detected; a shared frame holds just that part
+    const QRect region = detectionRegion(entry->imagePath, frame);
+    entry->region = region;
+    if (!region.isNull()) {
+        item["crop"] = QJsonArray{ region.x(), region.y(), region.width(), region.height() };
+    }
+
+    // Hand the decoded frame over in memory when a slot is free
+    QJsonObject frameDescriptor;
+    entry->slot = frameRing.store(frame, region, frameDescriptor);
+    if (entry->slot >= 0) {
+        item["shm"] = frameDescriptor;
+    }
+
+    // Kept as sent, in case the worker dies before answering
+    entry->item = item;
+
+    if (index >= 0) {
+        workers[index].inFlight.insert(requestId);
+    } else {
+        // No worker is up; sent when one has restarted
+        awaitingReplay.append(requestId);
+    }
+}
+
+void DefectDetector::dropRequest(quint64 requestId)
+{
+    auto it = requests.find(requestId);
+    if (it == requests.end()) return;
+
+    frameRing.release(it->slot);
+    if (it->worker >= 0 && it->worker < workers.size()) {
+        workers[it->worker].inFlight.remove(requestId);
+    }
+    awaitingReplay.removeOne(requestId);
+    QList<quint64> &order = surfaceOrder[it->surface];
+    order.removeOne(requestId);
+    if (order.isEmpty()) surfaceOrder.remove(it->surface);
+    requests.erase(it);
+}
+
+void DefectDetector::completeRequest(quint64 requestId, bool succeeded, const QJsonArray &detections, const QString &error)
+{
+    auto it = requests.find(requestId);
+    if (it == requests.end() || it->done) return;
+
+    // The worker has answered, so it is done reading the frame
+    frameRing.release(it->slot);
+    it->slot = -1;
+    if (it->worker >= 0 && it->worker < workers.size()) {
+        workers[it->worker].inFlight.remove(requestId);
+    }
+
+    if (succeeded) {
+        cache.store(it->cacheKey, detections);
+    }
+
+    if (it->cancelled) {
+        // Nobody is waiting for it any more
+        requests.erase(it);
         return;
     }
 
-    QString command = QString("detect %1").arg(imagePath);
-    writeToProcess(command);
-} 
\ No newline at end of file
+    it->done = true;
+    it->succeeded = succeeded;
+    it->detections = detections;
+    it->error = error;
+    const QString surface = it->surface;
+    emitCompleted(surface);
+}
+
+void DefectDetector::emitCompleted(const QString &surface)
+{
+    // Emit answered requests from the front of the surface's queue; a request
+    // still running holds back everything submitted after it
+    while (true) {
+        auto order = surfaceOrder.find(surface);
+        if (order == surfaceOrder.end()) return;
+        if (order->isEmpty()) {
+            surfaceOrder.erase(order);
+            return;
+        }
+
+        const quint64 requestId = order->first();
+        auto it = requests.find(requestId);
+        if (it != requests.end() && !it->done) return;
+
+        order->removeFirst();
+        if (it == requests.end()) continue;
+
+        const Request request = *it;
+        requests.erase(it);
+        if (request.succeeded) {
+            emit detectionFinished(requestId, request.imagePath, request.detections, request.region.topLeft());
+        } else {
+            emit detectionError(requestId, request.imagePath, request.error);
+        }
+    }
+}
+
+bool DefectDetector::sendRequest(int index, const QJsonObject &request)
+{
+    QProcess *process = workers[index].process;
+    if (!process || !workers[index].ready) {
+        emit statusMessage("Cannot send command - process not ready");
+        return false;
+    }
+
+    // QProcess buffers the write and flushes it from the event loop
+    QByteArray frame = QJsonDocument(request).toJson(QJsonDocument::Compact);
+    frame.append('\n');
+    return process->write(frame) == frame.size();
+}
+
+void DefectDetector::runNative(quint64 requestId, const QImage &frame)
+{
+    auto entry = requests.constFind(requestId);
+    if (entry == requests.constEnd()) return;
+    const QString imagePath = entry->imagePath;
+    const int priority = entry->priority;
+
+    auto *watcher = new QFutureWatcher<NativeResult>(this);
+    connect(watcher, &QFutureWatcher<NativeResult>::finished, this, [this, watcher, requestId, imagePath]() {
+        const NativeResult result = watcher->result();
+        watcher->deleteLater();
+        {
+            QMutexLocker locker(&nativeCancelMutex);
+            nativeCancelled.remove(requestId);
+        }
+        if (result.cancelled) {
+            // Nothing to report
+        } else if (result.succeeded) {
+            emit statusMessage(QString("[SUCCESS] Detection results saved for %1 (%2 defects, %3 ms)")
+                               .arg(imagePath).arg(result.detections.size()).arg(result.inferenceMs));
+        } else {
+            emit statusMessage(QString("[ERROR] %1").arg(result.error));
+        }
+        auto it = requests.find(requestId);
+        if (it != requests.end()) it->region = result.region;
+        completeRequest(requestId, result.succeeded, result.detections, result.error);
+    });
+
+    // The pool takes higher priority jobs first; they keep the priority they
+    // were submitted with
+    const bool writeAnnotated = annotate;
+    auto job = [this, requestId, imagePath, frame, writeAnnotated]() {
+        NativeResult result;
+        {
+            // Stale work is dropped before it reaches the model
+            QMutexLocker locker(&nativeCancelMutex);
+            if (nativeCancelled.contains(requestId)) {
+                result.cancelled = true;
+                return result;
+            }
+        }
+
+        QMetaObject::invokeMethod(this, [this, requestId, imagePath]() {
+            auto it = requests.constFind(requestId);
+            if (it != requests.constEnd() && !it->cancelled) emit detectionStarted(requestId, imagePath);
+        }, Qt::QueuedConnection);
+
+        // With a crop, only that region of a file is decoded
+        const QRect region = detectionRegion(imagePath, frame);
+        result.region = region;
+        QImage image;
+        if (frame.isNull()) {
+            image = region.isNull() ? CaptureStore::read(imagePath) : TileReader::readRegion(imagePath, region);
+        } else {
+            image = region.isNull() ? frame : frame.copy(region);
+        }
+        if (image.isNull()) {
+            result.error = QString("Could not read %1").arg(imagePath);
+            return result;
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        result.succeeded = nativeDetector.detect(image, result.detections, &result.error);
+        result.inferenceMs = timer.elapsed();
+        if (result.succeeded) {
+            // The annotated copy is only rendered on request; the viewer
+            // draws the boxes itself
+            const bool saved = writeAnnotated
+                ? saveDetectionResults(imagePath, image, region, result.detections)
+                : saveDetectionFile(imagePath, region, result.detections);
+            if (!saved) {
+                // Detections are still good; the files are only for later sessions
+                qDebug() << "Failed to save detection results for" << imagePath;
+            }
+        }
+        return result;
+    };
+    watcher->setFuture(QtConcurrent::task(std::move(job))
+                           .onThreadPool(nativePool)
+                           .withPriority(priority)
+                           .spawn());
+}
+
+quint64 DefectDetector::detectImage(const QString &imagePath, const QImage &frame)
+{
+    // While every worker is restarting, the request waits for one
+    if (!modelInitialized || (runningBackend == Python && liveWorkerCount() == 0)) {
+        emit statusMessage("Model not initialized - cannot detect defects");
+        return 0;
+    }
+
+    const quint64 requestId = newRequest(imagePath);
+    keyRequests({ requestId }, { frame });
+    return requestId;
+}
+
+QList<quint64> DefectDetector::detectBatch(const QStringList &imagePaths, const QList<QImage> &frames)
+{
+    QList<quint64> requestIds;
+    if (!modelInitialized || (runningBackend == Python && liveWorkerCount() == 0)) {
+        emit statusMessage("Model not initialized - cannot detect defects");
+        return requestIds;
+    }
+
+    // Submitted together, so the images the cache cannot answer land in as
+    // few worker batches as possible
+    for (const QString &imagePath : imagePaths) {
+        requestIds.append(newRequest(imagePath));
+    }
+    keyRequests(requestIds, frames);
+    return requestIds;
+}
@@ -4,38 +4,232 @@
 #include <QtCore/QObject>
 #include <QtCore/QProcess>
 #include <QtCore/QString>
+#include <QtCore/QHash>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonObject>
+#include <QtCore/QList>
+#include <QtCore/QSet>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFuture>
+#include <QtCore/QMutex>
+#include <QtCore/QThreadPool>
 #include <QtCore/QDebug>
+#include <QtCore/QPoint>
+#include <QtCore/QRect>
+#include <QtCore/QSize>
+#include <QtGui/QImage>
+#include "detectioncache.h"
+#include "nativedetector.h"
+#include "sharedframering.h"
 
+// Runs defect detection either in process (NativeDetector on a thread pool)
+// or, as the fallback when the app was built without OpenCV DNN or there is
+// no model/best.onnx, in a pool of scripts/defect_detector.py workers. Both
+// report through the same signals: each request gets detectionFinished or
+// detectionError once, per surface (the image's directory) in the order the
+// images were submitted, unless it is cancelled first.
 class DefectDetector : public QObject
 {
     Q_OBJECT
 
 public:
+    enum Backend {
+        Native,  // OpenCV DNN in this process
+        Python   // scripts/defect_detector.py worker processes
+    };
+
     explicit DefectDetector(QObject *parent = nullptr);
     ~DefectDetector();
 
     void initializeDetectionProcess();
+    // True once the native model is loaded, or once every Python worker has
+    // either loaded the model or failed to and at least one is ready
     bool isModelInitialized() const { return modelInitialized; }
-    void detectImage(const QString &imagePath);
+
+    // Returns the request id, or 0 if no worker is ready. imagePath still
+    // names the capture (results are written next to it); frame, if given,
+    // is what the worker runs on.
+    quint64 detectImage(const QString &imagePath, const QImage &frame = QImage());
+    // One request id per image, in order, or an empty list if no worker is
+    // ready. Results still arrive per image through detectionFinished and
+    // detectionError, including for images that could not be sent.
+    QList<quint64> detectBatch(const QStringList &imagePaths, const QList<QImage> &frames = QList<QImage>());
+    // Requests for surfacePath (a capture directory) go ahead of the others,
+    // including those waiting in a Python worker (native jobs keep the
+    // priority they were submitted with). Empty for none.
+    void setFocusSurface(const QString &surfacePath);
+    QString getFocusSurface() const { return focusSurface; }
+    // Drops the requests not yet reported; they get neither detectionFinished
+    // nor detectionError. Returns how many were dropped.
+    int cancelSurface(const QString &surfacePath);
+    bool cancelRequest(quint64 requestId);
+
+    // Requests not yet reported, including those waiting for a worker
+    int pendingCount() const { return requests.size(); }
+    // Requests whose worker exited, or that arrived while none was up
+    int awaitingReplayCount() const { return awaitingReplay.size(); }
+    // Python worker restarts since the detector was created. A worker that
+    // exits is restarted after a delay that doubles with each quick failure
+    // in a row; an image in flight through several crashes is failed.
+    int restartCount() const { return restarts; }
+
+    static QString backendName(Backend backend);
+    // The preferred backend; Native falls back to Python if it cannot load
+    void setBackend(Backend backend) { this->backend = backend; }
+    Backend getBackend() const { return backend; }
+    Backend activeBackend() const { return runningBackend; }
+
+    // Each Python worker runs whatever is waiting, up to maxBatchSize images
+    // held for at most maxBatchWaitMs, as one forward pass. Take effect the
+    // next time the processes are started.
+    void setBatchLimits(int maxBatchSize, int maxBatchWaitMs);
+    int getMaxBatchSize() const { return maxBatchSize; }
+    int getMaxBatchWaitMs() const { return maxBatchWaitMs; }
+    // Python processes, or native inference threads
+    void setWorkerCount(int count);
+    int getWorkerCount() const { return workerCount; }
+    // Detect only the stitched centre crop (coordinates in crop space) rather
+    // than the whole capture; the results files record the crop
+    void setCropOnly(bool enabled);
+    bool getCropOnly() const { return cropOnly; }
+    void setCropSize(const QSize &size);
+    QSize getCropSize() const { return cropSize; }
+    // Also write <image>_detected.jpg with the boxes burnt in. Off by default:
+    // the viewer draws detections over the capture itself.
+    void setAnnotate(bool enabled) { annotate = enabled; }
+    bool getAnnotate() const { return annotate; }
+    // Images seen before are answered from a DetectionCache without running the model
+    void setCacheEnabled(bool enabled) { cache.setEnabled(enabled); }
+    bool isCacheEnabled() const { return cache.isEnabled(); }
+    // Torch threads for each Python worker's forward pass; 0 splits the cores
+    // evenly between workers
+    void setIntraOpThreads(int count) { intraOpThreads = qMax(0, count); }
+    int getIntraOpThreads() const { return intraOpThreads; }
+    // Gives each Python worker its own block of cores (Linux only)
+    void setCpuPinning(bool enabled) { cpuPinning = enabled; }
+    bool getCpuPinning() const { return cpuPinning; }
+
+    int readyWorkerCount() const;
 
 signals:
     void modelInitializationComplete();
     void modelInitializationFailed(QString error);
-    void detectionComplete(const QStringList &results);
-    void detectionError(QString error);
+    void detectionStarted(quint64 requestId, const QString &imagePath);
+    // The detections' xyxy are relative to cropOrigin, the top left of the
+    // crop detection ran on in capture pixels; zero for the full frame
+    void detectionFinished(quint64 requestId, const QString &imagePath, const QJsonArray &detections,
+                           const QPoint &cropOrigin);
+    void detectionError(quint64 requestId, const QString &imagePath, const QString &error);
     void statusMessage(QString message);
-
-private slots:
-    void handleProcessOutput();
-    void handleProcessError(QProcess::ProcessError error);
-    void handleProcessFinished(int exitCode, QProcess::ExitStatus exitStatus);
+    void workerRestarted(int worker, int restartCount);
 
 private:
-    QProcess *detectionProcess;
-    bool modelInitialized;
+    // Spoken to over newline-delimited JSON; the worker echoes each request's
+    // id, so answers match however stdout is chunked
+    struct Worker {
+        QProcess *process = nullptr;
+        QByteArray outputBuffer;  // Bytes after the last complete line
+        QByteArray logBuffer;
+        bool starting = false;    // Launched, model not loaded yet
+        bool ready = false;
+        bool restarted = false;   // Started by the supervisor rather than at startup
+        bool restartPending = false;
+        int crashes = 0;          // Quick failures in a row; sets the restart delay
+        QElapsedTimer upSince;    // Since the model was loaded
+        QSet<quint64> inFlight;
+    };
+
+    struct Request {
+        QString imagePath;
+        QString surface;
+        int worker = -1;
+        int slot = -1;            // Frame ring slot, or -1 if sent by path
+        bool done = false;        // Answered, waiting for earlier images of the surface
+        bool succeeded = false;
+        QJsonArray detections;
+        QRect region;             // Crop detection ran on; null for the full frame
+        QString error;
+        QString cacheKey;         // Stored under this key when it succeeds
+        QJsonObject item;         // As sent, for replaying to another worker
+        int attempts = 0;         // Workers that exited with it in flight
+        int priority = 0;
+        bool cancelled = false;   // Waiting only for the worker to let go of it
+        bool keying = false;      // Its cache key is being computed; not sent yet
+    };
+
     QString pythonScriptPath;
-    
-    void writeToProcess(const QString &command);
+    Backend backend;
+    Backend runningBackend;
+    QElapsedTimer startupTimer;
+    quint64 startGeneration;  // Ignores native loads from an earlier start
+    QVector<Worker> workers;
+    int workerCount;
+    bool cpuPinning;
+    int intraOpThreads;
+    int startingWorkers;
+    QString lastStartupError;
+    bool modelInitialized;
+    int maxBatchSize;
+    int maxBatchWaitMs;
+    bool cropOnly;
+    QSize cropSize;
+    bool annotate;
+
+    quint64 nextRequestId;
+    QHash<quint64, Request> requests;
+    QHash<QString, QList<quint64>> surfaceOrder;  // Surface -> request ids in submission order
+    QList<quint64> awaitingReplay;                // Waiting for a ready worker
+    int restarts;
+    QString focusSurface;
+
+    SharedFrameRing frameRing;  // Decoded frames handed to the Python workers without a disk read
+
+    NativeDetector nativeDetector;
+    QThreadPool nativePool;
+    QFuture<QString> nativeLoad;
+    QMutex nativeCancelMutex;
+    QSet<quint64> nativeCancelled;  // Checked by native jobs before they run
+
+    DetectionCache cache;
+    QThreadPool cachePool;  // Hashes images and reads cache entries off the UI thread
+
+    void loadStationConfig();
+    void stopWorkers();
+    bool startNative();
+    void startPython();
+    void startWorker(int index, bool restart = false);
+    QString workerLabel(int index) const;
+
+    void handleProcessOutput(int index);
+    void handleProcessLog(int index);
+    void handleProcessError(int index, QProcess::ProcessError error);
+    void handleProcessFinished(int index, int exitCode, QProcess::ExitStatus exitStatus);
+    void handleMessage(int index, const QJsonObject &message);
+    void workerExited(int index, const QString &reason);
+    void scheduleRestart(int index, bool failedStart);
+    int liveWorkerCount() const;
+    void requeueRequest(quint64 requestId, const QString &reason);
+    void replayRequests();
+    void finishStartup();
+
+    QRect detectionRegion(const QString &imagePath, const QImage &frame) const;
+    void updateCacheContext();
+    void answerFromCache(quint64 requestId, const QJsonArray &detections);
+    int priorityFor(const QString &surface) const;
+    void reprioritizeSurface(const QString &surface);
+    int cancelRequests(const QList<quint64> &requestIds);
+    int leastLoadedWorker() const;
+    quint64 newRequest(const QString &imagePath);
+    void keyRequests(const QList<quint64> &requestIds, const QList<QImage> &frames);
+    void dispatchRequests(const QList<quint64> &requestIds, const QList<QImage> &frames);
+    void assignWorker(quint64 requestId, int index, const QImage &frame, QJsonObject &item);
+    void dropRequest(quint64 requestId);
+    void completeRequest(quint64 requestId, bool succeeded, const QJsonArray &detections, const QString &error);
+    void emitCompleted(const QString &surface);
+    bool sendRequest(int index, const QJsonObject &request);
+    void runNative(quint64 requestId, const QImage &frame);
 };
 
-#endif // DEFECTDETECTOR_H 
\ No newline at end of file
+#endif // DEFECTDETECTOR_H
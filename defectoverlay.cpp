@@ -0,0 +1,121 @@
+#include "defectoverlay.h"
+#include <QFile>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPainter>
+#include <QDebug>
+
+DefectOverlay DefectOverlay::load(const QString &surfacePath)
+{
+    DefectOverlay overlay;
+
+    QFile file(QString("%1/defect_coordinates.json").arg(surfacePath));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return overlay;
+    }
+
+    QJsonArray defects = QJsonDocument::fromJson(file.readAll()).object()["defects"].toArray();
+    file.close();
+
+    for (const QJsonValue &value : defects) {
+        QJsonObject defect = value.toObject();
+        QJsonObject canvasPos = defect["canvas_position"].toObject();
+
+        // canvas_position holds the centre of the defect
+        double width = canvasPos["width"].toDouble();
+        double height = canvasPos["height"].toDouble();
+        Defect item;
+        item.canvasRect = QRectF(canvasPos["x"].toDouble() - width / 2,
+                                 canvasPos["y"].toDouble() - height / 2,
+                                 width, height);
+        item.type = defect["type"].toString();
+        // Stored in percent, like the detector reports it
+        item.confidence = defect["confidence"].toDouble() / 100.0;
+        overlay.append(item);
+    }
+
+    return overlay;
+}
+
+DefectOverlay DefectOverlay::fromDetections(const QJsonArray &detections, const QPoint &origin)
+{
+    DefectOverlay overlay;
+    for (const QJsonValue &value : detections) {
+        QJsonObject detection = value.toObject();
+        QJsonArray xyxy = detection["xyxy"].toArray();
+        if (xyxy.size() != 4) continue;
+
+        Defect item;
+        item.canvasRect = QRectF(QPointF(xyxy[0].toDouble(), xyxy[1].toDouble()),
+                                 QPointF(xyxy[2].toDouble(), xyxy[3].toDouble())).translated(origin);
+        item.type = detection["class_name"].toString();
+        // The detector reports percent
+        item.confidence = detection["confidence"].toDouble() / 100.0;
+        overlay.append(item);
+    }
+    return overlay;
+}
+
+QColor DefectOverlay::colorFor(const QString &defectType)
+{
+    if (defectType == "damage") return QColor(255, 0, 0, 128);
+    if (defectType == "mark") return QColor(0, 255, 0, 128);
+    if (defectType == "oil") return QColor(0, 0, 255, 128);
+    if (defectType == "edge") return QColor(255, 165, 0, 128);
+    return QColor(128, 128, 128, 128);
+}
+
+void DefectOverlay::paint(QPainter &painter, const QTransform &imageToTarget) const
+{
+    painter.save();
+    painter.resetTransform();
+    painter.setFont(QFont("Arial", 10));
+    QFontMetrics metrics(painter.font());
+
+    for (const Defect &defect : defects) {
+        // Keep tiny defects visible when zoomed out
+        QRectF rect = imageToTarget.mapRect(defect.canvasRect);
+        if (rect.width() < 4) rect.adjust(-(4 - rect.width()) / 2, 0, (4 - rect.width()) / 2, 0);
+        if (rect.height() < 4) rect.adjust(0, -(4 - rect.height()) / 2, 0, (4 - rect.height()) / 2);
+
+        QColor color = colorFor(defect.type);
+        painter.setPen(QPen(color, 2));
+        painter.setBrush(color);
+        painter.drawRect(rect);
+
+        // Label inside the box when it fits, above it otherwise
+        QString label = QString("%1\n%2%").arg(defect.type).arg(qRound(defect.confidence * 100));
+        QRectF textRect = metrics.boundingRect(QRect(0, 0, 1000, 1000), Qt::AlignCenter, label);
+        painter.setPen(Qt::white);
+        if (textRect.width() <= rect.width() && textRect.height() <= rect.height()) {
+            painter.drawText(rect, Qt::AlignCenter, label);
+        } else {
+            textRect.moveCenter(QPointF(rect.center().x(), rect.top() - textRect.height() / 2 - 2));
+            painter.fillRect(textRect, QColor(0, 0, 0, 128));
+            painter.drawText(textRect, Qt::AlignCenter, label);
+        }
+    }
+
+    painter.restore();
+}
+
+bool DefectOverlay::exportLabeledImage(const QString &surfacePath, const QString &outputPath)
+{
+    QImage labeledImage(QString("%1/stitched.jpg").arg(surfacePath));
+    if (labeledImage.isNull()) {
+        qDebug() << "Failed to load stitched image for labeling";
+        return false;
+    }
+
+    QPainter painter(&labeledImage);
+    load(surfacePath).paint(painter, QTransform());
+    painter.end();
+
+    if (!labeledImage.save(outputPath)) {
+        qDebug() << "Failed to save labeled stitched image";
+        return false;
+    }
+    return true;
+}
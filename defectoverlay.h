@@ -0,0 +1,49 @@
+#ifndef DEFECTOVERLAY_H
+#define DEFECTOVERLAY_H
+
+#include <QColor>
+#include <QJsonArray>
+#include <QPoint>
+#include <QRectF>
+#include <QString>
+#include <QTransform>
+#include <QVector>
+
+class QPainter;
+
+// Defects of a stitched surface as a vector layer. It is read from
+// defect_coordinates.json and drawn over whatever resolution is on screen,
+// so no labeled copy of the stitched image has to be decoded or stored.
+// A full resolution labeled JPEG is only rendered by exportLabeledImage().
+class DefectOverlay
+{
+public:
+    struct Defect {
+        QRectF canvasRect;  // Stitched image pixels
+        QString type;
+        float confidence = 0.0f;  // 0..1; the JSON files hold percent
+    };
+
+    static DefectOverlay load(const QString &surfacePath);
+    // One capture's detections, as the detector reports them: xyxy relative
+    // to origin, the crop detection ran on
+    static DefectOverlay fromDetections(const QJsonArray &detections, const QPoint &origin = QPoint());
+    static QColor colorFor(const QString &defectType);
+
+    void append(const Defect &defect) { defects.append(defect); }
+    bool isEmpty() const { return defects.isEmpty(); }
+    int size() const { return defects.size(); }
+    const QVector<Defect> &items() const { return defects; }
+
+    // imageToTarget maps stitched image pixels to the painter's device. Outlines
+    // and labels keep a constant on-screen size whatever the zoom.
+    void paint(QPainter &painter, const QTransform &imageToTarget) const;
+
+    // Decodes stitched.jpg, burns the overlay in and writes outputPath
+    static bool exportLabeledImage(const QString &surfacePath, const QString &outputPath);
+
+private:
+    QVector<Defect> defects;
+};
+
+#endif // DEFECTOVERLAY_H
@@ -0,0 +1,106 @@
+#include "defectstore.h"
+#include <QFile>
+#include <QJsonDocument>
+#include <QDebug>
+
+bool DefectStore::load(const QString &coordinatesPath)
+{
+    clear();
+
+    QFile file(coordinatesPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Could not open defect coordinates file:" << coordinatesPath;
+        return false;
+    }
+
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
+    file.close();
+    if (!doc.isObject()) {
+        qWarning() << "Invalid JSON format in file:" << coordinatesPath;
+        return false;
+    }
+
+    const QJsonArray defects = doc.object()["defects"].toArray();
+    reserve(defects.size());
+    for (const QJsonValue &value : defects) {
+        const QJsonObject defect = value.toObject();
+        const QJsonObject physicalPos = defect["physical_position"].toObject();
+
+        // The stitcher writes the centre of the defect, as for canvas_position
+        const double width = physicalPos["width"].toDouble();
+        const double height = physicalPos["height"].toDouble();
+        DefectRecord record;
+        record.type = typeId(defect["type"].toString());
+        record.confidence = float(defect["confidence"].toDouble());
+        record.x = float(physicalPos["x"].toDouble() - width / 2);
+        record.y = float(physicalPos["y"].toDouble() - height / 2);
+        record.width = float(width);
+        record.height = float(height);
+        appendColumns(record);
+    }
+
+    // Shared with the parsed document, not copied
+    sources = defects;
+    return true;
+}
+
+void DefectStore::clear()
+{
+    types.clear();
+    confidences.clear();
+    xs.clear();
+    ys.clear();
+    widths.clear();
+    heights.clear();
+    names.clear();
+    sources = QJsonArray();
+}
+
+void DefectStore::reserve(int count)
+{
+    types.reserve(count);
+    confidences.reserve(count);
+    xs.reserve(count);
+    ys.reserve(count);
+    widths.reserve(count);
+    heights.reserve(count);
+}
+
+int DefectStore::append(const DefectRecord &defect, const QJsonObject &source)
+{
+    appendColumns(defect);
+    sources.append(source);
+    return int(types.size()) - 1;
+}
+
+void DefectStore::appendColumns(const DefectRecord &defect)
+{
+    types.append(defect.type);
+    confidences.append(defect.confidence);
+    xs.append(defect.x);
+    ys.append(defect.y);
+    widths.append(defect.width);
+    heights.append(defect.height);
+}
+
+DefectRecord DefectStore::at(int index) const
+{
+    DefectRecord record;
+    record.type = types.at(index);
+    record.confidence = confidences.at(index);
+    record.x = xs.at(index);
+    record.y = ys.at(index);
+    record.width = widths.at(index);
+    record.height = heights.at(index);
+    return record;
+}
+
+quint16 DefectStore::typeId(const QString &name)
+{
+    qsizetype id = names.indexOf(name);
+    if (id < 0) {
+        names.append(name);
+        id = names.size() - 1;
+    }
+    return quint16(id);
+}
@@ -0,0 +1,73 @@
+#ifndef DEFECTSTORE_H
+#define DEFECTSTORE_H
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QRectF>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// One defect as the cutting analysis sees it. POD: no strings, no JSON,
+// cheap to copy.
+struct DefectRecord {
+    quint16 type;       // Index into DefectStore::typeNames()
+    float confidence;
+    float x;            // Rectangle on the surface in mm: top left and size.
+    float y;            // physical_position holds the centre.
+    float width;
+    float height;
+
+    QRectF rect() const { return QRectF(x, y, width, height); }
+};
+
+// The defects of a surface in structure-of-arrays form, so that the loops
+// over thousands of defects read only the columns they use, from contiguous
+// memory. Everything else refers to a defect by its index here.
+//
+// JSON is only touched at the edges: load() parses defect_coordinates.json
+// once, and sourceObject() hands the original object back for writing
+// results; the loaded array is kept as is rather than copied per defect.
+class DefectStore
+{
+public:
+    // Reads the "defects" array of a defect_coordinates.json
+    bool load(const QString &coordinatesPath);
+    void clear();
+    void reserve(int count);
+    int append(const DefectRecord &defect, const QJsonObject &source = QJsonObject());
+
+    int size() const { return int(types.size()); }
+    bool isEmpty() const { return types.isEmpty(); }
+    DefectRecord at(int index) const;
+
+    // Columns, one entry per defect
+    const QVector<quint16> &typeColumn() const { return types; }
+    const QVector<float> &confidenceColumn() const { return confidences; }
+    const QVector<float> &xColumn() const { return xs; }
+    const QVector<float> &yColumn() const { return ys; }
+    const QVector<float> &widthColumn() const { return widths; }
+    const QVector<float> &heightColumn() const { return heights; }
+
+    // Type names are interned as they are first seen
+    quint16 typeId(const QString &name);
+    QString typeName(int index) const { return names.value(types.at(index)); }
+    const QStringList &typeNames() const { return names; }
+
+    // The defect's JSON as loaded (empty for appended records without one)
+    QJsonObject sourceObject(int index) const { return sources.at(index).toObject(); }
+
+private:
+    void appendColumns(const DefectRecord &defect);
+
+    QVector<quint16> types;
+    QVector<float> confidences;
+    QVector<float> xs;
+    QVector<float> ys;
+    QVector<float> widths;
+    QVector<float> heights;
+    QStringList names;
+    QJsonArray sources;
+};
+
+#endif // DEFECTSTORE_H
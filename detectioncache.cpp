@@ -0,0 +1,244 @@
+#include "detectioncache.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtEndian>
+#include <QDebug>
+#include <cstring>
+
+namespace {
+
+const quint64 Prime1 = 11400714785074694791ULL;
+const quint64 Prime2 = 14029467366897019727ULL;
+const quint64 Prime3 = 1609587929392839161ULL;
+const quint64 Prime4 = 9650029242287828579ULL;
+const quint64 Prime5 = 2870177450012600261ULL;
+
+inline quint64 rotateLeft(quint64 value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+inline quint64 read64(const uchar *p)
+{
+    quint64 value;
+    std::memcpy(&value, p, sizeof(value));
+    return qFromLittleEndian(value);
+}
+
+inline quint32 read32(const uchar *p)
+{
+    quint32 value;
+    std::memcpy(&value, p, sizeof(value));
+    return qFromLittleEndian(value);
+}
+
+inline quint64 round64(quint64 accumulator, quint64 input)
+{
+    accumulator += input * Prime2;
+    accumulator = rotateLeft(accumulator, 31);
+    return accumulator * Prime1;
+}
+
+inline quint64 merge64(quint64 accumulator, quint64 value)
+{
+    accumulator ^= round64(0, value);
+    return accumulator * Prime1 + Prime4;
+}
+
+QString hexKey(quint64 value)
+{
+    return QString("%1").arg(value, 16, 16, QChar('0'));
+}
+
+}
+
+DetectionCache::DetectionCache()
+    : cacheEnabled(true)
+    , contextValid(false)
+    , contextSeed(0)
+{
+    cacheDir = QString("%1/detection_cache")
+        .arg(QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation));
+}
+
+quint64 DetectionCache::hash(const void *data, qsizetype length, quint64 seed)
+{
+    const uchar *p = static_cast<const uchar *>(data);
+    const uchar *end = p + length;
+    quint64 h;
+
+    if (length >= 32) {
+        // Four independent lanes over 32-byte stripes
+        quint64 v1 = seed + Prime1 + Prime2;
+        quint64 v2 = seed + Prime2;
+        quint64 v3 = seed;
+        quint64 v4 = seed - Prime1;
+        const uchar *limit = end - 32;
+        do {
+            v1 = round64(v1, read64(p));
+            v2 = round64(v2, read64(p + 8));
+            v3 = round64(v3, read64(p + 16));
+            v4 = round64(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+        h = merge64(h, v1);
+        h = merge64(h, v2);
+        h = merge64(h, v3);
+        h = merge64(h, v4);
+    } else {
+        h = seed + Prime5;
+    }
+
+    h += quint64(length);
+
+    // Tail
+    while (p + 8 <= end) {
+        h ^= round64(0, read64(p));
+        h = rotateLeft(h, 27) * Prime1 + Prime4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= quint64(read32(p)) * Prime1;
+        h = rotateLeft(h, 23) * Prime2 + Prime3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= quint64(*p) * Prime5;
+        h = rotateLeft(h, 11) * Prime1;
+        ++p;
+    }
+
+    // Avalanche
+    h ^= h >> 33;
+    h *= Prime2;
+    h ^= h >> 29;
+    h *= Prime3;
+    h ^= h >> 32;
+    return h;
+}
+
+bool DetectionCache::hashFile(const QString &path, quint64 &result, quint64 seed)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    const qint64 size = file.size();
+    if (size == 0) {
+        result = hash(nullptr, 0, seed);
+        return true;
+    }
+
+    // Mapping avoids copying captures and model weights into a buffer first
+    uchar *data = file.map(0, size);
+    if (data) {
+        result = hash(data, size, seed);
+        file.unmap(data);
+        return true;
+    }
+
+    const QByteArray bytes = file.readAll();
+    if (bytes.size() != size) return false;
+    result = hash(bytes.constData(), bytes.size(), seed);
+    return true;
+}
+
+bool DetectionCache::setContext(const QString &modelPath, const QString &settings)
+{
+    contextValid = false;
+
+    QFileInfo info(modelPath);
+    const QString modelKey = QString("%1|%2|%3")
+        .arg(info.absoluteFilePath()).arg(info.size()).arg(info.lastModified().toMSecsSinceEpoch());
+    quint64 modelHash = 0;
+    auto known = modelHashes.constFind(modelKey);
+    if (known != modelHashes.constEnd()) {
+        modelHash = known.value();
+    } else if (hashFile(modelPath, modelHash)) {
+        modelHashes.insert(modelKey, modelHash);
+    } else {
+        qDebug() << "Detection cache disabled: cannot hash model" << modelPath;
+        return false;
+    }
+
+    const QByteArray context = QString("%1|%2").arg(hexKey(modelHash), settings).toUtf8();
+    contextSeed = hash(context.constData(), context.size());
+    contextValid = true;
+    return true;
+}
+
+QString DetectionCache::keyFor(const QString &imagePath) const
+{
+    if (!cacheEnabled || !contextValid) return QString();
+
+    quint64 imageHash = 0;
+    if (!hashFile(imagePath, imageHash, contextSeed)) return QString();
+    return hexKey(imageHash);
+}
+
+QString DetectionCache::keyFor(const QImage &frame) const
+{
+    if (!cacheEnabled || !contextValid || frame.isNull()) return QString();
+
+    // Row by row, each seeded with the hash so far; the padding at the end
+    // of a scan line is not part of the image
+    const QByteArray layout = QString("%1x%2|%3").arg(frame.width()).arg(frame.height())
+        .arg(int(frame.format())).toUtf8();
+    quint64 frameHash = hash(layout.constData(), layout.size(), contextSeed);
+    const qsizetype rowBytes = (qsizetype(frame.width()) * frame.depth() + 7) / 8;
+    for (int y = 0; y < frame.height(); ++y) {
+        frameHash = hash(frame.constScanLine(y), rowBytes, frameHash);
+    }
+    return hexKey(frameHash);
+}
+
+QString DetectionCache::entryPath(const QString &key) const
+{
+    return QString("%1/%2/%3.json").arg(cacheDir, key.left(2), key);
+}
+
+bool DetectionCache::lookup(const QString &key, QJsonArray &detections) const
+{
+    if (key.isEmpty()) return false;
+
+    QFile file(entryPath(key));
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    QJsonParseError parseError;
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &parseError);
+    file.close();
+    if (parseError.error != QJsonParseError::NoError || !doc.isObject()) {
+        qDebug() << "Ignoring unreadable detection cache entry" << file.fileName();
+        return false;
+    }
+
+    detections = doc.object()["detections"].toArray();
+    return true;
+}
+
+bool DetectionCache::store(const QString &key, const QJsonArray &detections) const
+{
+    if (key.isEmpty()) return false;
+
+    const QString path = entryPath(key);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    QJsonObject entry;
+    entry["detections"] = detections;
+
+    // Atomic, so a reader never sees half an entry
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Failed to write detection cache entry" << path;
+        return false;
+    }
+    file.write(QJsonDocument(entry).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
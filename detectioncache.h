@@ -0,0 +1,58 @@
+#ifndef DETECTIONCACHE_H
+#define DETECTIONCACHE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QImage>
+#include <QJsonArray>
+#include <QString>
+
+// Persistent store of detection results keyed by what determines them: the
+// image's bytes, the model file and the detection settings. Re-analysing an
+// archived session, or re-queueing images that were already run, is answered
+// from here without touching the model.
+//
+// Keys are XXH64 of the image bytes, seeded with a hash of the context
+// (model hash plus settings), so a new model or threshold misses rather than
+// returning stale results. Entries are small JSON files sharded by the first
+// byte of the key under AppLocalDataLocation/detection_cache.
+class DetectionCache
+{
+public:
+    DetectionCache();
+
+    // XXH64, as in the reference implementation
+    static quint64 hash(const void *data, qsizetype length, quint64 seed = 0);
+    // Hashes a file through a memory map; returns false if it cannot be read
+    static bool hashFile(const QString &path, quint64 &result, quint64 seed = 0);
+
+    void setEnabled(bool enabled) { cacheEnabled = enabled; }
+    bool isEnabled() const { return cacheEnabled; }
+
+    // Model file plus a description of every setting that changes results.
+    // Returns false (and disables lookups) if the model cannot be hashed.
+    bool setContext(const QString &modelPath, const QString &settings);
+    bool hasContext() const { return contextValid; }
+    // Changes whenever setContext() does; keys made under another id are stale
+    quint64 contextId() const { return contextSeed; }
+
+    // Empty if the cache is off or the image cannot be read. Both read the
+    // whole image, so callers keep them off the UI thread.
+    QString keyFor(const QString &imagePath) const;
+    // A decoded frame is keyed by its pixels, so it never matches the key of
+    // the file it came from
+    QString keyFor(const QImage &frame) const;
+    bool lookup(const QString &key, QJsonArray &detections) const;
+    bool store(const QString &key, const QJsonArray &detections) const;
+
+private:
+    QString entryPath(const QString &key) const;
+
+    QString cacheDir;
+    bool cacheEnabled;
+    bool contextValid;
+    quint64 contextSeed;
+    QHash<QString, quint64> modelHashes;  // "path|size|mtime" -> hash, so a model is hashed once
+};
+
+#endif // DETECTIONCACHE_H
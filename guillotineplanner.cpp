@@ -0,0 +1,406 @@
+#include "guillotineplanner.h"
+#include <QHash>
+#include <QPair>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Half-open rectangle in ticks
+struct Box {
+    int left;
+    int top;
+    int right;
+    int bottom;
+};
+
+// Boxes solved by the full search before the rest settle for strips; keeps
+// a surface with many scattered defects to a few milliseconds
+const int MaxSearchedBoxes = 4000;
+
+enum class Split : quint8 { None, Vertical, Horizontal, Rows, Columns };
+
+struct Choice {
+    int pieces = 0;
+    Split split = Split::None;
+    int position = 0;  // Tick of the cut
+};
+
+class PlanSearch
+{
+public:
+    PlanSearch(int pieceWidth, int pieceHeight, const QVector<Box> &defects)
+        : pieceWidth(pieceWidth), pieceHeight(pieceHeight), defects(defects) {}
+
+    int solve(const Box &box);
+    void collect(const Box &box, QVector<Box> &pieces) const;
+    int solvedCount() const { return int(memo.size()); }
+    bool isExhaustive() const { return !budgetHit; }
+
+private:
+    static quint64 key(const Box &box)
+    {
+        return (quint64(box.left) << 48) | (quint64(box.top) << 32)
+             | (quint64(box.right) << 16) | quint64(box.bottom);
+    }
+    // Most pieces the box could hold without defects
+    int bound(const Box &box) const
+    {
+        return ((box.right - box.left) / pieceWidth) * ((box.bottom - box.top) / pieceHeight);
+    }
+    void defectsIn(const Box &box, QVector<int> &inside) const;
+    // Drops the waste past the last edge a piece can end on
+    Box reduced(const Box &box, const QVector<int> &inside) const;
+    // Pieces crossing every line across the box, integrated over the box
+    int lineBound(const Box &box, const QVector<int> &inside, bool rows) const;
+    // Best plan of piece-high strips across the box (rows) or piece-wide
+    // strips down it, each filled from its start; pieces are added when given
+    int strips(const Box &box, const QVector<int> &inside, bool rows, QVector<Box> *pieces = nullptr) const;
+    int fillStrip(const Box &box, const QVector<int> &inside, bool rows, int start, QVector<Box> *pieces) const;
+    // Once out, every open box keeps the best it has so far
+    bool outOfBudget()
+    {
+        budgetHit = budgetHit || memo.size() >= MaxSearchedBoxes;
+        return budgetHit;
+    }
+    QVector<int> cutPositions(int nearEdge, int farEdge, int pieceSize,
+                              const QVector<int> &inside, bool vertical) const;
+
+    int pieceWidth;
+    int pieceHeight;
+    QVector<Box> defects;
+    QHash<quint64, Choice> memo;  // Only boxes with a defect in them
+    bool budgetHit = false;
+    mutable QVector<QPair<int, int>> stripBlockers;  // Scratch for fillStrip()
+};
+
+void PlanSearch::defectsIn(const Box &box, QVector<int> &inside) const
+{
+    for (int i = 0; i < defects.size(); ++i) {
+        const Box &defect = defects[i];
+        if (defect.left < box.right && defect.right > box.left
+            && defect.top < box.bottom && defect.bottom > box.top) {
+            inside.append(i);
+        }
+    }
+}
+
+Box PlanSearch::reduced(const Box &box, const QVector<int> &inside) const
+{
+    // Pieces start at the box's near edge or just past a defect, so they can
+    // only end a whole number of pieces after one of those
+    auto lastEdge = [&](int nearEdge, int farEdge, int pieceSize, bool vertical) {
+        int last = nearEdge + (farEdge - nearEdge) / pieceSize * pieceSize;
+        for (int i : inside) {
+            const int defectEnd = vertical ? defects[i].right : defects[i].bottom;
+            if (defectEnd > nearEdge && defectEnd < farEdge) {
+                last = qMax(last, defectEnd + (farEdge - defectEnd) / pieceSize * pieceSize);
+            }
+        }
+        return last;
+    };
+    Box result = box;
+    result.right = lastEdge(box.left, box.right, pieceWidth, true);
+    result.bottom = lastEdge(box.top, box.bottom, pieceHeight, false);
+    return result;
+}
+
+int PlanSearch::lineBound(const Box &box, const QVector<int> &inside, bool rows) const
+{
+    // Along each line the best is greedy: a piece as early as the defects
+    // crossing that line allow. Those only change at defect edges.
+    const int lineStart = rows ? box.top : box.left;
+    const int lineEnd = rows ? box.bottom : box.right;
+    const int alongStart = rows ? box.left : box.top;
+    const int alongEnd = rows ? box.right : box.bottom;
+    const int alongSize = rows ? pieceWidth : pieceHeight;
+    const int acrossSize = rows ? pieceHeight : pieceWidth;
+
+    QVector<int> breaks = {lineStart, lineEnd};
+    for (int i : inside) {
+        const Box &defect = defects[i];
+        breaks.append(qBound(lineStart, rows ? defect.top : defect.left, lineEnd));
+        breaks.append(qBound(lineStart, rows ? defect.bottom : defect.right, lineEnd));
+    }
+    std::sort(breaks.begin(), breaks.end());
+    breaks.erase(std::unique(breaks.begin(), breaks.end()), breaks.end());
+
+    QVector<QPair<int, int>> blockers;
+    qint64 total = 0;
+    for (int b = 0; b + 1 < breaks.size(); ++b) {
+        blockers.clear();
+        for (int i : inside) {
+            const Box &defect = defects[i];
+            const int from = rows ? defect.top : defect.left;
+            const int to = rows ? defect.bottom : defect.right;
+            if (from < breaks[b + 1] && to > breaks[b]) {
+                blockers.append(qMakePair(rows ? defect.left : defect.top, rows ? defect.right : defect.bottom));
+            }
+        }
+        std::sort(blockers.begin(), blockers.end());
+
+        int position = alongStart;
+        int count = 0;
+        for (const QPair<int, int> &blocker : std::as_const(blockers)) {
+            if (blocker.first > position) count += (blocker.first - position) / alongSize;
+            position = qMax(position, blocker.second);
+        }
+        if (alongEnd > position) count += (alongEnd - position) / alongSize;
+        total += qint64(count) * (breaks[b + 1] - breaks[b]);
+    }
+    return int(total / acrossSize);
+}
+
+int PlanSearch::strips(const Box &box, const QVector<int> &inside, bool rows, QVector<Box> *pieces) const
+{
+    const int nearEdge = rows ? box.top : box.left;
+    const int farEdge = rows ? box.bottom : box.right;
+    const int stripSize = rows ? pieceHeight : pieceWidth;
+
+    // Strips start a whole number of strips from the near edge or a defect
+    QVector<int> starts = cutPositions(nearEdge - stripSize, farEdge - stripSize + 1, stripSize, inside, !rows);
+    if (starts.isEmpty() || starts.first() != nearEdge) starts.prepend(nearEdge);
+
+    // best[i]: most pieces from strips starting at starts[i] or later
+    const int count = int(starts.size());
+    QVector<int> best(count + 1, 0);
+    QVector<int> next(count, count);
+    QVector<bool> taken(count, false);
+    for (int i = count - 1; i >= 0; --i) {
+        next[i] = int(std::lower_bound(starts.begin() + i, starts.end(), starts[i] + stripSize) - starts.begin());
+        const int withStrip = fillStrip(box, inside, rows, starts[i], nullptr) + best[next[i]];
+        taken[i] = withStrip > best[i + 1];
+        best[i] = taken[i] ? withStrip : best[i + 1];
+    }
+
+    if (pieces) {
+        for (int i = 0; i < count; i = taken[i] ? next[i] : i + 1) {
+            if (taken[i]) fillStrip(box, inside, rows, starts[i], pieces);
+        }
+    }
+    return best[0];
+}
+
+int PlanSearch::fillStrip(const Box &box, const QVector<int> &inside, bool rows, int start, QVector<Box> *pieces) const
+{
+    const int end = start + (rows ? pieceHeight : pieceWidth);
+    const int alongSize = rows ? pieceWidth : pieceHeight;
+
+    QVector<QPair<int, int>> &blockers = stripBlockers;
+    blockers.clear();
+    for (int i : inside) {
+        const Box &defect = defects[i];
+        const int from = rows ? defect.top : defect.left;
+        const int to = rows ? defect.bottom : defect.right;
+        if (from < end && to > start) {
+            blockers.append(qMakePair(rows ? defect.left : defect.top, rows ? defect.right : defect.bottom));
+        }
+    }
+    std::sort(blockers.begin(), blockers.end());
+    blockers.append(qMakePair(rows ? box.right : box.bottom, 0));
+
+    int position = rows ? box.left : box.top;
+    int count = 0;
+    for (const QPair<int, int> &blocker : std::as_const(blockers)) {
+        for (; position + alongSize <= blocker.first; position += alongSize) {
+            if (pieces) {
+                pieces->append(rows ? Box{position, start, position + alongSize, end}
+                                    : Box{start, position, end, position + alongSize});
+            }
+            ++count;
+        }
+        position = qMax(position, blocker.second);
+    }
+    return count;
+}
+
+QVector<int> PlanSearch::cutPositions(int nearEdge, int farEdge, int pieceSize,
+                                      const QVector<int> &inside, bool vertical) const
+{
+    // Whole pieces from the near edge, or from just past a defect
+    QVector<int> cuts;
+    for (int position = nearEdge + pieceSize; position < farEdge; position += pieceSize) {
+        cuts.append(position);
+    }
+    for (int i : inside) {
+        const int defectEnd = vertical ? defects[i].right : defects[i].bottom;
+        for (int position = defectEnd; position > nearEdge && position < farEdge; position += pieceSize) {
+            cuts.append(position);
+        }
+    }
+    std::sort(cuts.begin(), cuts.end());
+    cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+    return cuts;
+}
+
+int PlanSearch::solve(const Box &wholeBox)
+{
+    if (wholeBox.right - wholeBox.left < pieceWidth || wholeBox.bottom - wholeBox.top < pieceHeight) return 0;
+
+    // A clean box is simply tiled
+    QVector<int> inside;
+    defectsIn(wholeBox, inside);
+    if (inside.isEmpty()) return bound(wholeBox);
+
+    // Boxes that differ only in waste share one solution
+    const Box box = reduced(wholeBox, inside);
+    const int width = box.right - box.left;
+    const int height = box.bottom - box.top;
+    if (box.right != wholeBox.right || box.bottom != wholeBox.bottom) {
+        inside.clear();
+        defectsIn(box, inside);
+        if (inside.isEmpty()) return bound(box);
+    }
+
+    const quint64 boxKey = key(box);
+    auto it = memo.constFind(boxKey);
+    if (it != memo.constEnd()) return it->pieces;
+
+    // Strips give a plan to beat, and often one that meets the bound
+    const int upper = qMin(bound(box), qMin(lineBound(box, inside, true), lineBound(box, inside, false)));
+    Choice best;
+    const int rowPieces = strips(box, inside, true);
+    const int columnPieces = strips(box, inside, false);
+    best.pieces = qMax(rowPieces, columnPieces);
+    best.split = rowPieces >= columnPieces ? Split::Rows : Split::Columns;
+    if (best.pieces >= upper || outOfBudget()) {
+        memo.insert(boxKey, best);
+        return best.pieces;
+    }
+
+    const int rows = height / pieceHeight;
+    for (int cut : cutPositions(box.left, box.right, pieceWidth, inside, true)) {
+        if (best.pieces >= upper || outOfBudget()) break;
+        if (((cut - box.left) / pieceWidth + (box.right - cut) / pieceWidth) * rows <= best.pieces) continue;
+        const Box first = {box.left, box.top, cut, box.bottom};
+        const Box second = {cut, box.top, box.right, box.bottom};
+        int pieces = solve(first);
+        if (pieces + bound(second) <= best.pieces) continue;
+        pieces += solve(second);
+        if (pieces > best.pieces) {
+            best.pieces = pieces;
+            best.split = Split::Vertical;
+            best.position = cut;
+        }
+    }
+
+    const int columns = width / pieceWidth;
+    for (int cut : cutPositions(box.top, box.bottom, pieceHeight, inside, false)) {
+        if (best.pieces >= upper || outOfBudget()) break;
+        if (((cut - box.top) / pieceHeight + (box.bottom - cut) / pieceHeight) * columns <= best.pieces) continue;
+        const Box first = {box.left, box.top, box.right, cut};
+        const Box second = {box.left, cut, box.right, box.bottom};
+        int pieces = solve(first);
+        if (pieces + bound(second) <= best.pieces) continue;
+        pieces += solve(second);
+        if (pieces > best.pieces) {
+            best.pieces = pieces;
+            best.split = Split::Horizontal;
+            best.position = cut;
+        }
+    }
+
+    memo.insert(boxKey, best);
+    return best.pieces;
+}
+
+void PlanSearch::collect(const Box &wholeBox, QVector<Box> &pieces) const
+{
+    if (wholeBox.right - wholeBox.left < pieceWidth || wholeBox.bottom - wholeBox.top < pieceHeight) return;
+
+    // The same reduction as solve() so the memo keys match
+    QVector<int> inside;
+    defectsIn(wholeBox, inside);
+    Box box = wholeBox;
+    if (!inside.isEmpty()) {
+        box = reduced(wholeBox, inside);
+        inside.clear();
+        defectsIn(box, inside);
+    }
+    if (inside.isEmpty()) {
+        for (int top = box.top; top + pieceHeight <= box.bottom; top += pieceHeight) {
+            for (int left = box.left; left + pieceWidth <= box.right; left += pieceWidth) {
+                pieces.append({left, top, left + pieceWidth, top + pieceHeight});
+            }
+        }
+        return;
+    }
+
+    const Choice choice = memo.value(key(box));
+    if (choice.split == Split::Vertical) {
+        collect({box.left, box.top, choice.position, box.bottom}, pieces);
+        collect({choice.position, box.top, box.right, box.bottom}, pieces);
+    } else if (choice.split == Split::Horizontal) {
+        collect({box.left, box.top, box.right, choice.position}, pieces);
+        collect({box.left, choice.position, box.right, box.bottom}, pieces);
+    } else if (choice.split == Split::Rows || choice.split == Split::Columns) {
+        strips(box, inside, choice.split == Split::Rows, &pieces);
+    }
+}
+
+} // namespace
+
+GuillotinePlanner::GuillotinePlanner(const QRectF &area, double pieceWidth, double pieceHeight)
+    : area(area)
+    , pieceWidth(pieceWidth)
+    , pieceHeight(pieceHeight)
+{
+    // Box coordinates are packed into 16 bits each for the memo key
+    ticksPerMm = qMin(100.0, 65535.0 / qMax(1.0, qMax(area.width(), area.height())));
+}
+
+GuillotinePlan GuillotinePlanner::plan(const DefectStore &defects) const
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    GuillotinePlan result;
+    // Ticks count from the area's corner
+    const int width = int(std::floor(area.width() * ticksPerMm + 1e-6));
+    const int height = int(std::floor(area.height() * ticksPerMm + 1e-6));
+    const int tickWidth = int(std::floor(pieceWidth * ticksPerMm + 1e-6));
+    const int tickHeight = int(std::floor(pieceHeight * ticksPerMm + 1e-6));
+    if (width <= 0 || height <= 0 || tickWidth <= 0 || tickHeight <= 0) return result;
+
+    // Defects clipped to the area as in CuttingAnalyzer::pieceRange(),
+    // then widened to whole ticks; one with no extent still takes a tick
+    QVector<Box> boxes;
+    boxes.reserve(defects.size());
+    for (int i = 0; i < defects.size(); ++i) {
+        const double left = defects.xColumn()[i] - area.left();
+        const double top = defects.yColumn()[i] - area.top();
+        const double right = left + defects.widthColumn()[i];
+        const double bottom = top + defects.heightColumn()[i];
+        if (right < 0 || left > area.width() || bottom < 0 || top > area.height()) {
+            continue;
+        }
+
+        Box box;
+        box.left = qBound(0, int(std::floor(left * ticksPerMm)), width - 1);
+        box.top = qBound(0, int(std::floor(top * ticksPerMm)), height - 1);
+        box.right = qBound(box.left + 1, int(std::ceil(right * ticksPerMm)), width);
+        box.bottom = qBound(box.top + 1, int(std::ceil(bottom * ticksPerMm)), height);
+        boxes.append(box);
+    }
+
+    PlanSearch search(tickWidth, tickHeight, boxes);
+    const Box surface = {0, 0, width, height};
+    search.solve(surface);
+
+    QVector<Box> pieces;
+    search.collect(surface, pieces);
+    std::sort(pieces.begin(), pieces.end(), [](const Box &a, const Box &b) {
+        return a.top != b.top ? a.top < b.top : a.left < b.left;
+    });
+
+    result.pieces.reserve(pieces.size());
+    for (const Box &piece : std::as_const(pieces)) {
+        result.pieces.append(QRectF(area.left() + piece.left / ticksPerMm, area.top() + piece.top / ticksPerMm,
+                                    tickWidth / ticksPerMm, tickHeight / ticksPerMm));
+    }
+    result.searchedRects = search.solvedCount();
+    result.optimal = search.isExhaustive();
+    result.elapsedMs = timer.nsecsElapsed() / 1e6;
+    return result;
+}
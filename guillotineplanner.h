@@ -0,0 +1,54 @@
+#ifndef GUILLOTINEPLANNER_H
+#define GUILLOTINEPLANNER_H
+
+#include <QRectF>
+#include <QVector>
+#include "defectstore.h"
+
+// Where the pieces of one surface come from when it is cut around its
+// defects. Every piece has the planned size and no defect in it.
+struct GuillotinePlan {
+    QVector<QRectF> pieces;  // mm on the surface, top to bottom, left to right
+    int searchedRects = 0;   // Distinct sub-rectangles the search solved
+    bool optimal = true;     // False if the search ran out of budget somewhere
+    double elapsedMs = 0.0;
+
+    bool isEmpty() const { return pieces.isEmpty(); }
+};
+
+// Plans guillotine cuts (each one straight across the part it divides) that
+// give the most defect-free pieces of one size.
+//
+// The search solves a rectangle as either a clean block, tiled from its top
+// left corner, or the best split by one vertical or horizontal cut, and
+// memoizes every sub-rectangle it solves. Cuts are only tried where an
+// optimal plan can have one: a whole number of pieces from the rectangle's
+// near edge or from the far edge of a defect inside it. A split is skipped
+// when the pieces that could possibly fit its two sides cannot beat the best
+// split found so far, and a rectangle stops searching once it reaches that
+// bound. Every rectangle starts from its best plan of straight strips, which
+// often already meets the bound; past a fixed number of rectangles the
+// search keeps those plans instead of splitting further.
+//
+// Only the area given is cut, so a trim around it stays waste. Coordinates
+// are held in integer ticks of at most 0.01 mm from its corner. Defects are
+// widened to whole ticks and the area and piece size are rounded down, so a
+// planned piece stays inside the area, never touches a defect and is at most
+// one tick short.
+class GuillotinePlanner
+{
+public:
+    // area is in mm on the surface; so are the planned pieces
+    GuillotinePlanner(const QRectF &area, double pieceWidth, double pieceHeight);
+
+    // Thread-safe; all search state is local to the call
+    GuillotinePlan plan(const DefectStore &defects) const;
+
+private:
+    QRectF area;
+    double pieceWidth;
+    double pieceHeight;
+    double ticksPerMm;
+};
+
+#endif // GUILLOTINEPLANNER_H
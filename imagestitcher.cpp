@@ -1,4 +1,10 @@
 #include "imagestitcher.h"
+#include "jpegstripwriter.h"
+#include "tilereader.h"
+#include "capturestore.h"
+#include "tileregistration.h"
+#include "tilepyramid.h"
+#include "defectoverlay.h"
 #include <QDir>
 #include <QPainter>
 #include <QJsonDocument>
@@ -6,7 +12,12 @@
 #include <QJsonArray>
 #include <QFile>
 #include <QFileInfo>
+#include <QImageReader>
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QtConcurrent>
+#include <cstring>
 
 ImageStitcher::ImageStitcher(const QString &surfacePath,
                            int imagesInX, int imagesInY,
@@ -19,73 +30,304 @@ ImageStitcher::ImageStitcher(const QString &surfacePath,
     , sequence(sequence)
     , actualWidth(actualWidth)
     , actualHeight(actualHeight)
+    , stitchMode(StitchMode::Streaming)
+    , bandHeight(64)
+    , lastStitchSucceeded(false)
+    , registrationEnabled(true)
+    , pyramidEnabled(true)
 {
+    // Decoding is CPU bound; never run more decoders than cores
+    decodePool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+
+    connect(&stitchWatcher, &QFutureWatcher<bool>::finished, this, [this]() {
+        lastStitchSucceeded = stitchWatcher.result();
+        emit finished();
+    });
+}
+
+ImageStitcher::~ImageStitcher()
+{
+    // The background stitch uses this object's members
+    stitchWatcher.waitForFinished();
+}
+
+void ImageStitcher::setMaxDecodeThreads(int threads)
+{
+    decodePool.setMaxThreadCount(qMax(1, threads));
 }
 
 bool ImageStitcher::stitchImages()
+{
+    lastStitchSucceeded = runStitch();
+    
+    // Emit finished signal
+    emit finished();
+    
+    return lastStitchSucceeded;
+}
+
+void ImageStitcher::stitchImagesAsync()
+{
+    if (stitchWatcher.isRunning()) {
+        qDebug() << "Stitch already running for" << surfacePath;
+        return;
+    }
+
+    // Run the whole stitch on the global pool; tile decodes fan out on decodePool
+    stitchWatcher.setFuture(QtConcurrent::run([this]() { return runStitch(); }));
+}
+
+bool ImageStitcher::runStitch()
+{
+    QElapsedTimer totalTimer;
+    totalTimer.start();
+
+    StitchTimings stageTimes;
+    stageTimes.threadCount = decodePool.maxThreadCount();
+
+    // Measure the real tile offsets before anything is cropped
+    if (registrationEnabled) {
+        registerTiles(stageTimes);
+    }
+
+    QSize canvasSize = getCanvasSize();
+    bool success = (stitchMode == StitchMode::Streaming)
+        ? stitchStreaming(canvasSize, stageTimes)
+        : stitchToCanvas(canvasSize, stageTimes);
+
+    stageTimes.totalMs = totalTimer.elapsed();
+    lastTimings = stageTimes;
+    qDebug() << "Stitch timings for" << surfacePath << ":" << timingsSummary();
+
+    return success;
+}
+
+QString ImageStitcher::timingsSummary() const
+{
+    return QString("%1 tiles on %2 threads - register %3 ms, decode %4 ms, compose %5 ms, encode %6 ms, total %7 ms")
+        .arg(lastTimings.tileCount)
+        .arg(lastTimings.threadCount)
+        .arg(lastTimings.registerMs)
+        .arg(lastTimings.decodeMs)
+        .arg(lastTimings.composeMs)
+        .arg(lastTimings.encodeMs)
+        .arg(lastTimings.totalMs);
+}
+
+QSize ImageStitcher::getCanvasSize() const
 {
     // Calculate canvas size maintaining aspect ratio
     const int baseWidth = 4400;  // 3 * 970 for 3x3 grid
     const double aspectRatio = actualWidth / actualHeight;
-    const int canvasWidth = baseWidth;
-    const int canvasHeight = static_cast<int>(baseWidth / aspectRatio);
+    return QSize(baseWidth, static_cast<int>(baseWidth / aspectRatio));
+}
+
+bool ImageStitcher::stitchToCanvas(const QSize &canvasSize, StitchTimings &stageTimes)
+{
+    const int canvasWidth = canvasSize.width();
+    const int canvasHeight = canvasSize.height();
+    QElapsedTimer timer;
+    timer.start();
     
     // Create canvas
     QImage canvas(canvasWidth, canvasHeight, QImage::Format_RGB888);
     canvas.fill(Qt::black);
     
-    QPainter painter(&canvas);
-    
-    // Process each position in the sequence
+    // Tiles own disjoint cells, so every worker writes straight into the canvas.
+    // Take the pixel pointer here so workers never touch the QImage itself.
+    uchar *canvasBits = canvas.bits();
+    const qsizetype canvasBytesPerLine = canvas.bytesPerLine();
+    const QRect canvasArea(QPoint(0, 0), canvasSize);
+    QAtomicInt placedTiles;
+
+    QVector<int> positions;
     for (int position = 0; position < sequence.size(); ++position) {
-        // sequence[position] tells us which image number goes at this position
-        int imageNumber = sequence[position];  // This is the image number we want at this position
-        
-        // Load the image
-        QString imagePath = QString("%1/image_%2.jpg").arg(surfacePath).arg(imageNumber, 2, 10, QChar('0'));
-        
-        QImage img(imagePath);
-        if (img.isNull()) continue;
-        
-        // Crop center region
-        QImage croppedImg = cropCenterRegion(img);
+        positions.append(position);
+    }
+
+    QtConcurrent::blockingMap(&decodePool, positions, [&](int position) {
+        QImage tile = loadTile(position);
+        if (tile.isNull()) return;
         
         // Calculate position based on sequence position
         QPoint imagePos = getImagePosition(position, canvasWidth, canvasHeight);
+        QRect cell = getCellRect(position, canvasWidth, canvasHeight);
         
-        // Draw image
-        painter.drawImage(imagePos, croppedImg);
-    }
-    
-    painter.end();
+        blitTile(canvasBits, canvasBytesPerLine, canvasArea, tile, imagePos, cell);
+        placedTiles.fetchAndAddRelaxed(1);
+    });
+
+    // Decode, crop and placement overlap inside the workers
+    stageTimes.decodeMs = timer.restart();
+    stageTimes.tileCount = placedTiles.loadRelaxed();
     
     // Save stitched image
-    bool success = canvas.save(QString("%1/stitched.jpg").arg(surfacePath), "JPG", 100);
-    
-    // Emit finished signal
-    emit finished();
-    
-    return success;
+    bool saved = canvas.save(QString("%1/stitched.jpg").arg(surfacePath), "JPG", 100);
+    if (saved && pyramidEnabled) {
+        saved = TilePyramidWriter::writeImage(surfacePath, "stitched", canvas);
+    }
+    stageTimes.encodeMs = timer.elapsed();
+    return saved;
 }
 
-QImage ImageStitcher::cropCenterRegion(const QImage &source)
+bool ImageStitcher::stitchStreaming(const QSize &canvasSize, StitchTimings &stageTimes)
 {
-    const int cropWidth = 1100;
-    const int cropHeight = 778;
-    
-    // Calculate center position
-    int x = (source.width() - cropWidth) / 2;
-    int y = (source.height() - cropHeight) / 2;
-    
-    // Ensure valid crop region
-    if (x < 0 || y < 0 || x + cropWidth > source.width() || y + cropHeight > source.height()) {
-        return source.scaled(cropWidth, cropHeight, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    const int canvasWidth = canvasSize.width();
+    const int canvasHeight = canvasSize.height();
+    const int cellHeight = canvasHeight / imagesInY;
+    QElapsedTimer timer;
+
+    JpegStripWriter writer;
+    if (!writer.open(QString("%1/stitched.jpg").arg(surfacePath), canvasWidth, canvasHeight, 100)) {
+        qDebug() << "Failed to open stitched image for streaming:" << writer.errorString();
+        return false;
+    }
+
+    // Viewer tiles are cut from the same bands as they are encoded
+    TilePyramidWriter pyramid;
+    if (pyramidEnabled && !pyramid.open(surfacePath, "stitched", canvasWidth, canvasHeight)) {
+        qDebug() << "Failed to open stitched tile pyramid:" << pyramid.errorString();
+        return false;
+    }
+
+    QImage band(canvasWidth, bandHeight, QImage::Format_RGB888);
+
+    // Each grid row owns a horizontal slab of the canvas; only that row's tiles
+    // are held in memory while its bands are composed and encoded.
+    for (int row = 0; row < imagesInY; ++row) {
+        const int slabTop = row * cellHeight;
+        const int slabBottom = (row == imagesInY - 1) ? canvasHeight : slabTop + cellHeight;
+
+        QVector<int> rowPositions;
+        for (int col = 0; col < imagesInX; ++col) {
+            int position = row * imagesInX + col;
+            if (position >= sequence.size()) break;
+            rowPositions.append(position);
+        }
+
+        // Decode and crop the row's tiles concurrently
+        timer.start();
+        const QList<QImage> decoded = QtConcurrent::blockingMapped<QList<QImage>>(&decodePool, rowPositions,
+            [this](int position) { return loadTile(position); });
+        stageTimes.decodeMs += timer.elapsed();
+
+        QVector<int> positions;
+        QVector<QImage> tiles;
+        for (int i = 0; i < decoded.size(); ++i) {
+            if (decoded[i].isNull()) continue;
+            positions.append(rowPositions[i]);
+            tiles.append(decoded[i]);
+        }
+        stageTimes.tileCount += tiles.size();
+
+        for (int bandTop = slabTop; bandTop < slabBottom; bandTop += bandHeight) {
+            const int rows = qMin(bandHeight, slabBottom - bandTop);
+
+            timer.start();
+            band.fill(Qt::black);
+            const QRect bandArea(QPoint(0, bandTop), band.size());
+            for (int i = 0; i < tiles.size(); ++i) {
+                QPoint imagePos = getImagePosition(positions[i], canvasWidth, canvasHeight);
+                QRect cell = getCellRect(positions[i], canvasWidth, canvasHeight);
+                blitTile(band.bits(), band.bytesPerLine(), bandArea, tiles[i], imagePos, cell);
+            }
+            stageTimes.composeMs += timer.restart();
+
+            bool written = writer.writeRows(band.constBits(), rows, band.bytesPerLine());
+            if (written && pyramidEnabled && !pyramid.writeRows(band.constBits(), rows, band.bytesPerLine())) {
+                qDebug() << "Failed to write stitched tile pyramid:" << pyramid.errorString();
+                written = false;
+            }
+            stageTimes.encodeMs += timer.elapsed();
+            if (!written) {
+                qDebug() << "Failed to encode stitched band:" << writer.errorString();
+                return false;
+            }
+        }
+    }
+
+    timer.start();
+    bool finishedOk = writer.finish();
+    if (finishedOk && pyramidEnabled && !pyramid.finish()) {
+        qDebug() << "Failed to finish stitched tile pyramid:" << pyramid.errorString();
+        finishedOk = false;
+    }
+    stageTimes.encodeMs += timer.elapsed();
+    if (!finishedOk) {
+        qDebug() << "Failed to finish stitched image:" << writer.errorString();
+        return false;
     }
+    return true;
+}
+
+QString ImageStitcher::tilePath(int position) const
+{
+    // sequence[position] tells us which image number goes at this position
+    int imageNumber = sequence[position];
+    return CaptureStore::findCapture(surfacePath, imageNumber);
+}
+
+QImage ImageStitcher::loadTile(int position) const
+{
+    // Decode only the center region; blitTile copies raw RGB888 rows.
+    // A tile that landed off its nominal spot is cropped against its offset.
+    QImage tile = TileReader::readCenterCrop(tilePath(position), TileReader::defaultCropSize(),
+                                             -tileCorrection(position));
+    if (tile.isNull()) return QImage();
     
-    return source.copy(x, y, cropWidth, cropHeight);
+    return tile.convertToFormat(QImage::Format_RGB888);
+}
+
+void ImageStitcher::registerTiles(StitchTimings &stageTimes)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const int downsample = TileRegistration::defaultDownsample();
+    QVector<int> positions;
+    for (int position = 0; position < sequence.size(); ++position) {
+        positions.append(position);
+    }
+
+    // Registration works on small grey copies that the decoder scales down itself
+    const QList<QImage> thumbnails = QtConcurrent::blockingMapped<QList<QImage>>(&decodePool, positions,
+        [this, downsample](int position) { return TileReader::readDownsampled(tilePath(position), downsample); });
+
+    TileRegistration registration(imagesInX, imagesInY, getCellSize(), downsample);
+    registration.setCropMargin(getCropMargin());
+    for (int position = 0; position < thumbnails.size(); ++position) {
+        registration.setTile(position, thumbnails[position]);
+    }
+    registration.run(&decodePool);
+    registration.save(surfacePath, sequence);
+
+    tileCorrections = registration.corrections();
+    stageTimes.registerMs = timer.elapsed();
+}
+
+int ImageStitcher::positionForImage(const QString &imagePath) const
+{
+    // Captures are named image_NN.<ext> where NN is the image number in the sequence
+    int imageNumber = CaptureStore::imageNumber(QFileInfo(imagePath).fileName());
+    if (imageNumber < 0) return -1;
+
+    return sequence.indexOf(imageNumber);
 }
 
-QPoint ImageStitcher::getImagePosition(int sequencePosition, int canvasWidth, int canvasHeight)
+QSize ImageStitcher::getCellSize() const
+{
+    QSize canvasSize = getCanvasSize();
+    return QSize(canvasSize.width() / imagesInX, canvasSize.height() / imagesInY);
+}
+
+QSize ImageStitcher::getCropMargin() const
+{
+    // All captures of a surface come from the same camera mode
+    QSize captureSize = sequence.isEmpty() ? QSize() : CaptureStore::readSize(tilePath(0));
+    return captureSize.isValid() ? TileReader::cropMargin(captureSize) : QSize();
+}
+
+QPoint ImageStitcher::getImagePosition(int sequencePosition, int canvasWidth, int canvasHeight) const
 {
     // Calculate grid cell size
     int cellWidth = canvasWidth / imagesInX;
@@ -109,47 +351,91 @@ QPoint ImageStitcher::getImagePosition(int sequencePosition, int canvasWidth, in
     return QPoint(x, y);
 }
 
-void ImageStitcher::labelDefects()
+QRect ImageStitcher::getCellRect(int sequencePosition, int canvasWidth, int canvasHeight) const
+{
+    // Each tile owns exactly one cell, so tiles never overlap and the result does
+    // not depend on drawing order. The last row and column absorb the remainder
+    // left by the integer division of the canvas.
+    int cellWidth = canvasWidth / imagesInX;
+    int cellHeight = canvasHeight / imagesInY;
+    int row = sequencePosition / imagesInX;
+    int col = sequencePosition % imagesInX;
+
+    int left = col * cellWidth;
+    int top = row * cellHeight;
+    int right = (col == imagesInX - 1) ? canvasWidth : left + cellWidth;
+    int bottom = (row == imagesInY - 1) ? canvasHeight : top + cellHeight;
+
+    return QRect(QPoint(left, top), QPoint(right - 1, bottom - 1));
+}
+
+void ImageStitcher::blitTile(uchar *targetBits, qsizetype targetBytesPerLine, const QRect &targetArea,
+                             const QImage &tile, const QPoint &tilePos, const QRect &clip)
 {
+    // Straight row copies in place of QPainter; both buffers must be RGB888.
+    // targetArea is the canvas rectangle covered by targetBits, which lets the
+    // same code fill a full canvas or a single streaming band.
+    QRect area = clip.intersected(QRect(tilePos, tile.size())).intersected(targetArea);
+    if (area.isEmpty()) return;
 
-    const int cropWidth = 1100;
-    const int cropHeight = 778;
+    const int bytesPerPixel = 3;
+    const qsizetype rowBytes = qsizetype(area.width()) * bytesPerPixel;
+    const int srcX = area.left() - tilePos.x();
+    const int dstX = area.left() - targetArea.left();
 
-    // Load the stitched image
+    for (int y = area.top(); y <= area.bottom(); ++y) {
+        const uchar *src = tile.constScanLine(y - tilePos.y()) + srcX * bytesPerPixel;
+        uchar *dst = targetBits + (y - targetArea.top()) * targetBytesPerLine + dstX * bytesPerPixel;
+        memcpy(dst, src, rowBytes);
+    }
+}
+
+void ImageStitcher::labelDefects()
+{
+    const QSize cropSize = TileReader::defaultCropSize();
+
+    // Only the stitched size is needed; defects are drawn as an overlay at display time
     QString stitchedPath = QString("%1/stitched.jpg").arg(surfacePath);
-    QImage stitchedImage(stitchedPath);
-    if (stitchedImage.isNull()) {
-        qDebug() << "Failed to load stitched image for labeling";
+    QSize stitchedSize = QImageReader(stitchedPath).size();
+    if (!stitchedSize.isValid()) {
+        qDebug() << "Failed to read stitched image size for labeling";
         return;
     }
 
-    // Create labeled copy of stitched image
-    QImage labeledImage = stitchedImage.copy();
-    QPainter labeledPainter(&labeledImage);
-
     // Clear any existing defect coordinates
     defectCoordinates = QJsonArray();
 
     // Create sequence to position map
     QMap<int, QPair<int, int>> seqToPos = createSequencePositionMap();
 
+    // Registered offsets move the defects together with their tiles
+    QVector<QPoint> corrections = tileCorrections.isEmpty()
+        ? TileRegistration::loadCorrections(surfacePath, sequence.size())
+        : tileCorrections;
+
     // Process each image in sequence
     for (int i = 0; i < sequence.size(); ++i) {
         int imageNumber = sequence[i];
-        QString imagePath = QString("%1/image_%2.jpg").arg(surfacePath).arg(imageNumber, 2, 10, QChar('0'));
-        QString detectionPath = imagePath;
-        detectionPath.replace(".jpg", "_detections.json");
+        QString imagePath = CaptureStore::findCapture(surfacePath, imageNumber);
+        QString detectionPath = CaptureStore::sidecarPath(imagePath, "_detections.json");
 
         // Get grid position for this sequence number
         auto pos = seqToPos[i + 1]; // sequence is 1-based
-        int gridX = pos.first * cropWidth;
-        int gridY = pos.second * cropHeight;
+        int gridX = pos.first * cropSize.width() + corrections.value(i).x();
+        int gridY = pos.second * cropSize.height() + corrections.value(i).y();
 
         // Load and process detections
         QFile file(detectionPath);
         if (file.open(QIODevice::ReadOnly)) {
-            QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
-            QJsonArray detections = doc.object()["detections"].toArray();
+            QJsonObject results = QJsonDocument::fromJson(file.readAll()).object();
+            QJsonArray detections = results["detections"].toArray();
+
+            // Crop-only detection already reports tile coordinates; full-frame
+            // results are shifted by where the stitched crop sits in the capture
+            QPointF cropOrigin;
+            if (!results.contains("crop")) {
+                cropOrigin = TileReader::centerCropRect(CaptureStore::readSize(imagePath), cropSize).topLeft();
+            }
 
             for (const QJsonValue &val : detections) {
                 QJsonObject detection = val.toObject();
@@ -163,20 +449,8 @@ void ImageStitcher::labelDefects()
                 float orig_h = detection["height"].toDouble();
 
                 // Transform coordinates to canvas position
-                float canvas_x = gridX + (orig_x - (1920 - cropWidth) / 2);
-                float canvas_y = gridY + (orig_y - (1080 - cropHeight) / 2);
-
-                // Set color based on defect type
-                QColor color;
-                if (defectType == "damage") color = QColor(255, 0, 0, 128);
-                else if (defectType == "mark") color = QColor(0, 255, 0, 128);
-                else if (defectType == "oil") color = QColor(0, 0, 255, 128);
-                else if (defectType == "edge") color = QColor(255, 165, 0, 128);
-                else color = QColor(128, 128, 128, 128);
-
-                // Draw defect rectangle
-                labeledPainter.setPen(QPen(color, 2));
-                labeledPainter.setBrush(color);
+                float canvas_x = gridX + (orig_x - cropOrigin.x());
+                float canvas_y = gridY + (orig_y - cropOrigin.y());
 
                 QRectF defectRect(
                     canvas_x - orig_w/2,
@@ -184,35 +458,24 @@ void ImageStitcher::labelDefects()
                     orig_w,
                     orig_h
                 );
-                labeledPainter.drawRect(defectRect);
-
-                // Draw label
-                labeledPainter.setPen(Qt::white);
-                labeledPainter.setFont(QFont("Arial", 10));
-                QString label = QString("%1\n%2%")
-                    .arg(defectType)
-                    .arg(qRound(confidence * 100));
-                labeledPainter.drawText(defectRect, Qt::AlignCenter, label);
 
                 // Save defect coordinates
                 QString imageName = QFileInfo(imagePath).fileName();
                 saveDefectCoordinates(imageName, imageNumber, defectType, confidence, 
-                                   defectRect, stitchedImage);
+                                   defectRect, stitchedSize);
             }
             file.close();
         }
     }
 
-    labeledPainter.end();
-
     // Save all defect coordinates to JSON file
     saveAllDefectCoordinates();
+}
 
-    // Save labeled stitched image
-    QString labeledPath = QString("%1/stitched_labeled.jpg").arg(surfacePath);
-    if (!labeledImage.save(labeledPath)) {
-        qDebug() << "Failed to save labeled stitched image";
-    }
+bool ImageStitcher::exportLabeledImage(const QString &outputPath) const
+{
+    QString path = outputPath.isEmpty() ? QString("%1/stitched_labeled.jpg").arg(surfacePath) : outputPath;
+    return DefectOverlay::exportLabeledImage(surfacePath, path);
 }
 
 QMap<int, QPair<int, int>> ImageStitcher::createSequencePositionMap()
@@ -228,13 +491,13 @@ QMap<int, QPair<int, int>> ImageStitcher::createSequencePositionMap()
 
 void ImageStitcher::saveDefectCoordinates(const QString &imageName, int seqNum,
                                         const QString &defectType, float confidence,
-                                        const QRectF &canvasRect, const QImage &stitchedImage)
+                                        const QRectF &canvasRect, const QSize &stitchedSize)
 {
     // Calculate physical dimensions
-    float physicalX = canvasRect.center().x() * actualWidth / stitchedImage.width();
-    float physicalY = canvasRect.center().y() * actualHeight / stitchedImage.height();
-    float physicalW = canvasRect.width() * actualWidth / stitchedImage.width();
-    float physicalH = canvasRect.height() * actualHeight / stitchedImage.height();
+    float physicalX = canvasRect.center().x() * actualWidth / stitchedSize.width();
+    float physicalY = canvasRect.center().y() * actualHeight / stitchedSize.height();
+    float physicalW = canvasRect.width() * actualWidth / stitchedSize.width();
+    float physicalH = canvasRect.height() * actualHeight / stitchedSize.height();
 
     // Create JSON object for this defect
     QJsonObject defect;
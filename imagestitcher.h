@@ -9,19 +9,75 @@
 #include <QPair>
 #include <QJsonArray>
 #include <QJsonObject>
+#include <QFutureWatcher>
+#include <QThreadPool>
 
 class ImageStitcher : public QObject
 {
     Q_OBJECT
 
 public:
+    // Canvas composes the whole surface in memory before encoding; Streaming
+    // composes and encodes one horizontal band at a time.
+    enum class StitchMode {
+        Canvas,
+        Streaming
+    };
+
+    // Wall-clock time spent in each stage of the last stitch, in milliseconds.
+    // Tiles are decoded concurrently, so decode is the time until the slowest
+    // tile of each batch is ready.
+    struct StitchTimings {
+        qint64 registerMs = 0;
+        qint64 decodeMs = 0;
+        qint64 composeMs = 0;
+        qint64 encodeMs = 0;
+        qint64 totalMs = 0;
+        int tileCount = 0;
+        int threadCount = 0;
+    };
+
     ImageStitcher(const QString &surfacePath,
                  int imagesInX, int imagesInY,
                  const QVector<int> &sequence,
                  double actualWidth, double actualHeight);
+    ~ImageStitcher();
     
+    void setStitchMode(StitchMode mode) { stitchMode = mode; }
+    void setBandHeight(int rows) { bandHeight = qMax(8, rows); }
+    void setMaxDecodeThreads(int threads);
+    void setRegistrationEnabled(bool enabled) { registrationEnabled = enabled; }
+    bool isRegistrationEnabled() const { return registrationEnabled; }
+    void setPyramidEnabled(bool enabled) { pyramidEnabled = enabled; }  // Viewer tiles next to the JPEG
+    bool isPyramidEnabled() const { return pyramidEnabled; }
+
     bool stitchImages();
-    void labelDefects();
+    void stitchImagesAsync();  // Returns immediately; finished() is emitted on this object's thread
+    bool isStitching() const { return stitchWatcher.isRunning(); }
+    bool stitchSucceeded() const { return lastStitchSucceeded; }
+    StitchTimings timings() const { return lastTimings; }
+    QString timingsSummary() const;
+    void labelDefects();  // Writes defect_coordinates.json; the overlay is drawn at display time
+    bool exportLabeledImage(const QString &outputPath = QString()) const;  // Full resolution, on request only
+
+    // Surface layout, shared with IncrementalStitcher. All of these are safe to
+    // call from worker threads.
+    QSize getCanvasSize() const;
+    QImage loadTile(int position) const;  // Cropped RGB888 tile, null if missing
+    QString tilePath(int position) const;
+    QSize getCellSize() const;
+    // How far the stitch crop can move inside the captures, from the first
+    // capture's size; invalid if it cannot be read. See TileRegistration::setCropMargin().
+    QSize getCropMargin() const;
+    // Per-position offsets from TileRegistration; tiles are cropped and defects
+    // placed accordingly. Set these before stitching, not while it runs.
+    void setTileCorrections(const QVector<QPoint> &corrections) { tileCorrections = corrections; }
+    QPoint tileCorrection(int position) const { return tileCorrections.value(position); }
+    int positionForImage(const QString &imagePath) const;  // -1 if not in the sequence
+    QPoint getImagePosition(int sequenceIndex, int canvasWidth, int canvasHeight) const;
+    QRect getCellRect(int sequenceIndex, int canvasWidth, int canvasHeight) const;
+    static void blitTile(uchar *targetBits, qsizetype targetBytesPerLine, const QRect &targetArea,
+                         const QImage &tile, const QPoint &tilePos, const QRect &clip);
 
 signals:
     void finished();
@@ -34,13 +90,24 @@ private:
     double actualWidth;
     double actualHeight;
     QJsonArray defectCoordinates;  // Store all defect coordinates
+    StitchMode stitchMode;
+    int bandHeight;  // Output rows composed per band in streaming mode
+    QThreadPool decodePool;  // Bounded pool for tile decode and crop
+    QFutureWatcher<bool> stitchWatcher;
+    bool lastStitchSucceeded;
+    bool registrationEnabled;
+    bool pyramidEnabled;
+    QVector<QPoint> tileCorrections;  // Empty until registered or loaded
+    StitchTimings lastTimings;
     
-    QImage cropCenterRegion(const QImage &source);
-    QPoint getImagePosition(int sequenceIndex, int canvasWidth, int canvasHeight);
+    bool runStitch();
+    void registerTiles(StitchTimings &stageTimes);
+    bool stitchToCanvas(const QSize &canvasSize, StitchTimings &stageTimes);
+    bool stitchStreaming(const QSize &canvasSize, StitchTimings &stageTimes);
     QMap<int, QPair<int, int>> createSequencePositionMap();
     void saveDefectCoordinates(const QString &imageName, int seqNum, 
                              const QString &defectType, float confidence,
-                             const QRectF &canvasRect, const QImage &stitchedImage);
+                             const QRectF &canvasRect, const QSize &stitchedSize);
     void saveAllDefectCoordinates();  // New method to save all coordinates at once
 };
 
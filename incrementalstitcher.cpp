@@ -0,0 +1,243 @@
+#include "incrementalstitcher.h"
+#include "tilereader.h"
+#include "tilepyramid.h"
+#include <QPainter>
+#include <QThread>
+#include <QDebug>
+#include <QtConcurrent>
+
+IncrementalStitcher::IncrementalStitcher(const QString &surfacePath,
+                                         int imagesInX, int imagesInY,
+                                         const QVector<int> &sequence,
+                                         double actualWidth, double actualHeight,
+                                         QObject *parent)
+    : QObject(parent)
+    , surfacePath(surfacePath)
+    , sequence(sequence)
+    , layout(surfacePath, imagesInX, imagesInY, sequence, actualWidth, actualHeight)
+    , placed(sequence.size(), false)
+    , placedCount(0)
+    , pendingDecodes(0)
+    , finalizeRequested(false)
+    , registrationDone(false)
+    , registration(imagesInX, imagesInY, layout.getCellSize())
+{
+    // The canvas lives for the whole capture so finalize() only has to encode it
+    canvasSize = layout.getCanvasSize();
+    canvas = QImage(canvasSize, QImage::Format_RGB888);
+    canvas.fill(Qt::black);
+
+    setPreviewSize(QSize(1100, 1100));
+
+    // Captures arrive one at a time; two decoders keep up without starving the camera
+    decodePool.setMaxThreadCount(qBound(1, QThread::idealThreadCount() / 2, 2));
+
+    connect(&registrationWatcher, &QFutureWatcher<void>::finished, this, &IncrementalStitcher::applyRegistration);
+    connect(&saveWatcher, &QFutureWatcher<bool>::finished, this, [this]() {
+        bool success = saveWatcher.result();
+        qDebug() << "Incremental stitch finalized for" << surfacePath
+                 << "in" << finalizeTimer.elapsed() << "ms, success:" << success;
+        emit finished(success);
+    });
+}
+
+IncrementalStitcher::~IncrementalStitcher()
+{
+    // Registration and decode workers read this object's layout
+    registrationWatcher.waitForFinished();
+    decodePool.waitForDone();
+    saveWatcher.waitForFinished();
+}
+
+void IncrementalStitcher::setPreviewSize(const QSize &size)
+{
+    previewSize = canvasSize.scaled(size, Qt::KeepAspectRatio).expandedTo(QSize(1, 1));
+    previewImage = QImage(previewSize, QImage::Format_RGB888);
+    previewImage.fill(Qt::black);
+}
+
+void IncrementalStitcher::addTile(const QString &imagePath)
+{
+    if (finalizeRequested) {
+        qDebug() << "Ignoring tile captured after finalize:" << imagePath;
+        return;
+    }
+
+    int position = layout.positionForImage(imagePath);
+    if (position < 0) {
+        qDebug() << "Captured image is not part of the sequence:" << imagePath;
+        return;
+    }
+
+    // A recapture simply replaces the tile already placed at this position
+    queueDecode(position);
+}
+
+void IncrementalStitcher::finalize()
+{
+    if (finalizeRequested) return;
+    finalizeRequested = true;
+    finalizeTimer.start();
+
+    // Pick up anything captured before this stitcher existed; missing files are skipped
+    for (int position = 0; position < sequence.size(); ++position) {
+        if (!placed[position]) {
+            queueDecode(position);
+        }
+    }
+
+    continueFinalize();
+}
+
+void IncrementalStitcher::continueFinalize()
+{
+    // Runs whenever the decode queue drains after finalize()
+    if (!finalizeRequested || pendingDecodes > 0) return;
+
+    if (layout.isRegistrationEnabled() && !registrationDone) {
+        startRegistration();
+    } else {
+        startSave();
+    }
+}
+
+void IncrementalStitcher::startRegistration()
+{
+    if (registrationWatcher.isRunning()) return;
+
+    // No decodes are pending, so the registration owns its tiles until it is done
+    registrationWatcher.setFuture(QtConcurrent::run([this]() {
+        registration.setCropMargin(layout.getCropMargin());
+        registration.run(&decodePool);
+        registration.save(surfacePath, sequence);
+    }));
+}
+
+void IncrementalStitcher::applyRegistration()
+{
+    registrationDone = true;
+    QVector<QPoint> corrections = registration.corrections();
+    layout.setTileCorrections(corrections);
+
+    // Tiles placed on their nominal spot are already right; re-crop the rest
+    int moved = 0;
+    for (int position = 0; position < corrections.size() && position < placed.size(); ++position) {
+        if (placed[position] && !corrections[position].isNull()) {
+            queueDecode(position);
+            ++moved;
+        }
+    }
+    qDebug() << "Registration moved" << moved << "of" << placedCount << "tiles in" << surfacePath;
+
+    continueFinalize();
+}
+
+void IncrementalStitcher::queueDecode(int position)
+{
+    ++pendingDecodes;
+
+    auto *watcher = new QFutureWatcher<DecodedTile>(this);
+    connect(watcher, &QFutureWatcher<DecodedTile>::finished, this, [this, watcher]() {
+        DecodedTile decoded = watcher->result();
+        watcher->deleteLater();
+        --pendingDecodes;
+
+        placeTile(decoded);
+        continueFinalize();
+    });
+
+    watcher->setFuture(QtConcurrent::run(&decodePool, [this, position]() {
+        return decodeTile(position);
+    }));
+}
+
+IncrementalStitcher::DecodedTile IncrementalStitcher::decodeTile(int position) const
+{
+    DecodedTile decoded;
+    decoded.position = position;
+    decoded.tile = layout.loadTile(position);
+    if (decoded.tile.isNull()) return decoded;
+
+    if (layout.isRegistrationEnabled() && !registrationDone) {
+        decoded.registrationTile = TileReader::readDownsampled(layout.tilePath(position),
+                                                               registration.downsample());
+    }
+
+    // Scale the visible part of the tile here so the owner thread only paints it
+    QPoint imagePos = layout.getImagePosition(position, canvasSize.width(), canvasSize.height());
+    QRect cell = layout.getCellRect(position, canvasSize.width(), canvasSize.height());
+    QRect visible = cell.intersected(QRect(imagePos, decoded.tile.size()));
+    QRect target = previewRect(visible);
+    if (!visible.isEmpty() && !target.isEmpty()) {
+        decoded.previewPatch = decoded.tile.copy(visible.translated(-imagePos))
+            .scaled(target.size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+
+    return decoded;
+}
+
+void IncrementalStitcher::placeTile(const DecodedTile &decoded)
+{
+    if (decoded.tile.isNull()) {
+        qDebug() << "No tile available for position" << decoded.position << "in" << surfacePath;
+        return;
+    }
+
+    const int canvasWidth = canvasSize.width();
+    const int canvasHeight = canvasSize.height();
+    QPoint imagePos = layout.getImagePosition(decoded.position, canvasWidth, canvasHeight);
+    QRect cell = layout.getCellRect(decoded.position, canvasWidth, canvasHeight);
+
+    ImageStitcher::blitTile(canvas.bits(), canvas.bytesPerLine(), canvas.rect(),
+                            decoded.tile, imagePos, cell);
+
+    if (!decoded.registrationTile.isNull()) {
+        registration.setTile(decoded.position, decoded.registrationTile);
+    }
+
+    if (!placed[decoded.position]) {
+        placed[decoded.position] = true;
+        ++placedCount;
+    }
+
+    if (!decoded.previewPatch.isNull()) {
+        QRect visible = cell.intersected(QRect(imagePos, decoded.tile.size()));
+        QPainter painter(&previewImage);
+        painter.drawImage(previewRect(visible).topLeft(), decoded.previewPatch);
+        painter.end();
+        emit previewUpdated(previewImage);
+    }
+
+    emit tilePlaced(decoded.position);
+}
+
+QRect IncrementalStitcher::previewRect(const QRect &canvasRect) const
+{
+    // Map a canvas rectangle onto the preview, rounding edges so neighbouring
+    // cells share their border instead of leaving gaps
+    const double scaleX = double(previewSize.width()) / canvasSize.width();
+    const double scaleY = double(previewSize.height()) / canvasSize.height();
+
+    int left = qRound(canvasRect.left() * scaleX);
+    int top = qRound(canvasRect.top() * scaleY);
+    int right = qRound((canvasRect.right() + 1) * scaleX);
+    int bottom = qRound((canvasRect.bottom() + 1) * scaleY);
+
+    return QRect(left, top, right - left, bottom - top);
+}
+
+void IncrementalStitcher::startSave()
+{
+    if (saveWatcher.isRunning()) return;
+
+    qDebug() << "Finalizing incremental stitch with" << placedCount << "of" << sequence.size() << "tiles";
+
+    // The canvas is no longer modified once finalizing, so the worker shares it
+    const QImage stitched = canvas;
+    const QString path = surfacePath;
+    const bool writePyramid = layout.isPyramidEnabled();
+    saveWatcher.setFuture(QtConcurrent::run([stitched, path, writePyramid]() {
+        if (!stitched.save(QString("%1/stitched.jpg").arg(path), "JPG", 100)) return false;
+        return !writePyramid || TilePyramidWriter::writeImage(path, "stitched", stitched);
+    }));
+}
@@ -0,0 +1,86 @@
+#ifndef INCREMENTALSTITCHER_H
+#define INCREMENTALSTITCHER_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QImage>
+#include <QSize>
+#include <QRect>
+#include <QFutureWatcher>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include "imagestitcher.h"
+#include "tileregistration.h"
+
+// Builds stitched.jpg while the surface is being captured. Every captured tile
+// is decoded and cropped on a worker thread, then placed into a persistent
+// canvas on the owner thread. finalize() registers the tiles, re-places only
+// those that turned out to be off their nominal spot and encodes the result.
+class IncrementalStitcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    IncrementalStitcher(const QString &surfacePath,
+                        int imagesInX, int imagesInY,
+                        const QVector<int> &sequence,
+                        double actualWidth, double actualHeight,
+                        QObject *parent = nullptr);
+    ~IncrementalStitcher();
+
+    void setPreviewSize(const QSize &size);  // Call before the first tile
+    QImage preview() const { return previewImage; }
+    int tilesPlaced() const { return placedCount; }
+    int tileCount() const { return sequence.size(); }
+    bool isFinalizing() const { return finalizeRequested; }
+
+    // Geometry and defect labelling for the same surface
+    ImageStitcher *surfaceStitcher() { return &layout; }
+
+public slots:
+    void addTile(const QString &imagePath);
+    void finalize();  // Places any missing tiles from disk, registers, then writes stitched.jpg
+
+signals:
+    void tilePlaced(int position);
+    void previewUpdated(const QImage &preview);
+    void finished(bool success);
+
+private:
+    struct DecodedTile {
+        int position = -1;
+        QImage tile;          // Cropped RGB888 tile
+        QImage previewPatch;  // Tile already clipped and scaled to its preview cell
+        QImage registrationTile;  // Downsampled grey capture, only before registration
+    };
+
+    void queueDecode(int position);
+    DecodedTile decodeTile(int position) const;
+    QRect previewRect(const QRect &canvasRect) const;
+    void placeTile(const DecodedTile &decoded);
+    void continueFinalize();
+    void startRegistration();
+    void applyRegistration();
+    void startSave();
+
+    QString surfacePath;
+    QVector<int> sequence;
+    ImageStitcher layout;
+    QSize canvasSize;
+    QImage canvas;
+    QSize previewSize;  // Read by decode workers; fixed once tiles arrive
+    QImage previewImage;
+    QVector<bool> placed;
+    int placedCount;
+    int pendingDecodes;
+    bool finalizeRequested;
+    bool registrationDone;
+    TileRegistration registration;
+    QFutureWatcher<void> registrationWatcher;
+    QThreadPool decodePool;  // Kept small so capture and UI threads stay responsive
+    QFutureWatcher<bool> saveWatcher;
+    QElapsedTimer finalizeTimer;
+};
+
+#endif // INCREMENTALSTITCHER_H
@@ -0,0 +1,178 @@
+#include "jpegstripwriter.h"
+#include <QFile>
+#include <QDebug>
+#include <cstdio>
+#include <csetjmp>
+
+extern "C" {
+#include <jpeglib.h>
+}
+
+namespace {
+
+struct JpegErrorManager {
+    jpeg_error_mgr pub;
+    jmp_buf jumpBuffer;
+    char message[JMSG_LENGTH_MAX];
+};
+
+// libjpeg's default handler calls exit(); jump back to the caller instead
+void jpegErrorExit(j_common_ptr cinfo)
+{
+    JpegErrorManager *err = reinterpret_cast<JpegErrorManager *>(cinfo->err);
+    (*cinfo->err->format_message)(cinfo, err->message);
+    longjmp(err->jumpBuffer, 1);
+}
+
+} // namespace
+
+struct JpegStripWriter::Encoder {
+    jpeg_compress_struct cinfo;
+    JpegErrorManager errorManager;
+    FILE *file = nullptr;
+    bool started = false;
+};
+
+JpegStripWriter::JpegStripWriter()
+    : imageWidth(0)
+    , imageHeight(0)
+    , writtenRows(0)
+{
+}
+
+JpegStripWriter::~JpegStripWriter()
+{
+    if (encoder) {
+        abort("Writer destroyed before finish()");
+    }
+}
+
+bool JpegStripWriter::open(const QString &path, int width, int height, int quality)
+{
+    if (encoder) {
+        abort("Writer reopened before finish()");
+    }
+    if (width <= 0 || height <= 0) {
+        lastError = QString("Invalid image size %1x%2").arg(width).arg(height);
+        return false;
+    }
+
+    FILE *file = std::fopen(QFile::encodeName(path).constData(), "wb");
+    if (!file) {
+        lastError = QString("Could not open %1 for writing").arg(path);
+        return false;
+    }
+
+    encoder.reset(new Encoder);
+    encoder->file = file;
+    outputPath = path;
+    imageWidth = width;
+    imageHeight = height;
+    writtenRows = 0;
+    lastError.clear();
+
+    jpeg_compress_struct &cinfo = encoder->cinfo;
+    cinfo.err = jpeg_std_error(&encoder->errorManager.pub);
+    encoder->errorManager.pub.error_exit = jpegErrorExit;
+
+    if (setjmp(encoder->errorManager.jumpBuffer)) {
+        abort(QString::fromLatin1(encoder->errorManager.message));
+        return false;
+    }
+
+    jpeg_create_compress(&cinfo);
+    encoder->started = true;
+    jpeg_stdio_dest(&cinfo, file);
+
+    cinfo.image_width = static_cast<JDIMENSION>(width);
+    cinfo.image_height = static_cast<JDIMENSION>(height);
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+
+    return true;
+}
+
+bool JpegStripWriter::writeRows(const uchar *rows, int rowCount, qsizetype bytesPerLine)
+{
+    if (!encoder) {
+        lastError = "Writer is not open";
+        return false;
+    }
+    if (rowCount <= 0) {
+        return true;
+    }
+    if (writtenRows + rowCount > imageHeight) {
+        abort(QString("Too many rows: %1 of %2").arg(writtenRows + rowCount).arg(imageHeight));
+        return false;
+    }
+
+    jpeg_compress_struct &cinfo = encoder->cinfo;
+    if (setjmp(encoder->errorManager.jumpBuffer)) {
+        abort(QString::fromLatin1(encoder->errorManager.message));
+        return false;
+    }
+
+    // libjpeg wants an array of row pointers; feed the strip in small batches
+    const int batchSize = 16;
+    JSAMPROW rowPointers[batchSize];
+    int row = 0;
+    while (row < rowCount) {
+        int batch = qMin(batchSize, rowCount - row);
+        for (int i = 0; i < batch; ++i) {
+            rowPointers[i] = const_cast<JSAMPROW>(rows + (row + i) * bytesPerLine);
+        }
+        row += static_cast<int>(jpeg_write_scanlines(&cinfo, rowPointers, static_cast<JDIMENSION>(batch)));
+    }
+    writtenRows += rowCount;
+
+    return true;
+}
+
+bool JpegStripWriter::finish()
+{
+    if (!encoder) {
+        lastError = "Writer is not open";
+        return false;
+    }
+    if (writtenRows != imageHeight) {
+        abort(QString("Only %1 of %2 rows were written").arg(writtenRows).arg(imageHeight));
+        return false;
+    }
+
+    if (setjmp(encoder->errorManager.jumpBuffer)) {
+        abort(QString::fromLatin1(encoder->errorManager.message));
+        return false;
+    }
+
+    jpeg_finish_compress(&encoder->cinfo);
+    jpeg_destroy_compress(&encoder->cinfo);
+    bool closed = std::fclose(encoder->file) == 0;
+    encoder.reset();
+
+    if (!closed) {
+        lastError = "Failed to flush JPEG file";
+    }
+    return closed;
+}
+
+void JpegStripWriter::abort(const QString &error)
+{
+    lastError = error;
+    qDebug() << "JPEG strip writer error:" << error;
+
+    if (encoder) {
+        if (encoder->started) {
+            jpeg_destroy_compress(&encoder->cinfo);
+        }
+        if (encoder->file) {
+            std::fclose(encoder->file);
+        }
+        encoder.reset();
+
+        // Never leave a truncated JPEG behind
+        QFile::remove(outputPath);
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef JPEGSTRIPWRITER_H
+#define JPEGSTRIPWRITER_H
+
+#include <QString>
+#include <memory>
+
+// Encodes a JPEG one horizontal strip at a time so callers never have to hold
+// the whole image in memory. Rows are tightly packed 8-bit RGB (QImage::Format_RGB888).
+class JpegStripWriter
+{
+public:
+    JpegStripWriter();
+    ~JpegStripWriter();
+
+    bool open(const QString &path, int width, int height, int quality = 100);
+    bool writeRows(const uchar *rows, int rowCount, qsizetype bytesPerLine);
+    bool finish();
+
+    int width() const { return imageWidth; }
+    int height() const { return imageHeight; }
+    int rowsWritten() const { return writtenRows; }
+    QString errorString() const { return lastError; }
+
+private:
+    struct Encoder;  // Keeps jpeglib.h out of this header
+    std::unique_ptr<Encoder> encoder;
+
+    void abort(const QString &error);
+
+    QString outputPath;
+    int imageWidth;
+    int imageHeight;
+    int writtenRows;
+    QString lastError;
+};
+
+#endif // JPEGSTRIPWRITER_H
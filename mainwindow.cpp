@@ -3,9 +3,15 @@
 #include "capturesettingsdialog.h"
 #include "motorizedcapturewindow.h"
 #include "imagestitcher.h"
+#include "incrementalstitcher.h"
+#include "pyramidviewer.h"
+#include "defectoverlay.h"
+#include "capturestore.h"
 #include "cuttingconfigdialog.h"
 #include "cuttingwindow.h"
+#include <QApplication>
 #include <QLabel>
+#include <QFileDialog>
 #include <QMessageBox>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
@@ -27,7 +33,7 @@
 #include <functional>
 
 MainWindow::MainWindow(QWidget *parent, const QString &sessionPath)
-    : QMainWindow(parent), sessionPath(sessionPath), defectDetector(nullptr), currentStitcher(nullptr)
+    : QMainWindow(parent), sessionPath(sessionPath), defectDetector(nullptr)
 {
     loadDimensions();
     setupUI();
@@ -81,6 +87,11 @@ void MainWindow::setupTopBar()
     // Add stretch to push cut button to the right
     topBarLayout->addStretch();
 
+    // Labeled image export; the defect view itself is only an overlay
+    exportLabeledButton = new QPushButton("Export Labeled Image");
+    exportLabeledButton->setMinimumWidth(100);
+    topBarLayout->addWidget(exportLabeledButton);
+
     // Cut Surface button at top right
     cutSurfaceButton = new QPushButton("Cut Surface");
     cutSurfaceButton->setMinimumWidth(100);
@@ -91,6 +102,7 @@ void MainWindow::setupTopBar()
 
     // Connect cut button
     connect(cutSurfaceButton, &QPushButton::clicked, this, &MainWindow::onCutSurface);
+    connect(exportLabeledButton, &QPushButton::clicked, this, &MainWindow::onExportLabeledImage);
 }
 
 void MainWindow::setupMainArea()
@@ -146,24 +158,20 @@ void MainWindow::setupMainArea()
     originalLabel->setAlignment(Qt::AlignCenter);
     defectLabel->setAlignment(Qt::AlignCenter);
     
-    // Original image
-    originalImageLabel = new QLabel();
-    originalImageLabel->setMinimumSize(500, 350);
-    originalImageLabel->setStyleSheet("QLabel { background-color: black; color: white; border: 1px solid #cccccc; border-radius: 5px; }");
-    originalImageLabel->setAlignment(Qt::AlignCenter);
-    originalImageLabel->setText("Select an image to preview");
+    // Original image; stitched surfaces are shown from their tile pyramid
+    originalImageView = new PyramidViewer();
+    originalImageView->setMinimumSize(500, 350);
+    originalImageView->setText("Select an image to preview");
     
     // Defect image
-    defectImageLabel = new QLabel();
-    defectImageLabel->setMinimumSize(500, 350);
-    defectImageLabel->setStyleSheet("QLabel { background-color: black; color: white; border: 1px solid #cccccc; border-radius: 5px; }");
-    defectImageLabel->setAlignment(Qt::AlignCenter);
-    defectImageLabel->setText("No defects detected yet");
+    defectImageView = new PyramidViewer();
+    defectImageView->setMinimumSize(500, 350);
+    defectImageView->setText("No defects detected yet");
     
     centerColumnLayout->addWidget(originalLabel);
-    centerColumnLayout->addWidget(originalImageLabel);
+    centerColumnLayout->addWidget(originalImageView);
     centerColumnLayout->addWidget(defectLabel);
-    centerColumnLayout->addWidget(defectImageLabel);
+    centerColumnLayout->addWidget(defectImageView);
     
     QWidget *centerColumn = new QWidget();
     centerColumn->setLayout(centerColumnLayout);
@@ -220,6 +228,7 @@ void MainWindow::setupMainArea()
     connect(surfaceTree, &QTreeWidget::itemSelectionChanged, this, &MainWindow::onItemSelectionChanged);
     connect(surfaceTree, &QTreeWidget::itemExpanded, this, &MainWindow::onItemExpanded);
     connect(surfaceTree, &QTreeWidget::itemCollapsed, this, &MainWindow::onItemCollapsed);
+    connect(defectTable, &QTableWidget::cellDoubleClicked, this, &MainWindow::onDefectDoubleClicked);
 
    
 }
@@ -252,8 +261,14 @@ void MainWindow::initializeDefectDetector()
             this, &MainWindow::onModelInitComplete);
     connect(defectDetector, &DefectDetector::modelInitializationFailed,
             this, &MainWindow::onModelInitFailed);
-    connect(defectDetector, &DefectDetector::detectionComplete,
-            this, &MainWindow::onDetectionComplete);
+    connect(defectDetector, &DefectDetector::detectionStarted,
+            this, &MainWindow::onDetectionStarted);
+    connect(defectDetector, &DefectDetector::detectionFinished,
+            this, &MainWindow::onDetectionFinished);
+    connect(defectDetector, &DefectDetector::detectionError,
+            this, &MainWindow::onDetectionError);
+    connect(defectDetector, &DefectDetector::workerRestarted,
+            this, &MainWindow::onDetectorRestarted);
     
     // Start initialization
     defectDetector->initializeDetectionProcess();
@@ -261,163 +276,29 @@ void MainWindow::initializeDefectDetector()
 
 void MainWindow::onModelStatusMessage(const QString &message)
 {
+    // Results arrive as structured signals; status text is only logged
     debugOutput->append(message);
     qDebug() << "Received message:" << message;
-    
-    // Split message into lines to handle multiple messages
-    QStringList lines = message.split("\n");
-    for (const QString &line : lines) {
-        // Check if this is a processing status message
-        if (line.contains("[STATUS] Processing image:")) {
-            QString imagePath = line.mid(line.indexOf(":") + 2).trimmed();
-            qDebug() << "Processing status - Found image path:" << imagePath;
-            updateImageStatus(imagePath, "Processing", -1);
-        }
-        // Check if this is a detection complete message
-        else if (line.contains("[SUCCESS] Detection results saved")) {
-            qDebug() << "Detection success message received:" << line;
-            
-            // Extract image name from "Detection results saved for image_XX.jpg"
-            QString imageName;
-            if (line.contains("for ")) {
-                imageName = line.mid(line.indexOf("for ") + 4);
-                imageName.remove(".jpg");
-                qDebug() << "Extracted image name:" << imageName;
-                
-                // Get the current surface directory
-                QString surfacePath;
-                for (int i = 0; i < surfaceTree->topLevelItemCount(); ++i) {
-                    QTreeWidgetItem* surfaceItem = surfaceTree->topLevelItem(i);
-                    qDebug() << "Checking surface:" << surfaceItem->text(0) << "with status:" << surfaceItem->text(1);
-                    if (surfaceItem->text(1) == "Processing" || surfaceItem->text(1) == "Pending") {
-                        surfacePath = QString("%1/%2").arg(sessionPath).arg(surfaceItem->text(0));
-                        qDebug() << "Found active surface path:" << surfacePath;
-                        break;
-                    }
-                }
-                
-                if (!surfacePath.isEmpty()) {
-                    QString imagePath = QString("%1/%2.jpg").arg(surfacePath).arg(imageName);
-                    QString detectionFile = QString("%1/%2_detections.json").arg(surfacePath).arg(imageName);
-                    qDebug() << "Looking for detection file:" << detectionFile;
-                    
-                    // Read detection file to get defect count
-                    if (QFile::exists(detectionFile)) {
-                        qDebug() << "Detection file exists";
-                        QFile file(detectionFile);
-                        if (file.open(QIODevice::ReadOnly)) {
-                            QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
-                            QJsonObject obj = doc.object();
-                            int defectCount = obj["detections"].toArray().size();
-                            file.close();
-                            
-                            qDebug() << "Detection complete - Path:" << imagePath;
-                            qDebug() << "Found defects:" << defectCount;
-                            updateImageStatus(imagePath, "Analyzed", defectCount);
-
-                            // Check if this is the currently selected image
-                            QTreeWidgetItem* currentItem = surfaceTree->currentItem();
-                            if (currentItem && !isSurfaceItem(currentItem)) {
-                                QString currentImagePath = QString("%1/%2").arg(surfacePath).arg(currentItem->text(0));
-                                if (currentImagePath == imagePath) {
-                                    // Update the defect image preview
-                                    QString detectedImagePath = imagePath;
-                                    detectedImagePath.replace(".jpg", "_detected.jpg");
-                                    QPixmap detectedPixmap(detectedImagePath);
-                                    if (!detectedPixmap.isNull()) {
-                                        QSize labelSize = defectImageLabel->size();
-                                        QPixmap scaledPixmap = detectedPixmap.scaled(labelSize, 
-                                            Qt::KeepAspectRatio, 
-                                            Qt::FastTransformation);
-                                        defectImageLabel->setPixmap(scaledPixmap);
-                                    }
-
-                                    // Update defect details table
-                                    if (file.open(QIODevice::ReadOnly)) {
-                                        QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
-                                        QJsonObject obj = doc.object();
-                                        QJsonArray detections = obj["detections"].toArray();
-
-                                        defectTable->setRowCount(detections.size());
-                                        for (int i = 0; i < detections.size(); ++i) {
-                                            QJsonObject detection = detections[i].toObject();
-                                            
-                                            // Number
-                                            QTableWidgetItem *numberItem = new QTableWidgetItem(QString::number(i + 1));
-                                            numberItem->setTextAlignment(Qt::AlignCenter);
-                                            defectTable->setItem(i, 0, numberItem);
-
-                                            // Type
-                                            QTableWidgetItem *typeItem = new QTableWidgetItem(detection["class_name"].toString());
-                                            typeItem->setTextAlignment(Qt::AlignCenter);
-                                            defectTable->setItem(i, 1, typeItem);
-
-                                            // Confidence
-                                            double confidence = detection["confidence"].toDouble();
-                                            // If confidence is > 1, assume it's already in percentage
-                                            if (confidence > 1) {
-                                                confidence = confidence / 100.0;
-                                            }
-                                            QTableWidgetItem *confItem = new QTableWidgetItem(
-                                                QString("%1%").arg(confidence * 100, 0, 'f', 1));
-                                            confItem->setTextAlignment(Qt::AlignCenter);
-                                            defectTable->setItem(i, 2, confItem);
-
-                                            // Location
-                                            QString location = QString("(%1, %2) mm")
-                                                .arg(detection["center_x"].toInt())
-                                                .arg(detection["center_y"].toInt());
-                                            QTableWidgetItem *locItem = new QTableWidgetItem(location);
-                                            locItem->setTextAlignment(Qt::AlignCenter);
-                                            defectTable->setItem(i, 3, locItem);
-
-                                            // Size
-                                            QString size = QString("%1 × %2 mm")
-                                                .arg(detection["width"].toInt())
-                                                .arg(detection["height"].toInt());
-                                            QTableWidgetItem *sizeItem = new QTableWidgetItem(size);
-                                            sizeItem->setTextAlignment(Qt::AlignCenter);
-                                            defectTable->setItem(i, 4, sizeItem);
-                                        }
-                                        file.close();
-                                    }
-                                }
-                            }
-                        } else {
-                            qDebug() << "Failed to open detection file";
-                        }
-                    } else {
-                        qDebug() << "Detection file does not exist";
-                    }
-                } else {
-                    qDebug() << "No active surface found";
-                }
-            } else {
-                qDebug() << "Failed to extract image name from message";
-            }
-        }
-    }
 }
 
 void MainWindow::onModelInitComplete()
 {
     debugOutput->append("<font color='green'><b>Model initialization completed successfully!</b></font>");
     
-    // Process any pending images
+    // Process any pending images, one batch per surface
     for (int i = 0; i < surfaceTree->topLevelItemCount(); ++i) {
         QTreeWidgetItem* surfaceItem = surfaceTree->topLevelItem(i);
+        QString surfacePath = QString("%1/%2").arg(sessionPath).arg(surfaceItem->text(0));
+        QStringList pendingImages;
         for (int j = 0; j < surfaceItem->childCount(); ++j) {
             QTreeWidgetItem* imageItem = surfaceItem->child(j);
             if (imageItem->text(1) == "Pending") {
-                QString surfacePath = QString("%1/%2").arg(sessionPath).arg(surfaceItem->text(0));
-                QString imagePath = QString("%1/%2").arg(surfacePath).arg(imageItem->text(0));
-                
-                // Queue the image for detection with a small delay
-                QTimer::singleShot(100 * (j + 1), this, [this, imagePath]() {
-                    defectDetector->detectImage(imagePath);
-                });
+                pendingImages.append(QString("%1/%2").arg(surfacePath).arg(imageItem->text(0)));
             }
         }
+        if (!pendingImages.isEmpty()) {
+            defectDetector->detectBatch(pendingImages);
+        }
     }
 }
 
@@ -426,28 +307,95 @@ void MainWindow::onModelInitFailed(const QString &error)
     debugOutput->append("<font color='red'><b>Model initialization failed: " + error + "</b></font>");
 }
 
-void MainWindow::onDetectionComplete(const QStringList &results)
+void MainWindow::onDetectionStarted(quint64 requestId, const QString &imagePath)
 {
-    // Update preview if the current selected item is the processed image
-    QString imagePath;
-    for (const QString &line : results) {
-        if (line.contains("[STATUS] Processing image:")) {
-            imagePath = line.mid(line.indexOf(":") + 2).trimmed();
-            break;
-        }
+    Q_UNUSED(requestId);
+    updateImageStatus(imagePath, "Processing", -1);
+}
+
+void MainWindow::onDetectionFinished(quint64 requestId, const QString &imagePath, const QJsonArray &detections,
+                                     const QPoint &cropOrigin)
+{
+    qDebug() << "Detection" << requestId << "complete - Path:" << imagePath << "defects:" << detections.size();
+    updateImageStatus(imagePath, "Analyzed", detections.size());
+
+    // Refresh the preview and table if this image is selected; the detections
+    // and their crop come with the result, so the JSON file is not read back
+    QTreeWidgetItem *imageItem = findImageItem(imagePath);
+    if (!imageItem || imageItem != surfaceTree->currentItem()) return;
+
+    showDetectedImage(imagePath, detections, cropOrigin);
+}
+
+void MainWindow::showDetectedImage(const QString &imagePath, const QJsonArray &detections, const QPoint &origin)
+{
+    // The boxes are drawn over the capture; the detector no longer renders
+    // an annotated copy unless asked to
+    if (defectImageView->setImageFile(imagePath)) {
+        defectImageView->setOverlay(DefectOverlay::fromDetections(detections, origin));
     }
-    
+    showImageDetections(detections);
+}
+
+void MainWindow::onDetectionError(quint64 requestId, const QString &imagePath, const QString &error)
+{
+    debugOutput->append(QString("<font color='red'>Detection %1 failed for %2: %3</font>")
+                        .arg(requestId).arg(QFileInfo(imagePath).fileName(), error.toHtmlEscaped()));
     if (!imagePath.isEmpty()) {
-        QTreeWidgetItem* imageItem = findImageItem(imagePath);
-        if (imageItem && imageItem == surfaceTree->currentItem()) {
-            QString detectedImagePath = imagePath;
-            detectedImagePath.replace(".jpg", "_detected.jpg");
-            QPixmap pixmap(detectedImagePath);
-            if (!pixmap.isNull()) {
-                defectImageLabel->setPixmap(pixmap.scaled(defectImageLabel->size(),
-                    Qt::KeepAspectRatio, Qt::SmoothTransformation));
-            }
+        updateImageStatus(imagePath, "Failed", -1);
+    }
+}
+
+void MainWindow::onDetectorRestarted(int worker, int restartCount)
+{
+    // Queued images are replayed by the detector; nothing to resubmit here
+    debugOutput->append(QString("<font color='orange'>Detector worker %1 restarted "
+                                "(%2 restart(s) this session, %3 image(s) queued, %4 to replay)</font>")
+                        .arg(worker + 1).arg(restartCount)
+                        .arg(defectDetector->pendingCount()).arg(defectDetector->awaitingReplayCount()));
+}
+
+void MainWindow::showImageDetections(const QJsonArray &detections)
+{
+    defectTable->setRowCount(detections.size());
+    for (int i = 0; i < detections.size(); ++i) {
+        QJsonObject detection = detections[i].toObject();
+
+        // Number
+        QTableWidgetItem *numberItem = new QTableWidgetItem(QString::number(i + 1));
+        numberItem->setTextAlignment(Qt::AlignCenter);
+        defectTable->setItem(i, 0, numberItem);
+
+        // Type
+        QTableWidgetItem *typeItem = new QTableWidgetItem(detection["class_name"].toString());
+        typeItem->setTextAlignment(Qt::AlignCenter);
+        defectTable->setItem(i, 1, typeItem);
+
+        // Confidence (ensure it's in 0-100% range)
+        double confidence = detection["confidence"].toDouble();
+        if (confidence > 1) {
+            confidence = confidence / 100.0;
         }
+        QTableWidgetItem *confItem = new QTableWidgetItem(QString("%1%").arg(confidence * 100, 0, 'f', 1));
+        confItem->setTextAlignment(Qt::AlignCenter);
+        defectTable->setItem(i, 2, confItem);
+
+        // Detections of a single capture are in image pixels
+        // Location (center x, y)
+        QString location = QString("(%1, %2)")
+            .arg(detection["center_x"].toInt())
+            .arg(detection["center_y"].toInt());
+        QTableWidgetItem *locItem = new QTableWidgetItem(location);
+        locItem->setTextAlignment(Qt::AlignCenter);
+        defectTable->setItem(i, 3, locItem);
+
+        // Size (width x height)
+        QString size = QString("%1 × %2")
+            .arg(detection["width"].toInt())
+            .arg(detection["height"].toInt());
+        QTableWidgetItem *sizeItem = new QTableWidgetItem(size);
+        sizeItem->setTextAlignment(Qt::AlignCenter);
+        defectTable->setItem(i, 4, sizeItem);
     }
 }
 
@@ -531,7 +479,7 @@ void MainWindow::updateImageStatus(const QString &imagePath, const QString &stat
             } else if (analyzedCount == totalExpectedImages) {
                 newStatus = "Analyzed";
                 
-                // If surface is now fully analyzed, create labeled stitched image
+                // If surface is now fully analyzed, map its defects onto the stitched image
                 QString surfacePath = QString("%1/%2").arg(sessionPath).arg(surfaceItem->text(0));
                 if (QFile::exists(surfacePath + "/stitched.jpg")) {
                     // Create new stitcher for labeling
@@ -542,83 +490,14 @@ void MainWindow::updateImageStatus(const QString &imagePath, const QString &stat
                         dimensions.actualWidth,
                         dimensions.actualHeight);
                     
-                    // Connect to finished signal to update UI if needed
-                    connect(labelStitcher, &ImageStitcher::finished, this, [this, surfaceItem, surfacePath]() {
-                        qDebug() << "Labeling complete, updating UI...";
-                        QString labeledPath = surfacePath + "/stitched_labeled.jpg";
-                        QString coordPath = surfacePath + "/defect_coordinates.json";
-                        
-                        // Add a small delay to ensure files are fully written
-                        QTimer::singleShot(500, this, [this, surfaceItem, labeledPath, coordPath]() {
-                            if (QFile::exists(labeledPath)) {
-                                // Update defect image preview if this surface is selected
-                                if (surfaceItem == surfaceTree->currentItem()) {
-                                    QPixmap labeledPixmap(labeledPath);
-                                    if (!labeledPixmap.isNull()) {
-                                        defectImageLabel->setPixmap(labeledPixmap.scaled(defectImageLabel->size(),
-                                            Qt::KeepAspectRatio, Qt::SmoothTransformation));
-                                        
-                                        // Update defect details from JSON
-                                        QFile coordFile(coordPath);
-                                        if (coordFile.open(QIODevice::ReadOnly)) {
-                                            QJsonDocument doc = QJsonDocument::fromJson(coordFile.readAll());
-                                            QJsonObject mainObj = doc.object();
-                                            QJsonArray defects = mainObj["defects"].toArray();
-                                            
-                                            defectTable->setRowCount(defects.size());
-                                            for (int i = 0; i < defects.size(); ++i) {
-                                                QJsonObject defect = defects[i].toObject();
-                                                
-                                                // Number
-                                                QTableWidgetItem *numberItem = new QTableWidgetItem(QString::number(i + 1));
-                                                numberItem->setTextAlignment(Qt::AlignCenter);
-                                                defectTable->setItem(i, 0, numberItem);
-
-                                                // Type
-                                                QTableWidgetItem *typeItem = new QTableWidgetItem(defect["type"].toString());
-                                                typeItem->setTextAlignment(Qt::AlignCenter);
-                                                defectTable->setItem(i, 1, typeItem);
-
-                                                // Confidence
-                                                double confidence = defect["confidence"].toDouble();
-                                                if (confidence > 1) {
-                                                    confidence = confidence / 100.0;
-                                                }
-                                                QTableWidgetItem *confItem = new QTableWidgetItem(
-                                                    QString("%1%").arg(confidence * 100, 0, 'f', 1));
-                                                confItem->setTextAlignment(Qt::AlignCenter);
-                                                defectTable->setItem(i, 2, confItem);
-
-                                                // For surface groups, we have physical_position object
-                                                QJsonObject physicalPos = defect["physical_position"].toObject();
-                                                
-                                                // Location (x, y) in mm
-                                                QString location = QString("(%1, %2) mm")
-                                                    .arg(physicalPos["x"].toDouble(), 0, 'f', 1)
-                                                    .arg(physicalPos["y"].toDouble(), 0, 'f', 1);
-                                                QTableWidgetItem *locItem = new QTableWidgetItem(location);
-                                                locItem->setTextAlignment(Qt::AlignCenter);
-                                                defectTable->setItem(i, 3, locItem);
-
-                                                // Size (width × height) in mm
-                                                QString size_str = QString("%1 × %2 mm")
-                                                    .arg(physicalPos["width"].toDouble(), 0, 'f', 1)
-                                                    .arg(physicalPos["height"].toDouble(), 0, 'f', 1);
-                                                QTableWidgetItem *sizeItem = new QTableWidgetItem(size_str);
-                                                sizeItem->setTextAlignment(Qt::AlignCenter);
-                                                defectTable->setItem(i, 4, sizeItem);
-                                            }
-                                            coordFile.close();
-                                        }
-                                    }
-                                }
-                            }
-                        });
-                    });
-                    
                     // Label defects and clean up
                     labelStitcher->labelDefects();
                     delete labelStitcher;
+
+                    // The overlay is read from the coordinates, so a selected surface can refresh right away
+                    if (surfaceItem == surfaceTree->currentItem()) {
+                        onItemSelectionChanged();
+                    }
                 }
             }
 
@@ -699,6 +578,10 @@ void MainWindow::onAddNewSurface()
         }
         saveDimensions();
 
+        // Remember the storage format for this station
+        CaptureStore::Format storageFormat = settingsDialog.getStorageFormat();
+        CaptureStore::setStationFormat(storageFormat);
+
         // Create a new surface directory
         int surfaceNumber = surfaceTree->topLevelItemCount() + 1;
         QString surfaceName = QString("surface_%1").arg(surfaceNumber, 2, 10, QChar('0'));
@@ -743,15 +626,37 @@ void MainWindow::onAddNewSurface()
                     }
                 });
         
+        // Stitch each tile as soon as it is captured so the surface builds up live
+        IncrementalStitcher *stitcher = new IncrementalStitcher(surfacePath,
+                                 currentCaptureSettings.imagesInX,
+                                 currentCaptureSettings.imagesInY,
+                                 currentCaptureSettings.sequence,
+                                 dimensions.actualWidth,
+                                 dimensions.actualHeight,
+                                 this);
+        stitcher->setPreviewSize(originalImageView->size());
+        connect(stitcher, &IncrementalStitcher::previewUpdated,
+                this, [this, surfacePath](const QImage &preview) {
+                    // Only show the live preview while its surface is selected
+                    QTreeWidgetItem *currentItem = surfaceTree->currentItem();
+                    if (!currentItem || !isSurfaceItem(currentItem)) return;
+                    if (QString("%1/%2").arg(sessionPath).arg(currentItem->text(0)) != surfacePath) return;
+
+                    originalImageView->setImage(preview);
+                });
+
         // Open capture window with A4 parameter
         MotorizedCaptureWindow captureWindow(this, surfacePath,
                                            currentCaptureSettings.imagesInX,
                                            currentCaptureSettings.imagesInY,
                                            currentCaptureSettings.sequence,
                                            isA4);  // Pass isA4 parameter
+        captureWindow.setStorageFormat(storageFormat);
         
         // Connect signals for real-time updates
         QTreeWidgetItem* captureItem = surfaceItem;  // Create a copy for the lambda
+        connect(&captureWindow, &MotorizedCaptureWindow::imageCaptured,
+                stitcher, &IncrementalStitcher::addTile);
         connect(&captureWindow, &MotorizedCaptureWindow::imageCaptured,
                 [this, captureItem](const QString &imagePath) {
                     // Add image to tree immediately
@@ -760,37 +665,22 @@ void MainWindow::onAddNewSurface()
                     imageItem->setText(0, fileInfo.fileName());
                     imageItem->setText(1, "Pending");
                     imageItem->setText(2, "-");
-
-                    // Start defect detection with a small delay
+                });
+        // Detection runs on the frame already in memory, straight away
+        connect(&captureWindow, &MotorizedCaptureWindow::frameCaptured,
+                this, [this](const QString &imagePath, const QImage &frame) {
                     if (defectDetector && defectDetector->isModelInitialized()) {
-                        QTimer::singleShot(100, this, [this, imagePath]() {
-                            defectDetector->detectImage(imagePath);
-                        });
+                        defectDetector->detectImage(imagePath, frame);
                     }
                 });
 
         if (captureWindow.exec() == QDialog::Accepted)
         {
-            // Delete any existing stitcher
-            if (currentStitcher) {
-                delete currentStitcher;
-                currentStitcher = nullptr;
-            }
-
-            // Create new stitcher
-            currentStitcher = new ImageStitcher(surfacePath,
-                                 currentCaptureSettings.imagesInX,
-                                 currentCaptureSettings.imagesInY,
-                                 currentCaptureSettings.sequence,
-                                 dimensions.actualWidth,
-                                 dimensions.actualHeight);
-
-            // Start stitching immediately
-            currentStitcher->stitchImages();
-
-            // Connect stitching completion signal
-            connect(currentStitcher, &ImageStitcher::finished, this, [this, surfacePath]() {
+            // Connect stitching completion signal before finalizing so it cannot be missed
+            connect(stitcher, &IncrementalStitcher::finished, this, [this, stitcher, surfacePath](bool success) {
                 qDebug() << "Stitching complete signal received for:" << surfacePath;
+                debugOutput->append(QString("Stitched %1 of %2 tiles incrementally")
+                    .arg(stitcher->tilesPlaced()).arg(stitcher->tileCount()));
                 
                 // Get the current surface item
                 QTreeWidgetItem *currentItem = surfaceTree->currentItem();
@@ -802,37 +692,30 @@ void MainWindow::onAddNewSurface()
                     qDebug() << "Stitched surface path:" << surfacePath;
                     
                     if (currentSurfacePath == surfacePath) {
-                        // Update the stitched image preview
-                        QString stitchedImagePath = QString("%1/stitched.jpg").arg(surfacePath);
-                        qDebug() << "Loading stitched image from:" << stitchedImagePath;
-                        
-                        if (QFile::exists(stitchedImagePath)) {
-                            QPixmap pixmap(stitchedImagePath);
-                            if (!pixmap.isNull()) {
-                                QSize labelSize = originalImageLabel->size();
-                                QPixmap scaledPixmap = pixmap.scaled(labelSize,
-                                    Qt::KeepAspectRatio,
-                                    Qt::FastTransformation);
-                                originalImageLabel->setPixmap(scaledPixmap);
-                                qDebug() << "Successfully updated stitched image preview";
-
-                                // Label defects after stitching
-                                currentStitcher->labelDefects();
-                            } else {
-                                qDebug() << "Failed to load stitched image pixmap";
-                                originalImageLabel->setText("Failed to load stitched image");
-                            }
+                        if (success) {
+                            // Switch from the live preview to the freshly written tile pyramid
+                            originalImageView->setSurface(surfacePath);
+                            qDebug() << "Successfully updated stitched image preview";
+
+                            // Label defects after stitching
+                            stitcher->surfaceStitcher()->labelDefects();
                         } else {
-                            qDebug() << "Stitched image file does not exist at:" << stitchedImagePath;
-                            originalImageLabel->setText("No stitched image available");
+                            qDebug() << "Failed to save stitched image for:" << surfacePath;
+                            originalImageView->setText("Failed to save stitched image");
                         }
                     }
                 }
 
-                // Cleanup stitcher
-                delete currentStitcher;
-                currentStitcher = nullptr;
+                // Cleanup stitcher; it is still emitting, so defer the delete
+                stitcher->deleteLater();
             });
+
+            // Only the encode is left; it runs on a worker thread
+            stitcher->finalize();
+        }
+        else
+        {
+            stitcher->deleteLater();
         }
     }
 }
@@ -855,8 +738,10 @@ void MainWindow::loadSurfaces()
         
         // Load surface status and defect count
         QDir dir(surfacePath);
-        QStringList images = dir.entryList(QStringList() << "image_*.jpg", QDir::Files);
-        images = images.filter(QRegularExpression("^image_\\d+\\.jpg$")); // Only get original images
+        QStringList images;
+        for (const QString &fileName : dir.entryList(CaptureStore::nameFilters(), QDir::Files, QDir::Name)) {
+            if (CaptureStore::isCaptureName(fileName)) images.append(fileName); // Only get original images
+        }
         
         qDebug() << "Found" << images.size() << "images for surface:" << surfaceDir;
         
@@ -869,8 +754,7 @@ void MainWindow::loadSurfaces()
             QTreeWidgetItem *imageItem = new QTreeWidgetItem(surfaceItem);
             imageItem->setText(0, image);
             
-            QString baseName = image;
-            baseName.chop(4); // Remove .jpg
+            QString baseName = QFileInfo(image).completeBaseName();
             QString detectionFile = QString("%1/%2_detections.json").arg(surfacePath).arg(baseName);
             
             qDebug() << "Checking detection file:" << detectionFile;
@@ -947,6 +831,12 @@ void MainWindow::onItemSelectionChanged()
     // Enable delete button only for surface items
     deleteSurfaceButton->setEnabled(isSurfaceItem(currentItem));
 
+    // Detect the surface being looked at first
+    if (defectDetector) {
+        QTreeWidgetItem *surfaceItem = isSurfaceItem(currentItem) ? currentItem : currentItem->parent();
+        defectDetector->setFocusSurface(QString("%1/%2").arg(sessionPath).arg(surfaceItem->text(0)));
+    }
+
     // Clear defect table
     defectTable->setRowCount(0);
     defectTable->setColumnCount(5);
@@ -958,30 +848,22 @@ void MainWindow::onItemSelectionChanged()
         // For surface items, show stitched image if available
         QString surfacePath = QString("%1/%2").arg(sessionPath).arg(currentItem->text(0));
         QString stitchedImagePath = QString("%1/stitched.jpg").arg(surfacePath);
-        QString labeledImagePath = QString("%1/stitched_labeled.jpg").arg(surfacePath);
         QString coordPath = QString("%1/defect_coordinates.json").arg(surfacePath);
         
-        // Show original stitched image in the original area
+        // Show original stitched image in the original area; only visible pyramid tiles are decoded
         if (QFile::exists(stitchedImagePath)) {
-            QPixmap pixmap(stitchedImagePath);
-            if (!pixmap.isNull()) {
-                originalImageLabel->setPixmap(pixmap.scaled(originalImageLabel->size(),
-                    Qt::KeepAspectRatio, Qt::SmoothTransformation));
-    } else {
-                originalImageLabel->setText("Failed to load stitched image");
-            }
+            originalImageView->setSurface(surfacePath);
         } else {
-            originalImageLabel->setText("No stitched image available");
+            originalImageView->setText("No stitched image available");
         }
         
         // Function to update defect view
-        std::function<void()> updateDefectView = [this, labeledImagePath, coordPath]() {
+        std::function<void()> updateDefectView = [this, surfacePath, coordPath]() {
             qDebug() << "Updating defect view...";
-            if (QFile::exists(labeledImagePath)) {
-                QPixmap labeledPixmap(labeledImagePath);
-                if (!labeledPixmap.isNull()) {
-                    defectImageLabel->setPixmap(labeledPixmap.scaled(defectImageLabel->size(),
-                        Qt::KeepAspectRatio, Qt::SmoothTransformation));
+            if (QFile::exists(coordPath)) {
+                if (defectImageView->setSurface(surfacePath)) {
+                    // Defects are drawn as vectors over the stitched pyramid
+                    defectImageView->setOverlay(DefectOverlay::load(surfacePath));
                     
                     // Load and display defect details from JSON
                     QFile coordFile(coordPath);
@@ -1037,17 +919,17 @@ void MainWindow::onItemSelectionChanged()
                         qDebug() << "Updated defect view with" << defects.size() << "defects";
                     }
                 } else {
-                    defectImageLabel->setText("Failed to load labeled image");
+                    defectImageView->setText("Failed to load stitched image");
                 }
             } else {
-                defectImageLabel->setText("No labeled image available");
+                defectImageView->setText("No defect coordinates available");
             }
         };
 
         // Initial update
         updateDefectView();
 
-        // Set up file watcher for the labeled image and coordinates file
+        // Set up file watcher for the coordinates file
         if (defectWatcher) {
             disconnect(defectWatcher, nullptr, this, nullptr);  // Disconnect all previous connections
             delete defectWatcher;
@@ -1057,7 +939,7 @@ void MainWindow::onItemSelectionChanged()
         
         // Connect the file watcher with a small delay to avoid rapid updates
         connect(defectWatcher, &QFileSystemWatcher::directoryChanged, this, 
-            [this, updateDefectView, labeledImagePath]() {
+            [this, updateDefectView, coordPath]() {
                 static QTimer *debounceTimer = nullptr;
                 if (debounceTimer) {
                     debounceTimer->stop();
@@ -1066,8 +948,8 @@ void MainWindow::onItemSelectionChanged()
                 debounceTimer = new QTimer(this);
                 debounceTimer->setSingleShot(true);
                 debounceTimer->setInterval(500);  // 500ms delay
-                connect(debounceTimer, &QTimer::timeout, this, [updateDefectView, labeledImagePath]() {
-                    if (QFile::exists(labeledImagePath)) {
+                connect(debounceTimer, &QTimer::timeout, this, [updateDefectView, coordPath]() {
+                    if (QFile::exists(coordPath)) {
                         updateDefectView();
                     }
                 });
@@ -1083,83 +965,24 @@ void MainWindow::onItemSelectionChanged()
         // Show original image
         updatePreviewImage(imagePath);
 
-        // Show detected image
-        QString detectedImagePath = imagePath;
-        detectedImagePath.replace(".jpg", "_detected.jpg");
-        QPixmap detectedPixmap(detectedImagePath);
-        if (!detectedPixmap.isNull()) {
-            QSize labelSize = defectImageLabel->size();
-            QPixmap scaledPixmap = detectedPixmap.scaled(labelSize, 
-                Qt::KeepAspectRatio, 
-                Qt::FastTransformation);
-            defectImageLabel->setPixmap(scaledPixmap);
-        } else {
-            defectImageLabel->setText("No defects detected yet");
-        }
-
-        // Load defect details if available
-        QString detectionFile = imagePath;
-        detectionFile.replace(".jpg", "_detections.json");
+        // Show the capture with its detections drawn over it, if it has been analyzed
+        QString detectionFile = CaptureStore::sidecarPath(imagePath, "_detections.json");
         QFile file(detectionFile);
         if (file.open(QIODevice::ReadOnly)) {
             QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
             QJsonObject obj = doc.object();
-            QJsonArray detections = obj["detections"].toArray();
-
-            // Populate defect table
-            defectTable->setRowCount(detections.size());
-            for (int i = 0; i < detections.size(); ++i) {
-                QJsonObject detection = detections[i].toObject();
-                
-                // Number
-                QTableWidgetItem *numberItem = new QTableWidgetItem(QString::number(i + 1));
-                numberItem->setTextAlignment(Qt::AlignCenter);
-                defectTable->setItem(i, 0, numberItem);
-
-                // Type
-                QTableWidgetItem *typeItem = new QTableWidgetItem(detection["class_name"].toString());
-                typeItem->setTextAlignment(Qt::AlignCenter);
-                defectTable->setItem(i, 1, typeItem);
-
-                // Confidence (ensure it's in 0-100% range)
-                double confidence = detection["confidence"].toDouble();
-                if (confidence > 1) {
-                    confidence = confidence / 100.0;
-                }
-                QTableWidgetItem *confItem = new QTableWidgetItem(QString("%1%").arg(confidence * 100, 0, 'f', 1));
-                confItem->setTextAlignment(Qt::AlignCenter);
-                defectTable->setItem(i, 2, confItem);
-
-                // For individual pieces, coordinates are directly in the detection object
-                // Location (center x, y)
-                QString location = QString("(%1, %2)")
-                    .arg(detection["center_x"].toInt())
-                    .arg(detection["center_y"].toInt());
-                QTableWidgetItem *locItem = new QTableWidgetItem(location);
-                locItem->setTextAlignment(Qt::AlignCenter);
-                defectTable->setItem(i, 3, locItem);
-
-                // Size (width x height)
-                QString size = QString("%1 × %2")
-                    .arg(detection["width"].toInt())
-                    .arg(detection["height"].toInt());
-                QTableWidgetItem *sizeItem = new QTableWidgetItem(size);
-                sizeItem->setTextAlignment(Qt::AlignCenter);
-                defectTable->setItem(i, 4, sizeItem);
-            }
+            QJsonObject crop = obj["crop"].toObject();
+            showDetectedImage(imagePath, obj["detections"].toArray(), QPoint(crop["x"].toInt(), crop["y"].toInt()));
             file.close();
+        } else {
+            defectImageView->setText("No defects detected yet");
         }
     }
 }
 
 void MainWindow::updatePreviewImage(const QString &imagePath)
 {
-    QPixmap pixmap(imagePath);
-    if (!pixmap.isNull())
-    {
-        originalImageLabel->setPixmap(pixmap.scaled(originalImageLabel->size(),
-            Qt::KeepAspectRatio, Qt::SmoothTransformation));
-    }
+    originalImageView->setImageFile(imagePath);
 }
 
 bool MainWindow::isSurfaceItem(QTreeWidgetItem *item) const
@@ -1178,16 +1001,52 @@ void MainWindow::onItemExpanded(QTreeWidgetItem *item)
         
         if (QFile::exists(stitchedImagePath))
         {
-            QPixmap pixmap(stitchedImagePath);
-            if (!pixmap.isNull())
-            {
-                originalImageLabel->setPixmap(pixmap.scaled(originalImageLabel->size(),
-                    Qt::KeepAspectRatio, Qt::SmoothTransformation));
-            }
+            originalImageView->setSurface(surfacePath);
         }
     }
 }
 
+void MainWindow::onDefectDoubleClicked(int row, int column)
+{
+    Q_UNUSED(column);
+    QTreeWidgetItem *currentItem = surfaceTree->currentItem();
+    if (!currentItem) return;
+
+    // Zoom both views onto the defect; the pyramid only decodes the tiles around it
+    QRectF defectRect;
+    if (isSurfaceItem(currentItem)) {
+        QString surfacePath = QString("%1/%2").arg(sessionPath).arg(currentItem->text(0));
+        QFile coordFile(QString("%1/defect_coordinates.json").arg(surfacePath));
+        if (!coordFile.open(QIODevice::ReadOnly)) return;
+        QJsonArray defects = QJsonDocument::fromJson(coordFile.readAll()).object()["defects"].toArray();
+        if (row < 0 || row >= defects.size()) return;
+
+        QJsonObject canvasPos = defects[row].toObject()["canvas_position"].toObject();
+        QSizeF size(canvasPos["width"].toDouble(), canvasPos["height"].toDouble());
+        QPointF center(canvasPos["x"].toDouble(), canvasPos["y"].toDouble());
+        defectRect = QRectF(center - QPointF(size.width() / 2, size.height() / 2), size);
+    } else {
+        QString imagePath = QString("%1/%2/%3").arg(sessionPath).arg(currentItem->parent()->text(0)).arg(currentItem->text(0));
+        QString detectionFile = CaptureStore::sidecarPath(imagePath, "_detections.json");
+        QFile file(detectionFile);
+        if (!file.open(QIODevice::ReadOnly)) return;
+        QJsonObject results = QJsonDocument::fromJson(file.readAll()).object();
+        QJsonArray detections = results["detections"].toArray();
+        if (row < 0 || row >= detections.size()) return;
+
+        // Detections are relative to the crop they ran on; the views show the whole capture
+        QJsonObject crop = results["crop"].toObject();
+        QJsonObject detection = detections[row].toObject();
+        QSizeF size(detection["width"].toDouble(), detection["height"].toDouble());
+        QPointF center(detection["center_x"].toDouble() + crop["x"].toInt(),
+                       detection["center_y"].toDouble() + crop["y"].toInt());
+        defectRect = QRectF(center - QPointF(size.width() / 2, size.height() / 2), size);
+    }
+
+    originalImageView->zoomToRect(defectRect);
+    defectImageView->zoomToRect(defectRect);
+}
+
 void MainWindow::onItemCollapsed(QTreeWidgetItem *item)
 {
     // Optional: You can add any special handling for collapsed items here
@@ -1208,12 +1067,14 @@ void MainWindow::onDeleteSurface()
         QString("Are you sure you want to delete %1 and all its images?").arg(currentItem->text(0)),
                               QMessageBox::Yes | QMessageBox::No) == QMessageBox::Yes)
     {
-        
+        // Its queued images would only burn CPU ahead of live ones
+        defectDetector->cancelSurface(surfacePath);
+
         if (surfaceDir.removeRecursively())
         {
             delete currentItem;
-            originalImageLabel->setText("Select an image to preview");
-            defectImageLabel->setText("No defects detected yet");
+            originalImageView->setText("Select an image to preview");
+            defectImageView->setText("No defects detected yet");
         }
         else
         {
@@ -1222,6 +1083,36 @@ void MainWindow::onDeleteSurface()
     }
 }
 
+void MainWindow::onExportLabeledImage()
+{
+    QTreeWidgetItem* selectedItem = surfaceTree->currentItem();
+    if (!selectedItem || selectedItem->parent() != nullptr) {
+        QMessageBox::warning(this, "Warning", "Please select a surface group to export.");
+        return;
+    }
+
+    QString surfacePath = QString("%1/%2").arg(sessionPath).arg(selectedItem->text(0));
+    if (!QFile::exists(surfacePath + "/stitched.jpg")) {
+        QMessageBox::warning(this, "Error", "The surface has not been stitched yet.");
+        return;
+    }
+
+    QString outputPath = QFileDialog::getSaveFileName(this, "Export Labeled Image",
+        surfacePath + "/stitched_labeled.jpg", "JPEG Images (*.jpg *.jpeg)");
+    if (outputPath.isEmpty()) {
+        return;
+    }
+
+    // Decodes and re-encodes the full surface, so it only happens on request
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    bool exported = DefectOverlay::exportLabeledImage(surfacePath, outputPath);
+    QApplication::restoreOverrideCursor();
+
+    if (!exported) {
+        QMessageBox::warning(this, "Error", "Failed to export the labeled image.");
+    }
+}
+
 void MainWindow::onCutSurface()
 {
     // Get the currently selected surface group
@@ -1261,6 +1152,13 @@ void MainWindow::onCutSurface()
                               dimensions.capturedWidth,
                               dimensions.capturedHeight,
                               surfaceCount);
+
+    // Layout suggestions look at every surface of the session
+    QStringList surfacePaths;
+    for (int i = 0; i < surfaceTree->topLevelItemCount(); ++i) {
+        surfacePaths.append(QString("%1/%2").arg(sessionPath).arg(surfaceTree->topLevelItem(i)->text(0)));
+    }
+    dialog.setSurfacePaths(surfacePaths);
     
     if (dialog.exec() == QDialog::Accepted) {
         int piecesInX = dialog.getPiecesInX();
@@ -1273,10 +1171,15 @@ void MainWindow::onCutSurface()
         
         // Create and show the cutting window modally
         // Pass sessionPath instead of surfacePath to analyze all surfaces
-        CuttingWindow *cuttingWindow = new CuttingWindow(this, sessionPath, piecesInX, piecesInY, useXAxisStacking);
+        CuttingWindow *cuttingWindow = new CuttingWindow(this, sessionPath, piecesInX, piecesInY, useXAxisStacking,
+                                                         dimensions.actualWidth, dimensions.actualHeight);
         cuttingWindow->setAttribute(Qt::WA_DeleteOnClose); // Automatically delete when closed
+        if (dialog.hasSelectedLayout()) {
+            cuttingWindow->setCutGrid(dialog.getSelectedLayout());
+        }
+        cuttingWindow->setGuillotineCutting(dialog.isGuillotineCutting());
         
-        // Perform the cutting analysis before showing the window
+        // Start the cutting analysis; the window fills in as the surfaces are done
         cuttingWindow->performCuttingAnalysis();
         
         cuttingWindow->exec(); // Show modal dialog and wait for it to close
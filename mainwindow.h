@@ -17,6 +17,7 @@
 #include "capturewindow.h"
 #include "defectdetector.h"
 #include "imagestitcher.h"
+#include "pyramidviewer.h"
 
 struct Dimensions {
     double actualWidth;
@@ -37,13 +38,19 @@ private slots:
     void onAddNewSurface();
     void onDeleteSurface();
     void onCutSurface();
+    void onExportLabeledImage();
     void onItemSelectionChanged();
     void onItemExpanded(QTreeWidgetItem* item);
     void onItemCollapsed(QTreeWidgetItem* item);
     void onModelStatusMessage(const QString &message);
     void onModelInitComplete();
     void onModelInitFailed(const QString &error);
-    void onDetectionComplete(const QStringList &results);
+    void onDetectionStarted(quint64 requestId, const QString &imagePath);
+    void onDetectionFinished(quint64 requestId, const QString &imagePath, const QJsonArray &detections,
+                             const QPoint &cropOrigin);
+    void onDetectionError(quint64 requestId, const QString &imagePath, const QString &error);
+    void onDetectorRestarted(int worker, int restartCount);
+    void onDefectDoubleClicked(int row, int column);
 
 private:
     void setupUI();
@@ -55,6 +62,8 @@ private:
     void loadSurfaces();
     void loadSurfaceImages(QTreeWidgetItem* surfaceItem);
     void updatePreviewImage(const QString& imagePath);
+    void showImageDetections(const QJsonArray &detections);
+    void showDetectedImage(const QString &imagePath, const QJsonArray &detections, const QPoint &origin);
     bool isSurfaceItem(QTreeWidgetItem* item) const;
     void initializeDefectDetector();
     void updateImageStatus(const QString &imagePath, const QString &status, int defectCount = -1);
@@ -66,8 +75,8 @@ private:
     // UI Components
     QWidget *centralWidget;
     QTreeWidget *surfaceTree;
-    QLabel *originalImageLabel;
-    QLabel *defectImageLabel;
+    PyramidViewer *originalImageView;
+    PyramidViewer *defectImageView;
     QTableWidget *defectTable;
     QLabel *dimensionsLabel;
     QTextEdit *debugOutput;
@@ -76,10 +85,10 @@ private:
     QPushButton *addSurfaceButton;
     QPushButton *deleteSurfaceButton;
     QPushButton *cutSurfaceButton;
+    QPushButton *exportLabeledButton;
 
     // Defect detector
     DefectDetector *defectDetector;
-    ImageStitcher *currentStitcher;
 
     // Capture settings
     struct CaptureSettings {
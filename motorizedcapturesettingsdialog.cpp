@@ -31,6 +31,20 @@ void MotorizedCaptureSettingsDialog::setupUI()
     sizeGroup->setLayout(sizeLayout);
     mainLayout->addWidget(sizeGroup);
 
+    // Capture storage format, remembered per station
+    QGroupBox *storageGroup = new QGroupBox("Capture Storage");
+    QVBoxLayout *storageLayout = new QVBoxLayout;
+
+    storageFormatCombo = new QComboBox;
+    for (CaptureStore::Format format : CaptureStore::formats()) {
+        storageFormatCombo->addItem(CaptureStore::formatLabel(format), int(format));
+    }
+    storageFormatCombo->setCurrentIndex(storageFormatCombo->findData(int(CaptureStore::stationFormat())));
+    storageLayout->addWidget(storageFormatCombo);
+
+    storageGroup->setLayout(storageLayout);
+    mainLayout->addWidget(storageGroup);
+
     // Sequence input
     QGroupBox *sequenceGroup = new QGroupBox("Capture Sequence (4×4)");
     QGridLayout *sequenceLayout = new QGridLayout;
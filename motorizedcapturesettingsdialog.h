@@ -8,6 +8,7 @@
 #include <QLabel>
 #include <QComboBox>
 #include <QVector>
+#include "capturestore.h"
 
 class MotorizedCaptureSettingsDialog : public QDialog
 {
@@ -20,6 +21,9 @@ public:
     int getImagesInY() const { return 4; }  // Fixed 4x4 grid
     QVector<int> getCaptureSequence() const { return sequence; }
     QString getPaperSize() const { return paperSizeCombo->currentText(); }
+    CaptureStore::Format getStorageFormat() const {
+        return static_cast<CaptureStore::Format>(storageFormatCombo->currentData().toInt());
+    }
 
 private slots:
     void validateSequence();
@@ -29,6 +33,7 @@ private:
     void setupUI();
     
     QComboBox *paperSizeCombo;
+    QComboBox *storageFormatCombo;
     QVector<QLineEdit*> sequenceInputs;
     QLabel *validationLabel;
     QPushButton *okButton;
@@ -6,7 +6,9 @@
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QFile>
+#include <QFileInfo>
 #include <QDateTime>
+#include <QElapsedTimer>
 #include <QPaintEvent>
 #include <QDebug>
 #include <QThread>
@@ -20,6 +22,7 @@ MotorizedCaptureWindow::MotorizedCaptureWindow(QWidget *parent, const QString &s
     , imagesInY(imagesInY)
     , sequence(sequence)
     , currentCaptureIndex(0)
+    , storageFormat(CaptureStore::stationFormat())
     , cameraConnected(false)
     , arduinoPort(nullptr)
     , isA4Size(isA4)
@@ -355,6 +358,7 @@ void MotorizedCaptureWindow::handleNetworkReply(QNetworkReply *reply)
         
         if (!image.isNull()) {
             lastFrame = image;
+            lastFrameData = imageData;
             cameraConnected = true;
             
             // Create a copy for display with reference box
@@ -544,15 +548,25 @@ void MotorizedCaptureWindow::captureImage()
         return;
     }
 
-    lastSavedImagePath = QString("%1/image_%2.jpg")
-        .arg(surfacePath)
-        .arg(currentCaptureIndex + 1, 2, 10, QChar('0'));
-    
-    saveImage(lastFrame);
+    lastSavedImagePath = CaptureStore::capturePath(surfacePath, currentCaptureIndex + 1, storageFormat);
+
+    // With pass-through storage this writes the snapshot exactly as the camera
+    // sent it; nothing is encoded between captures
+    QElapsedTimer saveTimer;
+    saveTimer.start();
+    bool saved = saveImage(lastFrame, lastFrameData);
+    qDebug() << "Saved" << lastSavedImagePath << "as" << CaptureStore::formatName(storageFormat)
+             << "in" << saveTimer.elapsed() << "ms";
+    if (!saved) {
+        statusLabel->setText(QString("Failed to save %1").arg(QFileInfo(lastSavedImagePath).fileName()));
+        return;
+    }
     capturedImages.append(lastSavedImagePath);
     
     // Emit signal for the newly captured image
     emit imageCaptured(lastSavedImagePath);
+    // The decoded frame too, so detection does not have to read the file back
+    emit frameCaptured(lastSavedImagePath, lastFrame);
     
     currentCaptureIndex++;
     updateStatusLabel();
@@ -565,9 +579,9 @@ void MotorizedCaptureWindow::captureImage()
     }
 }
 
-void MotorizedCaptureWindow::saveImage(const QImage &image)
+bool MotorizedCaptureWindow::saveImage(const QImage &image, const QByteArray &encoded)
 {
-    image.save(lastSavedImagePath, "JPG", 100);
+    return CaptureStore::write(lastSavedImagePath, storageFormat, image, encoded);
 }
 
 QString MotorizedCaptureWindow::getCurrentCoordinates() const
@@ -609,6 +623,7 @@ void MotorizedCaptureWindow::saveSettings()
         sequenceArray.append(num);
     }
     settings["sequence"] = sequenceArray;
+    settings["capture_format"] = CaptureStore::formatName(storageFormat);
 
     QJsonDocument doc(settings);
     QString filename = surfacePath + "/settings.json";
@@ -13,6 +13,7 @@
 #include <QSerialPortInfo>
 #include <QComboBox>
 #include <QHBoxLayout>
+#include "capturestore.h"
 
 class MotorizedCaptureWindow : public QDialog
 {
@@ -29,8 +30,12 @@ public:
 
     QStringList getCapturedImages() const { return capturedImages; }
 
+    void setStorageFormat(CaptureStore::Format format) { storageFormat = format; }
+    CaptureStore::Format getStorageFormat() const { return storageFormat; }
+
 signals:
     void imageCaptured(const QString &imagePath);
+    void frameCaptured(const QString &imagePath, const QImage &frame);
 
 protected:
     void keyPressEvent(QKeyEvent *event) override {
@@ -126,7 +131,7 @@ private:
     void connectToArduino();
     void updateStatusLabel();
     QString getCurrentCoordinates() const;
-    void saveImage(const QImage &image);
+    bool saveImage(const QImage &image, const QByteArray &encoded);
     void saveSettings();
     void drawReferenceBox(QPainter &painter);
     void sendArduinoCommand(const QString &command);
@@ -167,6 +172,8 @@ private:
     QVector<int> sequence;
     int currentCaptureIndex;
     QImage lastFrame;
+    QByteArray lastFrameData;  // lastFrame as the camera sent it, for pass-through captures
+    CaptureStore::Format storageFormat;
     
     // Camera settings
     // TODO: change camera url
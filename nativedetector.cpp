@@ -0,0 +1,241 @@
+#include "nativedetector.h"
+#include <QDir>
+#include <QFile>
+#include <QJsonObject>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+#include <QDebug>
+
+#ifdef CARDQT_HAVE_OPENCV_DNN
+#include <opencv2/core.hpp>
+#include <opencv2/dnn.hpp>
+#include <opencv2/imgproc.hpp>
+#include <vector>
+#endif
+
+struct NativeDetector::NetPool
+{
+#ifdef CARDQT_HAVE_OPENCV_DNN
+    std::vector<cv::dnn::Net> instances;
+#endif
+    QVector<int> idle;
+    QMutex mutex;
+    QWaitCondition released;
+
+    int acquire()
+    {
+        QMutexLocker locker(&mutex);
+        while (idle.isEmpty()) {
+            released.wait(&mutex);
+        }
+        return idle.takeLast();
+    }
+
+    void release(int index)
+    {
+        QMutexLocker locker(&mutex);
+        idle.append(index);
+        released.wakeOne();
+    }
+};
+
+NativeDetector::NativeDetector()
+    : inputSize(640)
+    , confidenceThreshold(0.25f)  // Ultralytics predict defaults
+    , iouThreshold(0.7f)
+{
+}
+
+NativeDetector::~NativeDetector() = default;
+
+bool NativeDetector::isAvailable()
+{
+#ifdef CARDQT_HAVE_OPENCV_DNN
+    return true;
+#else
+    return false;
+#endif
+}
+
+QString NativeDetector::defaultModelPath()
+{
+    return QDir::currentPath() + "/model/best.onnx";
+}
+
+const QStringList &NativeDetector::classNames()
+{
+    // Same order as the class ids the model was trained with
+    static const QStringList names = { "damage", "edge", "mark", "oil" };
+    return names;
+}
+
+bool NativeDetector::load(const QString &modelPath, int instances, QString *error)
+{
+    unload();
+
+#ifdef CARDQT_HAVE_OPENCV_DNN
+    if (!QFile::exists(modelPath)) {
+        if (error) *error = QString("ONNX model not found at %1").arg(modelPath);
+        return false;
+    }
+
+    instances = qMax(1, instances);
+    auto pool = std::make_unique<NetPool>();
+    try {
+        for (int i = 0; i < instances; ++i) {
+            cv::dnn::Net net = cv::dnn::readNetFromONNX(modelPath.toStdString());
+            net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+            net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+            pool->instances.push_back(net);
+            pool->idle.append(i);
+        }
+    } catch (const cv::Exception &e) {
+        if (error) *error = QString("Failed to load %1: %2").arg(modelPath, QString::fromStdString(e.msg));
+        return false;
+    }
+
+    // OpenCV's own thread pool is process wide; share the cores between the
+    // instances instead of letting each forward pass claim all of them
+    cv::setNumThreads(qMax(1, QThread::idealThreadCount() / instances));
+
+    nets = std::move(pool);
+    return true;
+#else
+    Q_UNUSED(instances);
+    if (error) *error = QString("Built without OpenCV DNN; cannot load %1").arg(modelPath);
+    return false;
+#endif
+}
+
+void NativeDetector::unload()
+{
+    nets.reset();
+}
+
+bool NativeDetector::isLoaded() const
+{
+    return nets != nullptr;
+}
+
+bool NativeDetector::detect(const QImage &image, QJsonArray &detections, QString *error) const
+{
+    detections = QJsonArray();
+    if (!nets) {
+        if (error) *error = "Native detector is not loaded";
+        return false;
+    }
+    if (image.isNull()) {
+        if (error) *error = "No image to run detection on";
+        return false;
+    }
+
+#ifdef CARDQT_HAVE_OPENCV_DNN
+    // Letterbox into the square network input the way Ultralytics does:
+    // scale to fit, centre, pad with grey
+    const QImage rgb = image.convertToFormat(QImage::Format_RGB888);
+    const cv::Mat source(rgb.height(), rgb.width(), CV_8UC3,
+                         const_cast<uchar *>(rgb.constBits()), size_t(rgb.bytesPerLine()));
+    const float scale = qMin(float(inputSize) / rgb.width(), float(inputSize) / rgb.height());
+    const int scaledWidth = qRound(rgb.width() * scale);
+    const int scaledHeight = qRound(rgb.height() * scale);
+    const int padX = (inputSize - scaledWidth) / 2;
+    const int padY = (inputSize - scaledHeight) / 2;
+
+    cv::Mat input(inputSize, inputSize, CV_8UC3, cv::Scalar(114, 114, 114));
+    cv::resize(source, input(cv::Rect(padX, padY, scaledWidth, scaledHeight)),
+               cv::Size(scaledWidth, scaledHeight), 0, 0, cv::INTER_LINEAR);
+    const cv::Mat blob = cv::dnn::blobFromImage(input, 1.0 / 255.0, cv::Size(), cv::Scalar(), false, false);
+
+    cv::Mat output;
+    const int instance = nets->acquire();
+    try {
+        cv::dnn::Net &net = nets->instances[size_t(instance)];
+        net.setInput(blob);
+        output = net.forward().clone();
+    } catch (const cv::Exception &e) {
+        nets->release(instance);
+        if (error) *error = QString("Inference failed: %1").arg(QString::fromStdString(e.msg));
+        return false;
+    }
+    nets->release(instance);
+
+    // YOLOv8 heads give [1, 4 + classes, anchors]: cx, cy, w, h, then one
+    // score per class. Some exports are already transposed.
+    const int classCount = classNames().size();
+    const int fields = 4 + classCount;
+    if (output.dims != 3) {
+        if (error) *error = QString("Unexpected model output with %1 dimensions").arg(output.dims);
+        return false;
+    }
+    cv::Mat rows;
+    if (output.size[1] == fields) {
+        rows = cv::Mat(output.size[1], output.size[2], CV_32F, output.ptr<float>()).t();
+    } else if (output.size[2] == fields) {
+        rows = cv::Mat(output.size[1], output.size[2], CV_32F, output.ptr<float>());
+    } else {
+        if (error) *error = QString("Model output does not match %1 classes").arg(classCount);
+        return false;
+    }
+
+    std::vector<cv::Rect> boxes;
+    std::vector<float> scores;
+    std::vector<int> classIds;
+    for (int r = 0; r < rows.rows; ++r) {
+        const float *row = rows.ptr<float>(r);
+        int classId = 0;
+        for (int c = 1; c < classCount; ++c) {
+            if (row[4 + c] > row[4 + classId]) classId = c;
+        }
+        const float score = row[4 + classId];
+        if (score < confidenceThreshold) continue;
+
+        // Back from letterboxed input to image pixels
+        const float x1 = (row[0] - row[2] / 2 - padX) / scale;
+        const float y1 = (row[1] - row[3] / 2 - padY) / scale;
+        const float x2 = (row[0] + row[2] / 2 - padX) / scale;
+        const float y2 = (row[1] + row[3] / 2 - padY) / scale;
+        cv::Rect box(cv::Point(qBound(0, int(x1), rgb.width()), qBound(0, int(y1), rgb.height())),
+                     cv::Point(qBound(0, int(x2), rgb.width()), qBound(0, int(y2), rgb.height())));
+        if (box.area() <= 0) continue;
+
+        boxes.push_back(box);
+        scores.push_back(score);
+        classIds.push_back(classId);
+    }
+
+    // Non-maximum suppression within each class, as Ultralytics does by default
+    for (int c = 0; c < classCount; ++c) {
+        std::vector<cv::Rect> classBoxes;
+        std::vector<float> classScores;
+        for (size_t i = 0; i < boxes.size(); ++i) {
+            if (classIds[i] != c) continue;
+            classBoxes.push_back(boxes[i]);
+            classScores.push_back(scores[i]);
+        }
+        if (classBoxes.empty()) continue;
+
+        std::vector<int> kept;
+        cv::dnn::NMSBoxes(classBoxes, classScores, confidenceThreshold, iouThreshold, kept);
+        for (int k : kept) {
+            const cv::Rect &box = classBoxes[size_t(k)];
+            QJsonObject detection;
+            detection["xyxy"] = QJsonArray{ box.x, box.y, box.x + box.width, box.y + box.height };
+            detection["confidence"] = double(classScores[size_t(k)]) * 100;  // Percentage
+            detection["class_id"] = c;
+            detection["class_name"] = classNames().at(c);
+            detection["width"] = box.width;
+            detection["height"] = box.height;
+            detection["area"] = box.width * box.height;
+            detection["center_x"] = box.x + box.width / 2;
+            detection["center_y"] = box.y + box.height / 2;
+            detections.append(detection);
+        }
+    }
+    return true;
+#else
+    if (error) *error = "Built without OpenCV DNN";
+    return false;
+#endif
+}
@@ -0,0 +1,54 @@
+#ifndef NATIVEDETECTOR_H
+#define NATIVEDETECTOR_H
+
+#include <QImage>
+#include <QJsonArray>
+#include <QString>
+#include <QStringList>
+#include <memory>
+
+// Runs the YOLO defect model in process with OpenCV DNN on an exported
+// model/best.onnx, so detection needs neither a Python interpreter nor a
+// file round trip. Detections have the same fields as the Python worker's.
+//
+// An OpenCV Net is not safe to run from two threads at once, so load()
+// creates one per thread that will call detect(); detect() borrows a free
+// one and blocks while all are busy.
+//
+// Without OpenCV DNN at build time (CARDQT_HAVE_OPENCV_DNN unset) load()
+// always fails and callers fall back to the Python worker.
+class NativeDetector
+{
+public:
+    NativeDetector();
+    ~NativeDetector();
+
+    static bool isAvailable();
+    static QString defaultModelPath();
+    static const QStringList &classNames();
+
+    bool load(const QString &modelPath, int instances, QString *error = nullptr);
+    void unload();
+    bool isLoaded() const;
+
+    // Thread safe. Returns false and sets error if inference failed.
+    bool detect(const QImage &image, QJsonArray &detections, QString *error = nullptr) const;
+
+    // Square network input the model was exported with
+    void setInputSize(int size) { inputSize = size; }
+    int getInputSize() const { return inputSize; }
+    float getConfidenceThreshold() const { return confidenceThreshold; }
+    float getIouThreshold() const { return iouThreshold; }
+
+private:
+    NativeDetector(const NativeDetector &) = delete;
+    NativeDetector &operator=(const NativeDetector &) = delete;
+
+    struct NetPool;
+    std::unique_ptr<NetPool> nets;
+    int inputSize;
+    float confidenceThreshold;
+    float iouThreshold;
+};
+
+#endif // NATIVEDETECTOR_H
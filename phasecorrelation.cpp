@@ -0,0 +1,301 @@
+#include "phasecorrelation.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PHASECORRELATION_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const double Pi = 3.14159265358979323846;
+
+// Square blocks keep both sides of the transpose in cache
+void transpose(const float *src, float *dst, int width, int height)
+{
+    const int block = 16;
+    for (int y0 = 0; y0 < height; y0 += block) {
+        for (int x0 = 0; x0 < width; x0 += block) {
+            const int yEnd = std::min(y0 + block, height);
+            const int xEnd = std::min(x0 + block, width);
+            for (int y = y0; y < yEnd; ++y) {
+                for (int x = x0; x < xEnd; ++x) {
+                    dst[x * height + y] = src[y * width + x];
+                }
+            }
+        }
+    }
+}
+
+// Vertex of the parabola through three samples, relative to the centre one
+float parabolicOffset(float left, float centre, float right)
+{
+    float denominator = left - 2.0f * centre + right;
+    if (std::fabs(denominator) < 1e-12f) return 0.0f;
+    float offset = 0.5f * (left - right) / denominator;
+    return std::max(-0.5f, std::min(0.5f, offset));
+}
+
+} // namespace
+
+PhaseCorrelator::PhaseCorrelator(int fftWidth, int fftHeight)
+{
+    buildPlan(planX, isPowerOfTwo(fftWidth) ? fftWidth : nextPowerOfTwo(fftWidth));
+    buildPlan(planY, isPowerOfTwo(fftHeight) ? fftHeight : nextPowerOfTwo(fftHeight));
+
+    const size_t count = size_t(planX.size) * planY.size;
+    aRe.resize(count);
+    aIm.resize(count);
+    bRe.resize(count);
+    bIm.resize(count);
+    columnRe.resize(count);
+    columnIm.resize(count);
+}
+
+int PhaseCorrelator::nextPowerOfTwo(int n)
+{
+    int power = 1;
+    while (power < n) power <<= 1;
+    return power;
+}
+
+bool PhaseCorrelator::usesSimd()
+{
+#ifdef PHASECORRELATION_SSE2
+    return true;
+#else
+    return false;
+#endif
+}
+
+void PhaseCorrelator::buildPlan(FftPlan &plan, int size)
+{
+    plan.size = size;
+
+    int bits = 0;
+    while ((1 << bits) < size) ++bits;
+    plan.bitReverse.resize(size);
+    for (int i = 0; i < size; ++i) {
+        int reversed = 0;
+        for (int b = 0; b < bits; ++b) {
+            if (i & (1 << b)) reversed |= 1 << (bits - 1 - b);
+        }
+        plan.bitReverse[i] = reversed;
+    }
+
+    // Forward twiddles e^(-i*pi*j/m); the inverse transform negates the imaginary part
+    plan.twiddleRe.assign(std::max(size, 2), 0.0f);
+    plan.twiddleIm.assign(std::max(size, 2), 0.0f);
+    for (int m = 1; m < size; m <<= 1) {
+        for (int j = 0; j < m; ++j) {
+            double angle = -Pi * j / m;
+            plan.twiddleRe[m + j] = static_cast<float>(std::cos(angle));
+            plan.twiddleIm[m + j] = static_cast<float>(std::sin(angle));
+        }
+    }
+}
+
+void PhaseCorrelator::fft(float *re, float *im, const FftPlan &plan, bool inverse)
+{
+    const int n = plan.size;
+
+    for (int i = 0; i < n; ++i) {
+        int j = plan.bitReverse[i];
+        if (j > i) {
+            std::swap(re[i], re[j]);
+            std::swap(im[i], im[j]);
+        }
+    }
+
+    const float sign = inverse ? -1.0f : 1.0f;
+
+    for (int m = 1; m < n; m <<= 1) {
+        const float *wRe = plan.twiddleRe.data() + m;
+        const float *wIm = plan.twiddleIm.data() + m;
+
+        for (int k = 0; k < n; k += 2 * m) {
+            float *topRe = re + k;
+            float *topIm = im + k;
+            float *bottomRe = re + k + m;
+            float *bottomIm = im + k + m;
+            int j = 0;
+
+#ifdef PHASECORRELATION_SSE2
+            // Four butterflies per iteration once a stage is at least four wide
+            const __m128 signVector = _mm_set1_ps(sign);
+            for (; j + 4 <= m; j += 4) {
+                __m128 wr = _mm_loadu_ps(wRe + j);
+                __m128 wi = _mm_mul_ps(_mm_loadu_ps(wIm + j), signVector);
+                __m128 br = _mm_loadu_ps(bottomRe + j);
+                __m128 bi = _mm_loadu_ps(bottomIm + j);
+                __m128 tr = _mm_sub_ps(_mm_mul_ps(br, wr), _mm_mul_ps(bi, wi));
+                __m128 ti = _mm_add_ps(_mm_mul_ps(br, wi), _mm_mul_ps(bi, wr));
+                __m128 ar = _mm_loadu_ps(topRe + j);
+                __m128 ai = _mm_loadu_ps(topIm + j);
+                _mm_storeu_ps(bottomRe + j, _mm_sub_ps(ar, tr));
+                _mm_storeu_ps(bottomIm + j, _mm_sub_ps(ai, ti));
+                _mm_storeu_ps(topRe + j, _mm_add_ps(ar, tr));
+                _mm_storeu_ps(topIm + j, _mm_add_ps(ai, ti));
+            }
+#endif
+            for (; j < m; ++j) {
+                float wr = wRe[j];
+                float wi = wIm[j] * sign;
+                float tr = bottomRe[j] * wr - bottomIm[j] * wi;
+                float ti = bottomRe[j] * wi + bottomIm[j] * wr;
+                bottomRe[j] = topRe[j] - tr;
+                bottomIm[j] = topIm[j] - ti;
+                topRe[j] += tr;
+                topIm[j] += ti;
+            }
+        }
+    }
+}
+
+void PhaseCorrelator::fft2d(float *re, float *im, bool inverse)
+{
+    const int width = planX.size;
+    const int height = planY.size;
+
+    for (int y = 0; y < height; ++y) {
+        fft(re + size_t(y) * width, im + size_t(y) * width, planX, inverse);
+    }
+
+    // Columns become contiguous rows after a transpose
+    transpose(re, columnRe.data(), width, height);
+    transpose(im, columnIm.data(), width, height);
+    for (int x = 0; x < width; ++x) {
+        fft(columnRe.data() + size_t(x) * height, columnIm.data() + size_t(x) * height, planY, inverse);
+    }
+    transpose(columnRe.data(), re, height, width);
+    transpose(columnIm.data(), im, height, width);
+}
+
+void PhaseCorrelator::loadPatch(const float *src, int patchWidth, int patchHeight, int stride,
+                                float *re, float *im)
+{
+    const int width = planX.size;
+    const int height = planY.size;
+    const int usedWidth = std::min(patchWidth, width);
+    const int usedHeight = std::min(patchHeight, height);
+    const float *origin = src + size_t((patchHeight - usedHeight) / 2) * stride + (patchWidth - usedWidth) / 2;
+
+    std::memset(re, 0, sizeof(float) * size_t(width) * height);
+    std::memset(im, 0, sizeof(float) * size_t(width) * height);
+
+    // Zero mean so the DC term does not swamp the correlation
+    double sum = 0.0;
+    for (int y = 0; y < usedHeight; ++y) {
+        const float *row = origin + size_t(y) * stride;
+        for (int x = 0; x < usedWidth; ++x) sum += row[x];
+    }
+    const float mean = static_cast<float>(sum / (double(usedWidth) * usedHeight));
+
+    // Hann window over the used area suppresses the patch edges
+    if (int(windowX.size()) != usedWidth) {
+        windowX.resize(usedWidth);
+        for (int x = 0; x < usedWidth; ++x) {
+            windowX[x] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * Pi * (x + 0.5) / usedWidth));
+        }
+    }
+    if (int(windowY.size()) != usedHeight) {
+        windowY.resize(usedHeight);
+        for (int y = 0; y < usedHeight; ++y) {
+            windowY[y] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * Pi * (y + 0.5) / usedHeight));
+        }
+    }
+
+    for (int y = 0; y < usedHeight; ++y) {
+        const float *row = origin + size_t(y) * stride;
+        float *dst = re + size_t(y) * width;
+        const float wy = windowY[y];
+        int x = 0;
+#ifdef PHASECORRELATION_SSE2
+        const __m128 meanVector = _mm_set1_ps(mean);
+        const __m128 wyVector = _mm_set1_ps(wy);
+        for (; x + 4 <= usedWidth; x += 4) {
+            __m128 value = _mm_sub_ps(_mm_loadu_ps(row + x), meanVector);
+            __m128 weight = _mm_mul_ps(_mm_loadu_ps(windowX.data() + x), wyVector);
+            _mm_storeu_ps(dst + x, _mm_mul_ps(value, weight));
+        }
+#endif
+        for (; x < usedWidth; ++x) {
+            dst[x] = (row[x] - mean) * windowX[x] * wy;
+        }
+    }
+}
+
+void PhaseCorrelator::crossPower(const float *aRe, const float *aIm, float *bRe, float *bIm) const
+{
+    // R = A * conj(B) / |A * conj(B)|, written over B
+    const size_t count = size_t(planX.size) * planY.size;
+    const float epsilon = 1e-12f;
+    size_t i = 0;
+
+#ifdef PHASECORRELATION_SSE2
+    const __m128 epsilonVector = _mm_set1_ps(epsilon);
+    for (; i + 4 <= count; i += 4) {
+        __m128 ar = _mm_loadu_ps(aRe + i);
+        __m128 ai = _mm_loadu_ps(aIm + i);
+        __m128 br = _mm_loadu_ps(bRe + i);
+        __m128 bi = _mm_loadu_ps(bIm + i);
+        __m128 cr = _mm_add_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi));
+        __m128 ci = _mm_sub_ps(_mm_mul_ps(ai, br), _mm_mul_ps(ar, bi));
+        __m128 magnitude = _mm_add_ps(_mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(cr, cr), _mm_mul_ps(ci, ci))),
+                                      epsilonVector);
+        _mm_storeu_ps(bRe + i, _mm_div_ps(cr, magnitude));
+        _mm_storeu_ps(bIm + i, _mm_div_ps(ci, magnitude));
+    }
+#endif
+    for (; i < count; ++i) {
+        float cr = aRe[i] * bRe[i] + aIm[i] * bIm[i];
+        float ci = aIm[i] * bRe[i] - aRe[i] * bIm[i];
+        float magnitude = std::sqrt(cr * cr + ci * ci) + epsilon;
+        bRe[i] = cr / magnitude;
+        bIm[i] = ci / magnitude;
+    }
+}
+
+PhaseCorrelator::Shift PhaseCorrelator::correlate(const float *a, const float *b,
+                                                  int patchWidth, int patchHeight, int stride)
+{
+    Shift shift;
+    if (patchWidth <= 0 || patchHeight <= 0) return shift;
+
+    const int width = planX.size;
+    const int height = planY.size;
+
+    loadPatch(a, patchWidth, patchHeight, stride, aRe.data(), aIm.data());
+    loadPatch(b, patchWidth, patchHeight, stride, bRe.data(), bIm.data());
+
+    fft2d(aRe.data(), aIm.data(), false);
+    fft2d(bRe.data(), bIm.data(), false);
+    crossPower(aRe.data(), aIm.data(), bRe.data(), bIm.data());
+    fft2d(bRe.data(), bIm.data(), true);
+
+    // The correlation surface is real; its maximum sits at the shift
+    const float *surface = bRe.data();
+    size_t best = 0;
+    for (size_t i = 1; i < size_t(width) * height; ++i) {
+        if (surface[i] > surface[best]) best = i;
+    }
+    const int peakX = int(best % width);
+    const int peakY = int(best / width);
+
+    auto at = [&](int x, int y) {
+        x = (x + width) % width;
+        y = (y + height) % height;
+        return surface[size_t(y) * width + x];
+    };
+    const float centre = at(peakX, peakY);
+    float subX = parabolicOffset(at(peakX - 1, peakY), centre, at(peakX + 1, peakY));
+    float subY = parabolicOffset(at(peakX, peakY - 1), centre, at(peakX, peakY + 1));
+
+    // Indices past the midpoint are negative shifts
+    shift.dx = (peakX > width / 2 ? peakX - width : peakX) + subX;
+    shift.dy = (peakY > height / 2 ? peakY - height : peakY) + subY;
+    shift.peak = centre / (float(width) * height);
+    return shift;
+}
@@ -0,0 +1,58 @@
+#ifndef PHASECORRELATION_H
+#define PHASECORRELATION_H
+
+#include <vector>
+
+// Estimates the translation between two greyscale patches with FFT phase
+// correlation. Plain C++ with no Qt types so the kernel can be benchmarked on
+// its own. Butterflies, windowing and the cross-power spectrum use SSE2 where
+// the target has it and equivalent scalar loops everywhere else.
+//
+// A correlator owns its scratch buffers: use one instance per thread.
+class PhaseCorrelator
+{
+public:
+    struct Shift {
+        float dx = 0.0f;
+        float dy = 0.0f;
+        float peak = 0.0f;  // Normalised peak height: ~1 for a clean match, ~0 for noise
+    };
+
+    // FFT size; both dimensions must be powers of two
+    PhaseCorrelator(int fftWidth, int fftHeight);
+
+    int fftWidth() const { return planX.size; }
+    int fftHeight() const { return planY.size; }
+
+    // a and b are patchWidth x patchHeight samples, rows stride floats apart.
+    // Patches larger than the FFT are cropped to their centre, smaller ones are
+    // zero padded. Returns the shift s for which a(x) ~= b(x - s).
+    Shift correlate(const float *a, const float *b,
+                    int patchWidth, int patchHeight, int stride);
+
+    static bool isPowerOfTwo(int n) { return n > 0 && (n & (n - 1)) == 0; }
+    static int nextPowerOfTwo(int n);
+    static bool usesSimd();
+
+private:
+    struct FftPlan {
+        int size = 0;
+        std::vector<int> bitReverse;
+        std::vector<float> twiddleRe;  // Stage with half length m keeps its twiddles at [m, 2m)
+        std::vector<float> twiddleIm;
+    };
+
+    static void buildPlan(FftPlan &plan, int size);
+    static void fft(float *re, float *im, const FftPlan &plan, bool inverse);
+    void fft2d(float *re, float *im, bool inverse);
+    void loadPatch(const float *src, int patchWidth, int patchHeight, int stride, float *re, float *im);
+    void crossPower(const float *aRe, const float *aIm, float *bRe, float *bIm) const;
+
+    FftPlan planX;
+    FftPlan planY;
+    std::vector<float> aRe, aIm, bRe, bIm;
+    std::vector<float> columnRe, columnIm;  // Transposed scratch for the column pass
+    std::vector<float> windowX, windowY;
+};
+
+#endif // PHASECORRELATION_H
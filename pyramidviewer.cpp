@@ -0,0 +1,356 @@
+#include "pyramidviewer.h"
+#include "capturestore.h"
+#include <QFile>
+#include <QFutureWatcher>
+#include <QImageReader>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QWheelEvent>
+#include <QDebug>
+#include <QtConcurrent>
+#include <cmath>
+
+namespace {
+
+const double maximumScale = 4.0;  // Screen pixels per image pixel at full zoom
+const double wheelZoomStep = 1.25;
+
+} // namespace
+
+PyramidViewer::PyramidViewer(QWidget *parent)
+    : QWidget(parent)
+    , zoom(1.0)
+    , dragging(false)
+    , tileCache(64 * 1024)  // 64 MB of decoded tiles
+    , generation(0)
+{
+    // Tiles are small; a couple of decoders keep up with panning
+    loaderPool.setMaxThreadCount(2);
+    setAttribute(Qt::WA_OpaquePaintEvent);
+}
+
+PyramidViewer::~PyramidViewer()
+{
+    loaderPool.waitForDone();
+}
+
+void PyramidViewer::resetContent()
+{
+    ++generation;
+    pyramid = TilePyramid();
+    image = QImage();
+    imageFullSize = QSize();
+    message.clear();
+    overlay = DefectOverlay();
+    tileCache.clear();
+    pendingTiles.clear();
+    zoom = 1.0;
+}
+
+bool PyramidViewer::setSurface(const QString &surfacePath, const QString &name)
+{
+    resetContent();
+
+    if (pyramid.load(surfacePath, name)) {
+        imageFullSize = pyramid.imageSize();
+        resetZoom();
+        return true;
+    }
+
+    // Older surfaces only have the stitched JPEG
+    QString imagePath = QString("%1/%2.jpg").arg(surfacePath).arg(name);
+    if (QFile::exists(imagePath) && setImageFile(imagePath)) {
+        return true;
+    }
+
+    setText(QString("No %1 image available").arg(name));
+    return false;
+}
+
+bool PyramidViewer::setImageFile(const QString &imagePath)
+{
+    if (CaptureStore::isNativeFormat(imagePath)) {
+        // Lossless captures have no Qt plugin; decode them whole
+        QImage decoded = CaptureStore::read(imagePath);
+        if (decoded.isNull()) {
+            setText("Failed to load image");
+            return false;
+        }
+        setImage(decoded);
+        return true;
+    }
+
+    QImageReader reader(imagePath);
+    QSize sourceSize = reader.size();
+
+    // Let the decoder downscale to what the widget can show
+    QSize displaySize = size() * devicePixelRatioF();
+    if (sourceSize.isValid() && !displaySize.isEmpty()
+        && sourceSize.width() > displaySize.width() && sourceSize.height() > displaySize.height()) {
+        reader.setScaledSize(sourceSize.scaled(displaySize, Qt::KeepAspectRatio));
+    }
+
+    QImage decoded = reader.read();
+    if (decoded.isNull()) {
+        qDebug() << "Failed to load preview image:" << imagePath << reader.errorString();
+        setText("Failed to load image");
+        return false;
+    }
+
+    setImage(decoded);
+    if (sourceSize.isValid()) {
+        imageFullSize = sourceSize;
+        resetZoom();
+    }
+    return true;
+}
+
+void PyramidViewer::setImage(const QImage &newImage)
+{
+    // The live preview keeps calling this; only reset the view when the shape changes
+    bool sameShape = !pyramid.isValid() && !image.isNull()
+        && newImage.size() == image.size() && imageFullSize == newImage.size();
+
+    if (!sameShape) {
+        resetContent();
+    }
+    image = newImage;
+    message.clear();
+    if (!sameShape) {
+        imageFullSize = newImage.size();
+        resetZoom();
+    }
+    update();
+}
+
+void PyramidViewer::setText(const QString &text)
+{
+    resetContent();
+    message = text;
+    update();
+}
+
+void PyramidViewer::setOverlay(const DefectOverlay &defects)
+{
+    overlay = defects;
+    update();
+}
+
+QSize PyramidViewer::imageSize() const
+{
+    return imageFullSize;
+}
+
+double PyramidViewer::fitScale() const
+{
+    if (imageFullSize.isEmpty() || width() <= 0 || height() <= 0) return 1.0;
+    return qMin(double(width()) / imageFullSize.width(), double(height()) / imageFullSize.height());
+}
+
+void PyramidViewer::resetZoom()
+{
+    zoom = 1.0;
+    center = QPointF(imageFullSize.width() / 2.0, imageFullSize.height() / 2.0);
+    update();
+}
+
+void PyramidViewer::zoomToRect(const QRectF &imageRect)
+{
+    if (imageFullSize.isEmpty() || imageRect.isEmpty()) return;
+
+    // Leave some context around the region
+    double scale = 0.5 * qMin(width() / imageRect.width(), height() / imageRect.height());
+    zoom = qBound(1.0, scale / fitScale(), maximumScale / fitScale());
+    center = imageRect.center();
+    clampCenter();
+    update();
+}
+
+void PyramidViewer::clampCenter()
+{
+    // Keep the image filling the view along any axis where it is larger than the view
+    double scale = currentScale();
+    double halfWidth = width() / (2.0 * scale);
+    double halfHeight = height() / (2.0 * scale);
+    double imageWidth = imageFullSize.width();
+    double imageHeight = imageFullSize.height();
+
+    center.setX(halfWidth * 2 >= imageWidth ? imageWidth / 2.0
+                                             : qBound(halfWidth, center.x(), imageWidth - halfWidth));
+    center.setY(halfHeight * 2 >= imageHeight ? imageHeight / 2.0
+                                               : qBound(halfHeight, center.y(), imageHeight - halfHeight));
+}
+
+QTransform PyramidViewer::imageToWidget() const
+{
+    double scale = currentScale();
+    QTransform transform;
+    transform.translate(width() / 2.0, height() / 2.0);
+    transform.scale(scale, scale);
+    transform.translate(-center.x(), -center.y());
+    return transform;
+}
+
+void PyramidViewer::paintEvent(QPaintEvent *)
+{
+    QPainter painter(this);
+    painter.fillRect(rect(), Qt::black);
+
+    if (!hasContent()) {
+        painter.setPen(Qt::white);
+        painter.drawText(rect(), Qt::AlignCenter, message);
+        return;
+    }
+
+    QTransform transform = imageToWidget();
+    QRectF visible = transform.inverted().mapRect(QRectF(rect()))
+        .intersected(QRectF(QPointF(0, 0), QSizeF(imageFullSize)));
+
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, zoom < 2.0);
+    painter.setTransform(transform);
+
+    if (pyramid.isValid()) {
+        paintPyramid(painter, visible);
+    } else {
+        painter.drawImage(QRectF(QPointF(0, 0), QSizeF(imageFullSize)), image);
+    }
+
+    if (!overlay.isEmpty()) {
+        painter.setRenderHint(QPainter::Antialiasing);
+        overlay.paint(painter, transform);
+    }
+}
+
+void PyramidViewer::paintPyramid(QPainter &painter, const QRectF &visible)
+{
+    const int level = pyramid.levelForScale(currentScale() * devicePixelRatioF());
+    const double factor = std::pow(2.0, level);  // Full resolution pixels per level pixel
+    const int tileSize = pyramid.tileSize();
+    const QSize levelSize = pyramid.levelSize(level);
+
+    const int firstCol = qMax(0, int(visible.left() / factor) / tileSize);
+    const int firstRow = qMax(0, int(visible.top() / factor) / tileSize);
+    const int lastCol = qMin((levelSize.width() - 1) / tileSize, int(visible.right() / factor) / tileSize);
+    const int lastRow = qMin((levelSize.height() - 1) / tileSize, int(visible.bottom() / factor) / tileSize);
+
+    for (int row = firstRow; row <= lastRow; ++row) {
+        for (int col = firstCol; col <= lastCol; ++col) {
+            QImage *tile = tileCache.object(tileKey(level, col, row));
+            if (tile) {
+                QRectF tileRect = pyramid.tileRect(level, col, row);
+                painter.drawImage(QRectF(tileRect.topLeft() * factor, tileRect.size() * factor), *tile);
+                continue;
+            }
+
+            requestTile(level, col, row);
+            paintFallback(painter, level, col, row);
+        }
+    }
+}
+
+void PyramidViewer::paintFallback(QPainter &painter, int level, int col, int row)
+{
+    // Stretch the part of a cached coarser tile that covers this one
+    for (int coarser = level + 1; coarser < pyramid.levelCount(); ++coarser) {
+        int shift = coarser - level;
+        QImage *tile = tileCache.object(tileKey(coarser, col >> shift, row >> shift));
+        if (!tile) continue;
+
+        const double factor = std::pow(2.0, level);
+        const double coarserFactor = std::pow(2.0, coarser);
+        QRectF target = pyramid.tileRect(level, col, row);
+        target = QRectF(target.topLeft() * factor, target.size() * factor);
+
+        QRectF coarserTile = pyramid.tileRect(coarser, col >> shift, row >> shift);
+        QRectF source(target.topLeft() / coarserFactor - coarserTile.topLeft(), target.size() / coarserFactor);
+        painter.drawImage(target, *tile, source.intersected(QRectF(QPointF(0, 0), QSizeF(tile->size()))));
+        return;
+    }
+}
+
+void PyramidViewer::requestTile(int level, int col, int row)
+{
+    const QString key = tileKey(level, col, row);
+    if (pendingTiles.contains(key)) return;
+    pendingTiles.insert(key);
+
+    const quint64 requestGeneration = generation;
+    const QString path = pyramid.tilePath(level, col, row);
+
+    auto *watcher = new QFutureWatcher<QImage>(this);
+    connect(watcher, &QFutureWatcher<QImage>::finished, this, [this, watcher, key, requestGeneration]() {
+        QImage tile = watcher->result();
+        watcher->deleteLater();
+        if (requestGeneration != generation) return;  // Content changed meanwhile
+
+        pendingTiles.remove(key);
+        if (tile.isNull()) return;
+
+        int costKb = qMax<qsizetype>(1, tile.sizeInBytes() / 1024);
+        tileCache.insert(key, new QImage(tile), costKb);
+        update();
+    });
+    watcher->setFuture(QtConcurrent::run(&loaderPool, [path]() { return QImage(path); }));
+}
+
+QString PyramidViewer::tileKey(int level, int col, int row)
+{
+    return QString("%1/%2_%3").arg(level).arg(col).arg(row);
+}
+
+void PyramidViewer::wheelEvent(QWheelEvent *event)
+{
+    if (!hasContent()) return;
+
+    // Zoom around the cursor: the image point under it stays put
+    QPointF cursor = event->position();
+    QPointF anchor = imageToWidget().inverted().map(cursor);
+
+    double steps = event->angleDelta().y() / 120.0;
+    double newZoom = qBound(1.0, zoom * std::pow(wheelZoomStep, steps), qMax(1.0, maximumScale / fitScale()));
+    if (qFuzzyCompare(newZoom, zoom)) return;
+    zoom = newZoom;
+
+    double scale = currentScale();
+    center = anchor - (cursor - QPointF(width() / 2.0, height() / 2.0)) / scale;
+    clampCenter();
+    update();
+    event->accept();
+}
+
+void PyramidViewer::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() == Qt::LeftButton && zoom > 1.0) {
+        dragging = true;
+        lastDragPos = event->pos();
+        setCursor(Qt::ClosedHandCursor);
+    }
+    QWidget::mousePressEvent(event);
+}
+
+void PyramidViewer::mouseMoveEvent(QMouseEvent *event)
+{
+    if (dragging) {
+        QPoint delta = event->pos() - lastDragPos;
+        lastDragPos = event->pos();
+        center -= QPointF(delta) / currentScale();
+        clampCenter();
+        update();
+    }
+    QWidget::mouseMoveEvent(event);
+}
+
+void PyramidViewer::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (dragging && event->button() == Qt::LeftButton) {
+        dragging = false;
+        unsetCursor();
+    }
+    QWidget::mouseReleaseEvent(event);
+}
+
+void PyramidViewer::mouseDoubleClickEvent(QMouseEvent *event)
+{
+    resetZoom();
+    QWidget::mouseDoubleClickEvent(event);
+}
@@ -0,0 +1,86 @@
+#ifndef PYRAMIDVIEWER_H
+#define PYRAMIDVIEWER_H
+
+#include <QWidget>
+#include <QCache>
+#include <QImage>
+#include <QPointF>
+#include <QRectF>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+#include <QTransform>
+#include "tilepyramid.h"
+#include "defectoverlay.h"
+
+// Zoomable view of a stitched surface. With a tile pyramid it decodes only
+// the tiles that are visible, at the level matching the current zoom, on a
+// background pool; coarser cached tiles stand in until they arrive. Plain
+// images (single captures, the live stitch preview) are shown the same way.
+//
+// Wheel zooms around the cursor, drag pans, double-click fits the image.
+class PyramidViewer : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit PyramidViewer(QWidget *parent = nullptr);
+    ~PyramidViewer();
+
+    // Shows <surface>/<name>_pyramid.json, or a reduced decode of <name>.jpg
+    // for surfaces stitched before pyramids existed. Returns false if neither exists.
+    bool setSurface(const QString &surfacePath, const QString &name = "stitched");
+    bool setImageFile(const QString &imagePath);  // Decoded at roughly the widget size
+    void setImage(const QImage &image);
+    void setText(const QString &message);
+    void clear() { setText(QString()); }
+
+    // Drawn over the content in image coordinates; cleared whenever the content changes
+    void setOverlay(const DefectOverlay &defects);
+    void clearOverlay() { setOverlay(DefectOverlay()); }
+
+    void zoomToRect(const QRectF &imageRect);  // In full resolution image pixels
+    void resetZoom();
+
+    bool hasContent() const { return pyramid.isValid() || !image.isNull(); }
+    QSize imageSize() const;
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void mouseDoubleClickEvent(QMouseEvent *event) override;
+
+    // Maps full resolution image pixels to widget coordinates
+    QTransform imageToWidget() const;
+
+private:
+    void resetContent();
+    double fitScale() const;
+    double currentScale() const { return fitScale() * zoom; }
+    void clampCenter();
+    void paintPyramid(QPainter &painter, const QRectF &visible);
+    void paintFallback(QPainter &painter, int level, int col, int row);
+    void requestTile(int level, int col, int row);
+    static QString tileKey(int level, int col, int row);
+
+    TilePyramid pyramid;
+    QImage image;         // Plain image content; may be smaller than imageFullSize
+    QSize imageFullSize;  // Coordinate space of the content
+    QString message;
+    DefectOverlay overlay;
+
+    double zoom;          // 1 = whole image fits the widget
+    QPointF center;       // Image point shown in the middle of the widget
+    QPoint lastDragPos;
+    bool dragging;
+
+    QCache<QString, QImage> tileCache;  // Cost in KB
+    QSet<QString> pendingTiles;
+    QThreadPool loaderPool;
+    quint64 generation;  // Bumped on content change so stale tile loads are dropped
+};
+
+#endif // PYRAMIDVIEWER_H
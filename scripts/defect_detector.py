@@ -1,7 +1,9 @@
 import sys
 import traceback
 import os
+import argparse
 import json
+import heapq
 import numpy as np
 import cv2
 from ultralytics import YOLO
@@ -10,89 +12,414 @@ from queue import Queue, Empty
 import threading
 import time
 
-# Global queue for detection requests
-detection_queue = Queue()
-processing_thread = None
+# Protocol: one JSON object per line in both directions.
+#
+#   requests  (stdin):  {"id": 7, "cmd": "detect", "path": "/.../image_01.jpg",
+#                        "shm": {"name": "/cardqt_..._frames_0", "offset": 0, "width": 1920,
+#                                "height": 1080, "stride": 5760, "format": "rgb888"},
+#                        "crop": [410, 151, 1100, 778], "priority": 1}
+#                       {"cmd": "detect_batch", "items": [{"id": 8, "path": ..., "shm": ...}, ...]}
+#                       {"cmd": "prioritize", "ids": [7, 8], "priority": 0}
+#                       {"cmd": "cancel", "ids": [7, 8]}
+#   responses (stdout): {"type": "ready"}
+#                       {"type": "fatal", "message": "..."}
+#                       {"type": "queued" | "started" | "cancelled", "id": 7, "path": "..."}
+#                       {"type": "result", "id": 7, "path": "...", "detections": [...], ...}
+#                       {"type": "error", "id": 7, "path": "...", "message": "..."}
+#                       {"type": "log", "level": "status" | "info" | "warning" | "error", "message": "..."}
+#
+# The real stdout is reserved for the protocol; sys.stdout is pointed at stderr
+# so that anything printed by libraries (YOLO logs every inference) cannot
+# break a frame.
+#
+# "shm" is optional. When present the decoded frame is read straight out of the
+# application's shared memory ring and the path only names where results go;
+# the slot stays reserved until this request's result or error is sent.
+#
+# "crop" is optional too: [x, y, width, height] of the capture to run on, the
+# part the stitcher keeps. Detections are then relative to the crop, and the
+# results file records it. A shared frame already holds only the crop.
+#
+# Requests are run in batches: once one is waiting, the worker collects up to
+# --max-batch of them for at most --max-wait-ms and runs a single forward pass.
+# Every image still gets its own result or error frame. detect_batch is only a
+# way to submit a surface's tiles in one line; its items are queued like
+# detect requests.
+#
+# Waiting requests are taken highest "priority" first (default 0), in arrival
+# order within a priority. "prioritize" changes the priority of requests that
+# are still waiting. "cancel" drops requests: one still waiting, or caught
+# before it reaches the model, is answered with "cancelled" instead of a
+# result. One already past the model is finished and answered as usual.
+#
+# Each request goes through four stages, each on its own thread: decode (file
+# or shared frame to a BGR array), preprocess (letterbox to the model input),
+# inference (batched forward pass) and write (save, answer). The
+# queues between them are small, so the model runs on one batch while the next
+# is decoded and the last is written, and a slow stage holds back the ones
+# before it rather than piling up frames. Per-stage timings are logged as
+# status lines after every batch.
+#
+# Only the detections are written unless --annotate is given; then the write
+# stage also renders <image>_detected.jpg with the boxes burnt in. The
+# application draws the boxes over the capture itself, so that copy is only
+# for tools that want a flat image.
+protocol_out = os.fdopen(os.dup(sys.stdout.fileno()), 'w', encoding='utf-8')
+sys.stdout = sys.stderr
+protocol_lock = threading.Lock()
+
+class RequestQueue:
+    """Requests waiting to be decoded, highest priority first. Unlike
+    queue.PriorityQueue, a waiting request can be reprioritized or taken out;
+    the heap entry it leaves behind is emptied and skipped."""
+
+    def __init__(self):
+        self.heap = []
+        self.entries = {}     # Request id -> [-priority, sequence, job]
+        self.sequence = 0
+        self.condition = threading.Condition()
+
+    def _push(self, job):
+        entry = [-job.priority, self.sequence, job]
+        self.sequence += 1
+        self.entries[job.id] = entry
+        heapq.heappush(self.heap, entry)
+
+    def put(self, job):
+        with self.condition:
+            self._push(job)
+            self.condition.notify()
+
+    def get(self, timeout):
+        deadline = time.monotonic() + timeout
+        with self.condition:
+            while True:
+                while self.heap:
+                    job = heapq.heappop(self.heap)[2]
+                    if job is not None:
+                        del self.entries[job.id]
+                        return job
+                remaining = deadline - time.monotonic()
+                if remaining <= 0:
+                    raise Empty
+                self.condition.wait(remaining)
+
+    def task_done(self):
+        pass
+
+    def reprioritize(self, ids, priority):
+        with self.condition:
+            for request_id in ids:
+                entry = self.entries.pop(request_id, None)
+                if entry is None:
+                    continue
+                job, entry[2] = entry[2], None
+                job.priority = priority
+                self._push(job)
+
+    def remove(self, ids):
+        removed = []
+        with self.condition:
+            for request_id in ids:
+                entry = self.entries.pop(request_id, None)
+                if entry is not None:
+                    removed.append(entry[2])
+                    entry[2] = None
+        return removed
+
+# Requests wait here unbounded, so reading stdin never blocks; the queues
+# between stages are bounded in start_pipeline()
+detection_queue = RequestQueue()
+decoded_queue = None
+prepared_queue = None
+written_queue = None
+pipeline_threads = []
 should_stop = False
 
-def process_queue(model):
-    global should_stop
+# Ids queued and not answered yet, and those of them cancelled after they
+# left detection_queue; a cancelled one is dropped at the next stage
+pending_ids = set()
+cancelled_ids = set()
+cancelled_lock = threading.Lock()
+
+def send(message_type, **fields):
+    fields['type'] = message_type
+    line = json.dumps(fields)
+    with protocol_lock:
+        protocol_out.write(line + '\n')
+        protocol_out.flush()
+
+def log(level, message):
+    send('log', level=level, message=message)
+
+# Batch limits, model input size, torch threads and annotation, set from the
+# command line
+max_batch = 8
+max_wait = 0.02
+input_size = 640
+intra_op_threads = 0
+write_annotated = False
+
+STAGES = ('decode', 'preprocess', 'inference', 'write')
+
+class Job:
+    """One request on its way through the pipeline."""
+    __slots__ = ('id', 'path', 'frame', 'crop', 'priority', 'source', 'input', 'scale', 'pad',
+                 'detections', 'queued_at', 'timings')
+
+    def __init__(self, request_id, image_path, frame, crop, priority=0):
+        self.id = request_id
+        self.path = image_path
+        self.frame = frame        # Shared memory descriptor, or None
+        self.crop = crop
+        self.priority = priority
+        self.source = None        # BGR array detections refer to
+        self.input = None         # Letterboxed model input
+        self.scale = 1.0
+        self.pad = (0, 0)
+        self.detections = None
+        self.queued_at = time.perf_counter()
+        self.timings = {}         # Stage name -> seconds
+
+def next_batch(source):
+    """Blocks for the first job, then gathers more until the batch is full
+    or max_wait has passed since the first one arrived."""
+    try:
+        batch = [source.get(timeout=1.0)]
+    except Empty:
+        return []
+    deadline = time.monotonic() + max_wait
+    while len(batch) < max_batch:
+        remaining = deadline - time.monotonic()
+        try:
+            batch.append(source.get(timeout=remaining) if remaining > 0
+                         else source.get_nowait())
+        except Empty:
+            break
+    return batch
+
+def wait_for_file(image_path):
+    # Captures are written atomically, so once the file exists it is complete
+    max_retries = 10
+    retry_count = 0
+    while retry_count < max_retries:
+        if os.path.exists(image_path) and os.path.getsize(image_path) > 0:
+            return True
+        time.sleep(0.2)
+        retry_count += 1
+    return False
+
+def load_source(image_path, frame, crop):
+    """Returns a BGR array for one request, from shared memory or from disk,
+    cut down to crop if one was asked for."""
+    if frame is not None:
+        return read_shared_frame(frame)
+    if not wait_for_file(image_path):
+        raise FileNotFoundError(f'Timeout waiting for image file: {image_path}')
+    source = load_capture(image_path)
+    if isinstance(source, str):
+        # Decode here so the whole batch is arrays; YOLO runs a list of
+        # arrays as one batch but streams a list of paths one by one
+        source = cv2.imread(source)
+        if source is None:
+            raise ValueError(f'Could not decode {image_path}')
+    if crop:
+        x, y, width, height = crop
+        source = np.ascontiguousarray(source[y:y + height, x:x + width])
+    return source
+
+def letterbox(image, size):
+    """Scales image to fit a size x size square and pads it with grey, as YOLO
+    does, so the model's own letterbox is a no-op. Returns the input with the
+    scale and (left, top) padding needed to map boxes back."""
+    height, width = image.shape[:2]
+    scale = min(size / height, size / width)
+    new_width, new_height = round(width * scale), round(height * scale)
+    if (new_width, new_height) != (width, height):
+        image = cv2.resize(image, (new_width, new_height), interpolation=cv2.INTER_LINEAR)
+    pad_x, pad_y = (size - new_width) / 2, (size - new_height) / 2
+    left, right = round(pad_x - 0.1), round(pad_x + 0.1)
+    top, bottom = round(pad_y - 0.1), round(pad_y + 0.1)
+    image = cv2.copyMakeBorder(image, top, bottom, left, right, cv2.BORDER_CONSTANT,
+                               value=(114, 114, 114))
+    return image, scale, (left, top)
+
+def decode(job):
+    job.source = load_source(job.path, job.frame, job.crop)
+
+def preprocess(job):
+    job.input, job.scale, job.pad = letterbox(job.source, input_size)
+
+def enqueue(job):
+    with cancelled_lock:
+        pending_ids.add(job.id)
+    detection_queue.put(job)
+    send('queued', id=job.id, path=job.path)
+
+def answered(job):
+    """Forgets a job once it is answered, whichever way."""
+    with cancelled_lock:
+        pending_ids.discard(job.id)
+        cancelled_ids.discard(job.id)
+
+def cancel(ids):
+    removed = detection_queue.remove(ids)
+    for job in removed:
+        answered(job)
+        send('cancelled', id=job.id, path=job.path)
+    # The rest are somewhere in the pipeline, or already answered and forgotten
+    with cancelled_lock:
+        cancelled_ids.update((set(ids) - {job.id for job in removed}) & pending_ids)
+
+def take_cancelled(job):
+    """Answers and returns True if job was cancelled after it was queued."""
+    with cancelled_lock:
+        if job.id not in cancelled_ids:
+            return False
+    answered(job)
+    send('cancelled', id=job.id, path=job.path)
+    return True
+
+def run_stage(name, work, source, sink):
+    """Runs work on every job from source and passes it on to sink. A job that
+    fails is answered with an error here and goes no further."""
     while not should_stop:
         try:
-            # Get item from queue with timeout
-            try:
-                image_path = detection_queue.get(timeout=1.0)
-            except Empty:
-                continue
-
-            # Wait for the image to be fully written
-            max_retries = 10
-            retry_count = 0
-            while retry_count < max_retries:
-                if os.path.exists(image_path) and os.path.getsize(image_path) > 0:
-                    # Add a small delay to ensure file is fully written
-                    time.sleep(0.1)
-                    break
-                time.sleep(0.2)
-                retry_count += 1
-
-            if retry_count >= max_retries:
-                print(f'[ERROR] Timeout waiting for image file: {image_path}')
-                sys.stdout.flush()
-                continue
-
-            print(f'[STATUS] Processing image: {image_path}')
-            sys.stdout.flush()
-            
-            detections, annotated_img = detect_defects(model, image_path)
-            if detections is not None and annotated_img is not None:
-                save_detection_results(image_path, detections, annotated_img)
-
-            detection_queue.task_done()
+            job = source.get(timeout=1.0)
+        except Empty:
+            continue
+        if take_cancelled(job):
+            source.task_done()
+            continue
+        start = time.perf_counter()
+        try:
+            work(job)
+        except Exception as e:
+            answered(job)
+            send('error', id=job.id, path=job.path, message=str(e))
+            continue
+        finally:
+            source.task_done()
+        job.timings[name] = time.perf_counter() - start
+        sink.put(job)
+
+def run_inference(model):
+    if intra_op_threads > 0:
+        # Set from this thread: with OpenMP the count is per calling thread
+        import torch
+        torch.set_num_threads(intra_op_threads)
+
+    while not should_stop:
+        # Stale work goes no further than this
+        batch = [job for job in next_batch(prepared_queue) if not take_cancelled(job)]
+        if not batch:
+            continue
 
+        for job in batch:
+            send('started', id=job.id, path=job.path)
+
+        try:
+            start = time.perf_counter()
+            outputs = detect_defects(model, batch)
+            share = (time.perf_counter() - start) / len(batch)
         except Exception as e:
-            print(f'[ERROR] Error in processing thread: {str(e)}')
-            print('[ERROR] Traceback:')
-            print(traceback.format_exc())
-            sys.stdout.flush()
+            for job in batch:
+                answered(job)
+                send('error', id=job.id, path=job.path, message=str(e))
+            log('error', traceback.format_exc())
+            continue
+
+        for job, detections in zip(batch, outputs):
+            job.input = None
+            job.detections = detections
+            job.timings['inference'] = share
+        written_queue.put(batch)
+
+def write_results():
+    while not should_stop:
+        try:
+            batch = written_queue.get(timeout=1.0)
+        except Empty:
+            continue
+
+        for job in batch:
+            start = time.perf_counter()
+            try:
+                annotated_img = annotate(job.source, job.detections) if write_annotated else None
+                files = save_detection_results(job.path, job.detections, annotated_img, job.crop)
+                job.timings['write'] = time.perf_counter() - start
+                # Cancelled too late to matter, if at all
+                answered(job)
+                send('result', id=job.id, path=job.path, detections=job.detections, **files)
+            except Exception as e:
+                answered(job)
+                send('error', id=job.id, path=job.path, message=str(e))
+                log('error', traceback.format_exc())
+            job.source = None
+        log_timings(batch)
+
+def log_timings(batch):
+    """One status line per batch: mean time per image in each stage, and
+    from being queued to being answered."""
+    done = [job for job in batch if len(job.timings) == len(STAGES)]
+    if not done:
+        return
+    stages = ', '.join(f'{name} {sum(job.timings[name] for job in done) * 1000 / len(done):.0f}'
+                       for name in STAGES)
+    latency_ms = sum(time.perf_counter() - job.queued_at for job in done) * 1000 / len(done)
+    log('status', f'Batch of {len(batch)}: {stages} ms per image; '
+                  f'{latency_ms:.0f} ms from queue to result')
+
+def start_pipeline(model):
+    global decoded_queue, prepared_queue, written_queue
+    # Enough decoded ahead for the next batch, not more
+    decoded_queue = Queue(maxsize=max_batch)
+    prepared_queue = Queue(maxsize=max_batch * 2)
+    written_queue = Queue(maxsize=2)
+
+    stages = [
+        (run_stage, ('decode', decode, detection_queue, decoded_queue)),
+        (run_stage, ('preprocess', preprocess, decoded_queue, prepared_queue)),
+        (run_inference, (model,)),
+        (write_results, ()),
+    ]
+    for target, args in stages:
+        thread = threading.Thread(target=target, args=args, daemon=True)
+        thread.start()
+        pipeline_threads.append(thread)
 
 def initialize_model():
     try:
-        print('[STATUS] Starting model initialization...')
-        sys.stdout.flush()
-        
+        log('status', 'Starting model initialization...')
+
         model_path = os.path.join(os.getcwd(), 'model', 'best.pt')
-        print(f'[STATUS] Looking for model at: {model_path}')
-        sys.stdout.flush()
-        
+        log('status', f'Looking for model at: {model_path}')
+
         if not os.path.exists(model_path):
-            print(f'[ERROR] Model not found at {model_path}')
-            print('[ERROR] Please ensure the model file exists in the model directory')
-            sys.stdout.flush()
+            send('fatal', message=f'Model not found at {model_path}. '
+                                  'Please ensure the model file exists in the model directory')
             sys.exit(1)
-        
-        print('[STATUS] Found model file, loading YOLO...')
-        sys.stdout.flush()
-        
+
+        log('status', 'Found model file, loading YOLO...')
+
         model = YOLO(model_path)
-        
+
         # Perform a warmup inference on a blank image
-        print('[STATUS] Performing warmup inference...')
-        sys.stdout.flush()
-        
+        log('status', 'Performing warmup inference...')
+
         # Create a small blank image for warmup
         warmup_img = np.zeros((640, 640, 3), dtype=np.uint8)
         warmup_path = os.path.join(os.getcwd(), 'warmup.jpg')
         cv2.imwrite(warmup_path, warmup_img)
-        
+
         try:
             # Run inference on warmup image
             model(warmup_path)
             # Remove warmup image
             os.remove(warmup_path)
-            print('[STATUS] Warmup inference completed')
+            log('status', 'Warmup inference completed')
         except Exception as we:
-            print(f'[WARNING] Warmup inference failed: {str(we)}')
+            log('warning', f'Warmup inference failed: {str(we)}')
         finally:
             # Try to remove warmup image if it still exists
             if os.path.exists(warmup_path):
@@ -100,149 +427,240 @@ def initialize_model():
                     os.remove(warmup_path)
                 except:
                     pass
-        
-        print('[SUCCESS] Model loaded successfully and ready for inference!')
-        sys.stdout.flush()
+
+        log('status', 'Model loaded successfully and ready for inference!')
         return model
+    except SystemExit:
+        raise
     except Exception as e:
-        print(f'[ERROR] Error initializing model: {str(e)}')
-        print('[ERROR] Traceback:')
-        print(traceback.format_exc())
-        sys.stdout.flush()
+        send('fatal', message=f'Error initializing model: {str(e)}')
+        log('error', traceback.format_exc())
         sys.exit(1)
 
-def detect_defects(model, image_path):
-    try:
-        # Run detection
-        results = model(image_path)
-        result = results[0]  # Get first image result
-        
-        # Define class names
-        class_names = ['damage', 'edge', 'mark', 'oil']
-        
-        # Process detections
-        detections = []
-        for box in result.boxes:
-            x1, y1, x2, y2 = map(int, box.xyxy[0].tolist())  # Convert to integers
-            width = x2 - x1
-            height = y2 - y1
-            class_id = int(box.cls)
-            detection = {
-                'xyxy': [x1, y1, x2, y2],
-                'confidence': float(box.conf) * 100,  # Convert to percentage
-                'class_id': class_id,
-                'class_name': class_names[class_id],  # Use correct class name from list
-                'width': width,
-                'height': height,
-                'area': width * height,
-                'center_x': (x1 + x2) // 2,
-                'center_y': (y1 + y2) // 2
-            }
-            detections.append(detection)
-        
-        # Use YOLO's built-in visualization
-        annotated_img = result.plot()
-        
-        return detections, annotated_img
-        
-    except Exception as e:
-        print(f'[ERROR] Error during detection: {str(e)}')
-        print('[ERROR] Traceback:')
-        print(traceback.format_exc())
-        sys.stdout.flush()
-        return None, None
+RAW_HEADER_SIZE = 24
 
-def save_detection_results(image_path, detections, annotated_img):
-    try:
-        # Get the directory and base filename
-        dir_path = os.path.dirname(image_path)
-        base_name = os.path.splitext(os.path.basename(image_path))[0]
-        
-        # Save annotated image
+def load_capture(image_path):
+    """Returns what YOLO should read: the path for JPEG captures, a BGR array
+    for the lossless QOI and raw capture formats written by CaptureStore."""
+    ext = os.path.splitext(image_path)[1].lower()
+    if ext == '.raw':
+        # 'CQRW', then little-endian u32 version, width, height, channels, bytes per line
+        with open(image_path, 'rb') as f:
+            data = f.read()
+        if data[:4] != b'CQRW':
+            raise ValueError(f'Not a raw capture: {image_path}')
+        version, width, height, channels, stride = np.frombuffer(data, dtype='<u4', count=5, offset=4)
+        if version != 1 or channels != 3:
+            raise ValueError(f'Unsupported raw capture: {image_path}')
+        rows = np.frombuffer(data, dtype=np.uint8, count=int(stride) * int(height), offset=RAW_HEADER_SIZE)
+        rgb = rows.reshape(int(height), int(stride))[:, :int(width) * 3].reshape(int(height), int(width), 3)
+        return np.ascontiguousarray(rgb[:, :, ::-1])
+    if ext == '.qoi':
+        # Pillow reads QOI since 9.5; OpenCV does not
+        from PIL import Image
+        with Image.open(image_path) as img:
+            rgb = np.asarray(img.convert('RGB'))
+        return np.ascontiguousarray(rgb[:, :, ::-1])
+    return image_path
+
+# Shared memory segments mapped so far, by name; the application keeps one
+# segment for its lifetime, so this normally holds a single entry
+shared_segments = {}
+
+def map_shared_segment(name):
+    segment = shared_segments.get(name)
+    if segment is None:
+        from multiprocessing import shared_memory
+        try:
+            # The application owns and unlinks the segment
+            segment = shared_memory.SharedMemory(name=name.lstrip('/'), track=False)
+        except TypeError:
+            # Python < 3.13 has no track argument; keep the resource tracker
+            # from unlinking the segment when this process exits
+            from multiprocessing import resource_tracker
+            segment = shared_memory.SharedMemory(name=name.lstrip('/'))
+            resource_tracker.unregister(segment._name, 'shared_memory')
+        shared_segments[name] = segment
+    return segment
+
+def read_shared_frame(frame):
+    """Copies a frame out of the application's shared memory ring as a BGR
+    array, so the slot can be reused as soon as the request is answered."""
+    if frame.get('format') != 'rgb888':
+        raise ValueError(f'Unsupported shared frame format: {frame.get("format")}')
+    segment = map_shared_segment(frame['name'])
+    width, height, stride = int(frame['width']), int(frame['height']), int(frame['stride'])
+    rgb = np.ndarray((height, width, 3), dtype=np.uint8, buffer=segment.buf,
+                     offset=int(frame['offset']), strides=(stride, 3, 1))
+    return rgb[:, :, ::-1].copy()
+
+# Class names by model class id
+CLASS_NAMES = ['damage', 'edge', 'mark', 'oil']
+
+def detect_defects(model, jobs):
+    """Runs one forward pass over the jobs' letterboxed inputs and returns the
+    detections for each job, in its source's coordinates."""
+    results = model([job.input for job in jobs], batch=len(jobs), imgsz=input_size)
+    return [collect_detections(result, job) for job, result in zip(jobs, results)]
+
+def collect_detections(result, job):
+    height, width = job.source.shape[:2]
+    left, top = job.pad
+
+    detections = []
+    for box in result.boxes:
+        # Undo the letterbox, clipped to the source
+        x1, y1, x2, y2 = box.xyxy[0].tolist()
+        x1 = int(min(max((x1 - left) / job.scale, 0), width))
+        x2 = int(min(max((x2 - left) / job.scale, 0), width))
+        y1 = int(min(max((y1 - top) / job.scale, 0), height))
+        y2 = int(min(max((y2 - top) / job.scale, 0), height))
+        box_width = x2 - x1
+        box_height = y2 - y1
+        class_id = int(box.cls)
+        detection = {
+            'xyxy': [x1, y1, x2, y2],
+            'confidence': float(box.conf) * 100,  # Convert to percentage
+            'class_id': class_id,
+            'class_name': CLASS_NAMES[class_id],
+            'width': box_width,
+            'height': box_height,
+            'area': box_width * box_height,
+            'center_x': (x1 + x2) // 2,
+            'center_y': (y1 + y2) // 2
+        }
+        detections.append(detection)
+
+    return detections
+
+def annotate(image, detections):
+    """Draws the detections over the source the way YOLO's result.plot()
+    does; the model only saw the letterboxed copy."""
+    from ultralytics.utils.plotting import Annotator, colors
+    annotator = Annotator(image)
+    for detection in detections:
+        label = f"{detection['class_name']} {detection['confidence'] / 100:.2f}"
+        annotator.box_label(detection['xyxy'], label, color=colors(detection['class_id'], True))
+    return annotator.result()
+
+def save_detection_results(image_path, detections, annotated_img=None, crop=None):
+    # Get the directory and base filename
+    dir_path = os.path.dirname(image_path)
+    base_name = os.path.splitext(os.path.basename(image_path))[0]
+    files = {}
+
+    # Save annotated image, if one was rendered
+    if annotated_img is not None:
         output_image_path = os.path.join(dir_path, f'{base_name}_detected.jpg')
         cv2.imwrite(output_image_path, annotated_img)
-        
-        # Save detection data
-        detection_data = {
-            'timestamp': datetime.now().isoformat(),
-            'image_file': os.path.basename(image_path),
-            'detections': detections
-        }
-        
-        output_json_path = os.path.join(dir_path, f'{base_name}_detections.json')
-        with open(output_json_path, 'w') as f:
-            json.dump(detection_data, f, indent=2)
-            
-        print(f'[SUCCESS] Detection results saved for {os.path.basename(image_path)}')
-        print(f'[INFO] Found {len(detections)} defects')
-        for det in detections:
-            print(f'[INFO] {det["class_name"]}: {det["confidence"]:.2f}')
-        sys.stdout.flush()
-        
-        return True
-        
-    except Exception as e:
-        print(f'[ERROR] Error saving detection results: {str(e)}')
-        print('[ERROR] Traceback:')
-        print(traceback.format_exc())
-        sys.stdout.flush()
-        return False
+        files['detected_image'] = output_image_path
+
+    # Save detection data; the stitcher and session loading still read it
+    detection_data = {
+        'timestamp': datetime.now().isoformat(),
+        'image_file': os.path.basename(image_path),
+        'detections': detections
+    }
+    if crop:
+        # Detections are relative to this region of the capture
+        x, y, width, height = crop
+        detection_data['crop'] = {'x': x, 'y': y, 'width': width, 'height': height}
+
+    output_json_path = os.path.join(dir_path, f'{base_name}_detections.json')
+    with open(output_json_path, 'w') as f:
+        json.dump(detection_data, f, indent=2)
+
+    log('info', f'Found {len(detections)} defects in {os.path.basename(image_path)}')
+    files['detections_file'] = output_json_path
+    return files
 
-def process_command(model, command):
+def process_command(model, line):
     try:
-        cmd_parts = command.strip().split()
-        if not cmd_parts:
+        line = line.strip()
+        if not line:
             return
-            
-        cmd = cmd_parts[0]
-        
+
+        try:
+            request = json.loads(line)
+        except ValueError:
+            log('error', f'Malformed request: {line}')
+            return
+
+        request_id = request.get('id')
+        cmd = request.get('cmd')
+
         if cmd == 'detect':
-            if len(cmd_parts) < 2:
-                print('[ERROR] Missing image path for detect command')
-                sys.stdout.flush()
+            image_path = request.get('path')
+            if not image_path:
+                send('error', id=request_id, path='', message='Missing image path for detect command')
                 return
-                
-            image_path = ' '.join(cmd_parts[1:])  # Handle paths with spaces
-            
+
             # Add to detection queue instead of processing immediately
-            detection_queue.put(image_path)
-            print(f'[STATUS] Queued image for detection: {image_path}')
-            sys.stdout.flush()
-            
+            enqueue(Job(request_id, image_path, request.get('shm'), request.get('crop'),
+                        request.get('priority', 0)))
+
+        elif cmd == 'detect_batch':
+            # Queued back to back, well inside the batch window, so they run together
+            items = request.get('items') or []
+            for item in items:
+                item_id = item.get('id')
+                image_path = item.get('path')
+                if not image_path:
+                    send('error', id=item_id, path='', message='Missing image path for detect command')
+                    continue
+                enqueue(Job(item_id, image_path, item.get('shm'), item.get('crop'),
+                                item.get('priority', 0)))
+
+        elif cmd == 'prioritize':
+            detection_queue.reprioritize(request.get('ids') or [], request.get('priority', 0))
+
+        elif cmd == 'cancel':
+            cancel(request.get('ids') or [])
+
         else:
-            print(f'[ERROR] Unknown command: {cmd}')
-            sys.stdout.flush()
-            
+            send('error', id=request_id, path='', message=f'Unknown command: {cmd}')
+
     except Exception as e:
-        print(f'[ERROR] Error processing command: {str(e)}')
-        print('[ERROR] Traceback:')
-        print(traceback.format_exc())
-        sys.stdout.flush()
+        log('error', f'Error processing command: {str(e)}')
+        log('error', traceback.format_exc())
 
 if __name__ == '__main__':
-    print('[STATUS] Python script started')
-    sys.stdout.flush()
-    
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--max-batch', type=int, default=max_batch,
+                        help='Most images run in one forward pass')
+    parser.add_argument('--max-wait-ms', type=float, default=max_wait * 1000,
+                        help='How long to hold a request waiting for others to batch with')
+    parser.add_argument('--input-size', type=int, default=input_size,
+                        help='Side of the square the model runs on')
+    parser.add_argument('--intra-op-threads', type=int, default=intra_op_threads,
+                        help='Torch threads for the forward pass; 0 leaves the default')
+    parser.add_argument('--annotate', action='store_true',
+                        help='Also write <image>_detected.jpg with the boxes drawn in')
+    options = parser.parse_args()
+    max_batch = max(1, options.max_batch)
+    max_wait = max(0.0, options.max_wait_ms / 1000)
+    input_size = max(32, options.input_size)
+    intra_op_threads = max(0, options.intra_op_threads)
+    write_annotated = options.annotate
+
+    log('status', f'Python script started (max batch {max_batch}, max wait {max_wait * 1000:.0f} ms, '
+                  f'input {input_size}, {intra_op_threads or "default"} intra-op threads)')
+
     # Initialize model
     model = None
     while model is None:
         try:
             model = initialize_model()
+        except SystemExit:
+            raise
         except Exception as e:
-            print(f'[ERROR] Model initialization failed, retrying in 2 seconds...')
-            print(f'[ERROR] Error: {str(e)}')
-            sys.stdout.flush()
-            import time
+            log('error', f'Model initialization failed, retrying in 2 seconds... {str(e)}')
             time.sleep(2)
-    
-    # Start processing thread
-    processing_thread = threading.Thread(target=process_queue, args=(model,))
-    processing_thread.daemon = True
-    processing_thread.start()
-    
-    print('[STATUS] Entering command loop')
-    sys.stdout.flush()
-    
+
+    start_pipeline(model)
+
+    send('ready')
+
     try:
         while True:
             line = sys.stdin.readline()
@@ -250,12 +668,10 @@ if __name__ == '__main__':
                 break
             process_command(model, line)
     except Exception as e:
-        print(f'[ERROR] Error in main loop: {str(e)}')
-        print('[ERROR] Traceback:')
-        print(traceback.format_exc())
-        sys.stdout.flush()
+        log('error', f'Error in main loop: {str(e)}')
+        log('error', traceback.format_exc())
     finally:
         # Clean shutdown
         should_stop = True
-        if processing_thread:
-            processing_thread.join(timeout=5.0) 
\ No newline at end of file
+        for thread in pipeline_threads:
+            thread.join(timeout=5.0)
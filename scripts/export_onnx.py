@@ -0,0 +1,23 @@
+import os
+import sys
+from ultralytics import YOLO
+
+# Exports model/best.pt to model/best.onnx for the in-process OpenCV DNN
+# detector. Run once per model update from the directory holding model/.
+#
+#   python3 scripts/export_onnx.py [image size]
+#
+# The image size must match what NativeDetector letterboxes to (640 unless
+# "input_size" is set in detector.json).
+
+if __name__ == '__main__':
+    image_size = int(sys.argv[1]) if len(sys.argv) > 1 else 640
+    model_path = os.path.join(os.getcwd(), 'model', 'best.pt')
+    if not os.path.exists(model_path):
+        print(f'Model not found at {model_path}', file=sys.stderr)
+        sys.exit(1)
+
+    # Static shapes and an opset OpenCV's ONNX importer handles; NMS stays in C++
+    exported = YOLO(model_path).export(format='onnx', imgsz=image_size, opset=12,
+                                       dynamic=False, simplify=True)
+    print(f'Exported {exported}')
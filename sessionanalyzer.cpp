@@ -0,0 +1,128 @@
+#include "sessionanalyzer.h"
+#include <QDir>
+#include <QThread>
+#include <QDebug>
+#include <QtConcurrent>
+
+void CuttingSession::clear()
+{
+    surfaces.clear();
+    indexByName.clear();
+}
+
+void CuttingSession::append(const SurfaceCuts &surface)
+{
+    indexByName.insert(surface.name, int(surfaces.size()));
+    surfaces.append(surface);
+}
+
+const CuttingAnalyzer *CuttingSession::surface(const QString &name) const
+{
+    auto it = indexByName.constFind(name);
+    if (it == indexByName.constEnd()) return nullptr;
+    return surfaces.at(*it).analysis.data();
+}
+
+const GuillotinePlan *CuttingSession::plan(const QString &name) const
+{
+    auto it = indexByName.constFind(name);
+    if (it == indexByName.constEnd() || !surfaces.at(*it).analysis) return nullptr;
+    return &surfaces.at(*it).plan;
+}
+
+SessionAnalyzer::SessionAnalyzer(int piecesInX, int piecesInY,
+                                 double surfaceWidth, double surfaceHeight,
+                                 QObject *parent)
+    : QObject(parent)
+    , piecesInX(piecesInX)
+    , piecesInY(piecesInY)
+    , surfaceWidth(surfaceWidth)
+    , surfaceHeight(surfaceHeight)
+    , originX(0.0)
+    , originY(0.0)
+    , pieceWidth(surfaceWidth / piecesInX)
+    , pieceHeight(surfaceHeight / piecesInY)
+    , guillotinePlanning(false)
+{
+    // Each surface is a JSON parse, a pass over its defects and a JSON write
+    pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+
+    connect(&watcher, &QFutureWatcher<SurfaceCuts>::progressValueChanged, this, [this](int analyzed) {
+        emit progress(analyzed, watcher.progressMaximum());
+    });
+    connect(&watcher, &QFutureWatcher<SurfaceCuts>::finished, this, &SessionAnalyzer::collectResults);
+}
+
+SessionAnalyzer::~SessionAnalyzer()
+{
+    // Workers read this object's configuration
+    watcher.cancel();
+    watcher.waitForFinished();
+}
+
+void SessionAnalyzer::setGrid(double originX, double originY, double pieceWidth, double pieceHeight)
+{
+    this->originX = originX;
+    this->originY = originY;
+    this->pieceWidth = pieceWidth;
+    this->pieceHeight = pieceHeight;
+}
+
+void SessionAnalyzer::start(const QStringList &surfacePaths)
+{
+    if (watcher.isRunning()) {
+        watcher.cancel();
+        watcher.waitForFinished();
+    }
+
+    result.clear();
+    timer.start();
+    emit progress(0, surfacePaths.size());
+
+    watcher.setFuture(QtConcurrent::mapped(&pool, surfacePaths, [this](const QString &surfacePath) {
+        return analyzeSurface(surfacePath);
+    }));
+}
+
+SurfaceCuts SessionAnalyzer::analyzeSurface(const QString &surfacePath) const
+{
+    SurfaceCuts surface;
+    surface.name = QDir(surfacePath).dirName();
+
+    QSharedPointer<CuttingAnalyzer> analyzer(
+        new CuttingAnalyzer(surfacePath, piecesInX, piecesInY, surfaceWidth, surfaceHeight));
+    analyzer->setGrid(originX, originY, pieceWidth, pieceHeight);
+    if (!analyzer->analyze()) {
+        qWarning() << "Failed to analyze surface:" << surface.name;
+        return surface;
+    }
+    surface.analysis = analyzer;
+
+    if (guillotinePlanning) {
+        // Within the grid's extent, so a trim margin stays waste
+        GuillotinePlanner planner(analyzer->gridRect(), pieceWidth, pieceHeight);
+        surface.plan = planner.plan(analyzer->defectStore());
+        qDebug() << surface.name << "- planned" << surface.plan.pieces.size() << "pieces in"
+                 << surface.plan.elapsedMs << "ms" << (surface.plan.optimal ? "" : "(search budget reached)");
+    }
+
+    // The window works from memory; the file is for whatever reads the session later
+    if (!analyzer->saveAnalysis(QString("%1/cutting_analysis.json").arg(surfacePath), surface.name)) {
+        qWarning() << "Failed to save cutting analysis for" << surface.name;
+    }
+    return surface;
+}
+
+void SessionAnalyzer::collectResults()
+{
+    if (watcher.isCanceled()) return;
+
+    // mapped() keeps the results in the order of the surface paths
+    const QList<SurfaceCuts> surfaces = watcher.future().results();
+    for (const SurfaceCuts &surface : surfaces) {
+        result.append(surface);
+    }
+
+    qDebug() << "Analyzed" << result.size() << "surfaces in" << timer.elapsed() << "ms";
+    emit finished();
+}
@@ -0,0 +1,88 @@
+#ifndef SESSIONANALYZER_H
+#define SESSIONANALYZER_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QSharedPointer>
+#include <QFutureWatcher>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include "cuttinganalyzer.h"
+#include "guillotineplanner.h"
+
+// The cutting analysis of one surface of the session
+struct SurfaceCuts {
+    QString name;  // surface_N
+    QSharedPointer<const CuttingAnalyzer> analysis;  // Null if the surface could not be analyzed
+    GuillotinePlan plan;  // Empty unless guillotine planning is on
+};
+
+// Every surface of a session, in session order, held in memory so the
+// cutting window never has to read cutting_analysis.json back
+class CuttingSession
+{
+public:
+    void clear();
+    void append(const SurfaceCuts &surface);
+
+    int size() const { return int(surfaces.size()); }
+    const SurfaceCuts &at(int index) const { return surfaces.at(index); }
+    // Null if the surface is unknown or was not analyzed
+    const CuttingAnalyzer *surface(const QString &name) const;
+    // The surface's guillotine plan, which has no pieces unless planning was
+    // on; null only where surface() is
+    const GuillotinePlan *plan(const QString &name) const;
+
+private:
+    QVector<SurfaceCuts> surfaces;
+    QHash<QString, int> indexByName;
+};
+
+// Analyzes all surfaces of a session concurrently. Each surface gets its own
+// CuttingAnalyzer on a pool thread, which also writes its cutting_analysis.json;
+// the owner thread only collects the results in session order.
+class SessionAnalyzer : public QObject
+{
+    Q_OBJECT
+
+public:
+    SessionAnalyzer(int piecesInX, int piecesInY,
+                    double surfaceWidth, double surfaceHeight,
+                    QObject *parent = nullptr);
+    ~SessionAnalyzer();
+
+    // See CuttingAnalyzer::setGrid(); by default the pieces tile the surface
+    void setGrid(double originX, double originY, double pieceWidth, double pieceHeight);
+    // Also plan guillotine cuts of the grid's piece size around each surface's defects
+    void setGuillotinePlanning(bool enabled) { guillotinePlanning = enabled; }
+    void start(const QStringList &surfacePaths);
+    bool isRunning() const { return watcher.isRunning(); }
+    const CuttingSession &session() const { return result; }
+
+signals:
+    void progress(int analyzed, int total);
+    void finished();
+
+private:
+    SurfaceCuts analyzeSurface(const QString &surfacePath) const;
+    void collectResults();
+
+    int piecesInX;
+    int piecesInY;
+    double surfaceWidth;
+    double surfaceHeight;
+    double originX;
+    double originY;
+    double pieceWidth;
+    double pieceHeight;
+    bool guillotinePlanning;
+    CuttingSession result;
+    QThreadPool pool;
+    QFutureWatcher<SurfaceCuts> watcher;
+    QElapsedTimer timer;
+};
+
+#endif // SESSIONANALYZER_H
@@ -0,0 +1,127 @@
+#include "sharedframering.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <cerrno>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+SharedFrameRing::SharedFrameRing()
+    : base(nullptr)
+    , slotBytes(0)
+    , mappedBytes(0)
+{
+}
+
+SharedFrameRing::~SharedFrameRing()
+{
+    destroy();
+}
+
+bool SharedFrameRing::create(int slotCount, qsizetype slotSize)
+{
+    destroy();
+    if (slotCount <= 0 || slotSize <= 0) return false;
+
+#ifdef Q_OS_UNIX
+    // One segment per process; the name is what the worker maps
+    static int segmentCounter = 0;
+    segmentName = QString("/cardqt_%1_frames_%2").arg(QCoreApplication::applicationPid()).arg(segmentCounter++);
+    const QByteArray nativeName = segmentName.toLocal8Bit();
+
+    int fd = shm_open(nativeName.constData(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        qDebug() << "shm_open failed for" << segmentName << std::strerror(errno);
+        segmentName.clear();
+        return false;
+    }
+
+    const qsizetype totalBytes = slotSize * slotCount;
+    if (ftruncate(fd, off_t(totalBytes)) != 0) {
+        qDebug() << "Failed to size shared frame segment:" << std::strerror(errno);
+        close(fd);
+        shm_unlink(nativeName.constData());
+        segmentName.clear();
+        return false;
+    }
+
+    void *mapped = mmap(nullptr, size_t(totalBytes), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);  // The mapping keeps the segment alive
+    if (mapped == MAP_FAILED) {
+        qDebug() << "Failed to map shared frame segment:" << std::strerror(errno);
+        shm_unlink(nativeName.constData());
+        segmentName.clear();
+        return false;
+    }
+
+    base = static_cast<uchar *>(mapped);
+    slotBytes = slotSize;
+    mappedBytes = totalBytes;
+    busy = QVector<bool>(slotCount, false);
+    return true;
+#else
+    qDebug() << "Shared frame handoff needs POSIX shared memory; sending paths instead";
+    return false;
+#endif
+}
+
+void SharedFrameRing::destroy()
+{
+#ifdef Q_OS_UNIX
+    if (base) {
+        munmap(base, size_t(mappedBytes));
+        shm_unlink(segmentName.toLocal8Bit().constData());
+    }
+#endif
+    base = nullptr;
+    slotBytes = 0;
+    mappedBytes = 0;
+    busy.clear();
+    segmentName.clear();
+}
+
+int SharedFrameRing::store(const QImage &frame, const QRect &region, QJsonObject &descriptor)
+{
+    if (!base || frame.isNull()) return -1;
+
+    const QRect area = region.isNull() ? frame.rect() : region.intersected(frame.rect());
+    const int width = area.width();
+    const int height = area.height();
+    const qsizetype stride = qsizetype(width) * 3;
+    if (area.isEmpty() || stride * height > slotBytes) return -1;
+
+    int slot = busy.indexOf(false);
+    if (slot < 0) return -1;
+
+    QImage rgb = (area == frame.rect() ? frame : frame.copy(area)).convertToFormat(QImage::Format_RGB888);
+    uchar *out = base + slot * slotBytes;
+    for (int y = 0; y < height; ++y) {
+        std::memcpy(out + y * stride, rgb.constScanLine(y), size_t(stride));
+    }
+    busy[slot] = true;
+
+    descriptor = QJsonObject();
+    descriptor["name"] = segmentName;
+    descriptor["offset"] = qint64(slot * slotBytes);
+    descriptor["width"] = width;
+    descriptor["height"] = height;
+    descriptor["stride"] = qint64(stride);
+    descriptor["format"] = "rgb888";
+    return slot;
+}
+
+void SharedFrameRing::release(int slot)
+{
+    if (slot >= 0 && slot < busy.size()) {
+        busy[slot] = false;
+    }
+}
+
+int SharedFrameRing::busyCount() const
+{
+    return int(busy.count(true));
+}
@@ -0,0 +1,51 @@
+#ifndef SHAREDFRAMERING_H
+#define SHAREDFRAMERING_H
+
+#include <QImage>
+#include <QJsonObject>
+#include <QRect>
+#include <QString>
+#include <QVector>
+
+// A POSIX shared-memory segment split into fixed-size slots, used to hand
+// decoded frames to the detector worker without a disk round trip. The
+// worker maps the segment once by name and reads each frame in place from
+// the offset given in its request.
+//
+// A slot stays busy until release() is called for it, which the detector
+// does when the worker answers the request. When no slot is free, or the
+// platform has no POSIX shared memory, callers fall back to sending the path.
+class SharedFrameRing
+{
+public:
+    SharedFrameRing();
+    ~SharedFrameRing();
+
+    bool create(int slotCount, qsizetype slotSize);
+    void destroy();
+    bool isValid() const { return base != nullptr; }
+    QString name() const { return segmentName; }
+
+    // Copies region of frame (all of it if region is null) into a free slot as
+    // packed RGB888 and fills descriptor with what the worker needs to read
+    // it. Returns the slot, or -1.
+    int store(const QImage &frame, const QRect &region, QJsonObject &descriptor);
+    void release(int slot);
+    int busyCount() const;
+    int slotCount() const { return int(busy.size()); }
+
+    // Largest capture the ring is sized for (1920x1080 RGB888)
+    static qsizetype defaultSlotSize() { return qsizetype(1920) * 1080 * 3; }
+
+private:
+    SharedFrameRing(const SharedFrameRing &) = delete;
+    SharedFrameRing &operator=(const SharedFrameRing &) = delete;
+
+    QString segmentName;
+    uchar *base;
+    qsizetype slotBytes;
+    qsizetype mappedBytes;
+    QVector<bool> busy;
+};
+
+#endif // SHAREDFRAMERING_H
@@ -0,0 +1,313 @@
+#include "tilepyramid.h"
+#include <QDir>
+#include <QFile>
+#include <QImageReader>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPainter>
+#include <QDebug>
+#include <cmath>
+#include <cstring>
+
+QString TilePyramid::descriptorPath(const QString &surfacePath, const QString &name)
+{
+    return QString("%1/%2_pyramid.json").arg(surfacePath).arg(name);
+}
+
+QString TilePyramid::tileDirectory(const QString &surfacePath, const QString &name)
+{
+    return QString("%1/%2_files").arg(surfacePath).arg(name);
+}
+
+bool TilePyramid::load(const QString &surfacePath, const QString &name)
+{
+    levels = 0;
+
+    QFile file(descriptorPath(surfacePath, name));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QJsonObject descriptor = QJsonDocument::fromJson(file.readAll()).object();
+    file.close();
+
+    fullSize = QSize(descriptor["width"].toInt(), descriptor["height"].toInt());
+    tileEdge = descriptor["tile_size"].toInt();
+    int levelCount = descriptor["levels"].toInt();
+    if (fullSize.isEmpty() || tileEdge <= 0 || levelCount <= 0) {
+        qDebug() << "Invalid tile pyramid descriptor for" << surfacePath;
+        return false;
+    }
+
+    directory = tileDirectory(surfacePath, name);
+    levels = levelCount;
+    return true;
+}
+
+QSize TilePyramid::levelSize(int level) const
+{
+    int width = fullSize.width();
+    int height = fullSize.height();
+    for (int i = 0; i < level; ++i) {
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+    return QSize(width, height);
+}
+
+int TilePyramid::levelForScale(double scale) const
+{
+    if (levels <= 0 || scale >= 1.0) return 0;
+    if (scale <= 0.0) return levels - 1;
+
+    int level = static_cast<int>(std::floor(std::log2(1.0 / scale)));
+    return qBound(0, level, levels - 1);
+}
+
+QString TilePyramid::tilePath(int level, int col, int row) const
+{
+    return QString("%1/%2/%3_%4.jpg").arg(directory).arg(level).arg(col).arg(row);
+}
+
+QRect TilePyramid::tileRect(int level, int col, int row) const
+{
+    QSize size = levelSize(level);
+    QRect tile(col * tileEdge, row * tileEdge, tileEdge, tileEdge);
+    return tile.intersected(QRect(QPoint(0, 0), size));
+}
+
+QImage TilePyramid::readOverview(const QSize &targetSize) const
+{
+    if (!isValid() || targetSize.isEmpty()) return QImage();
+
+    double scale = qMin(double(targetSize.width()) / fullSize.width(),
+                        double(targetSize.height()) / fullSize.height());
+    int level = levelForScale(scale);
+    QSize size = levelSize(level);
+
+    QImage overview(size, QImage::Format_RGB888);
+    overview.fill(Qt::black);
+    QPainter painter(&overview);
+
+    const int cols = (size.width() + tileEdge - 1) / tileEdge;
+    const int rows = (size.height() + tileEdge - 1) / tileEdge;
+    for (int row = 0; row < rows; ++row) {
+        for (int col = 0; col < cols; ++col) {
+            QImage tile(tilePath(level, col, row));
+            if (!tile.isNull()) {
+                painter.drawImage(tileRect(level, col, row).topLeft(), tile);
+            }
+        }
+    }
+    painter.end();
+
+    return overview;
+}
+
+QImage TilePyramid::readSurfaceOverview(const QString &surfacePath, const QString &name, const QSize &targetSize)
+{
+    TilePyramid pyramid;
+    if (pyramid.load(surfacePath, name)) {
+        return pyramid.readOverview(targetSize);
+    }
+
+    QImageReader reader(QString("%1/%2.jpg").arg(surfacePath).arg(name));
+    QSize sourceSize = reader.size();
+    if (sourceSize.isValid() && !targetSize.isEmpty()
+        && sourceSize.width() > targetSize.width() && sourceSize.height() > targetSize.height()) {
+        reader.setScaledSize(sourceSize.scaled(targetSize, Qt::KeepAspectRatio));
+    }
+    return reader.read();
+}
+
+TilePyramidWriter::TilePyramidWriter()
+    : tileEdge(TilePyramid::defaultTileSize())
+    , jpegQuality(85)
+    , writtenTiles(0)
+{
+}
+
+bool TilePyramidWriter::open(const QString &surfacePath, const QString &name, int width, int height,
+                             int tileSize, int quality)
+{
+    if (width <= 0 || height <= 0 || tileSize <= 0) {
+        lastError = QString("Invalid pyramid size %1x%2").arg(width).arg(height);
+        return false;
+    }
+
+    this->surfacePath = surfacePath;
+    this->name = name;
+    directory = TilePyramid::tileDirectory(surfacePath, name);
+    tileEdge = tileSize;
+    jpegQuality = quality;
+    fullSize = QSize(width, height);
+    writtenTiles = 0;
+    lastError.clear();
+
+    // The descriptor is written last, so readers never see a half-built pyramid
+    QFile::remove(TilePyramid::descriptorPath(surfacePath, name));
+    QDir(directory).removeRecursively();
+
+    levels.clear();
+    int levelWidth = width;
+    int levelHeight = height;
+    while (true) {
+        Level level;
+        level.width = levelWidth;
+        level.height = levelHeight;
+        level.strip = QImage(levelWidth, qMin(tileEdge, levelHeight), QImage::Format_RGB888);
+        level.pendingRow.resize(levelWidth * 3);
+        level.reducedRow.resize(((levelWidth + 1) / 2) * 3);
+        levels.append(level);
+
+        if (!QDir().mkpath(QString("%1/%2").arg(directory).arg(levels.size() - 1))) {
+            lastError = QString("Could not create %1").arg(directory);
+            levels.clear();
+            return false;
+        }
+
+        if (levelWidth <= tileEdge && levelHeight <= tileEdge) break;
+        levelWidth = (levelWidth + 1) / 2;
+        levelHeight = (levelHeight + 1) / 2;
+    }
+
+    return true;
+}
+
+bool TilePyramidWriter::writeRows(const uchar *rows, int rowCount, qsizetype bytesPerLine)
+{
+    if (levels.isEmpty()) {
+        lastError = "Pyramid writer is not open";
+        return false;
+    }
+
+    for (int i = 0; i < rowCount; ++i) {
+        if (!pushRow(0, rows + i * bytesPerLine)) return false;
+    }
+    return true;
+}
+
+bool TilePyramidWriter::pushRow(int levelIndex, const uchar *row)
+{
+    Level &level = levels[levelIndex];
+    if (level.rowsReceived >= level.height) {
+        lastError = QString("Too many rows for pyramid level %1").arg(levelIndex);
+        return false;
+    }
+
+    std::memcpy(level.strip.scanLine(level.stripRows), row, size_t(level.width) * 3);
+    ++level.stripRows;
+    ++level.rowsReceived;
+    if (level.stripRows == level.strip.height() && !flushStrip(levelIndex)) {
+        return false;
+    }
+
+    if (levelIndex + 1 >= levels.size()) return true;
+
+    // Every pair of rows becomes one row of the next level
+    if (!level.hasPending) {
+        std::memcpy(level.pendingRow.data(), row, size_t(level.width) * 3);
+        level.hasPending = true;
+        return true;
+    }
+
+    level.hasPending = false;
+    downsampleRows(level.width, level.pendingRow.constData(), row, level.reducedRow.data());
+    return pushRow(levelIndex + 1, level.reducedRow.constData());
+}
+
+bool TilePyramidWriter::flushStrip(int levelIndex)
+{
+    Level &level = levels[levelIndex];
+    if (level.stripRows == 0) return true;
+
+    const int cols = (level.width + tileEdge - 1) / tileEdge;
+    for (int col = 0; col < cols; ++col) {
+        int x = col * tileEdge;
+        QImage tile = level.strip.copy(x, 0, qMin(tileEdge, level.width - x), level.stripRows);
+        QString path = QString("%1/%2/%3_%4.jpg").arg(directory).arg(levelIndex).arg(col).arg(level.tileRow);
+        if (!tile.save(path, "JPG", jpegQuality)) {
+            lastError = QString("Failed to write pyramid tile %1").arg(path);
+            return false;
+        }
+        ++writtenTiles;
+    }
+
+    ++level.tileRow;
+    level.stripRows = 0;
+    return true;
+}
+
+void TilePyramidWriter::downsampleRows(int sourceWidth, const uchar *top, const uchar *bottom, uchar *out)
+{
+    // 2x2 box filter; an odd last column is paired with itself
+    const int outWidth = (sourceWidth + 1) / 2;
+    for (int x = 0; x < outWidth; ++x) {
+        int left = 2 * x * 3;
+        int right = qMin(2 * x + 1, sourceWidth - 1) * 3;
+        for (int c = 0; c < 3; ++c) {
+            int sum = top[left + c] + top[right + c] + bottom[left + c] + bottom[right + c];
+            out[x * 3 + c] = static_cast<uchar>((sum + 2) / 4);
+        }
+    }
+}
+
+bool TilePyramidWriter::finish()
+{
+    if (levels.isEmpty()) {
+        lastError = "Pyramid writer is not open";
+        return false;
+    }
+
+    // Top to bottom, so a level's last row reaches the next level before it flushes
+    for (int levelIndex = 0; levelIndex < levels.size(); ++levelIndex) {
+        Level &level = levels[levelIndex];
+        if (level.hasPending && levelIndex + 1 < levels.size()) {
+            // Odd height: the last row is paired with itself
+            level.hasPending = false;
+            downsampleRows(level.width, level.pendingRow.constData(), level.pendingRow.constData(),
+                           level.reducedRow.data());
+            if (!pushRow(levelIndex + 1, level.reducedRow.constData())) return false;
+        }
+        if (!flushStrip(levelIndex)) return false;
+
+        if (level.rowsReceived != level.height) {
+            lastError = QString("Pyramid level %1 got %2 of %3 rows")
+                .arg(levelIndex).arg(level.rowsReceived).arg(level.height);
+            return false;
+        }
+    }
+
+    QJsonObject descriptor;
+    descriptor["width"] = fullSize.width();
+    descriptor["height"] = fullSize.height();
+    descriptor["tile_size"] = tileEdge;
+    descriptor["levels"] = levels.size();
+    descriptor["format"] = "jpg";
+    descriptor["quality"] = jpegQuality;
+
+    QFile file(TilePyramid::descriptorPath(surfacePath, name));
+    if (!file.open(QIODevice::WriteOnly)) {
+        lastError = "Failed to write pyramid descriptor";
+        return false;
+    }
+    file.write(QJsonDocument(descriptor).toJson(QJsonDocument::Indented));
+    file.close();
+
+    levels.clear();
+    return true;
+}
+
+bool TilePyramidWriter::writeImage(const QString &surfacePath, const QString &name, const QImage &image,
+                                   int tileSize, int quality)
+{
+    QImage rgb = image.convertToFormat(QImage::Format_RGB888);
+    TilePyramidWriter writer;
+    if (!writer.open(surfacePath, name, rgb.width(), rgb.height(), tileSize, quality)
+        || !writer.writeRows(rgb.constBits(), rgb.height(), rgb.bytesPerLine())
+        || !writer.finish()) {
+        qDebug() << "Failed to write tile pyramid:" << writer.errorString();
+        return false;
+    }
+    return true;
+}
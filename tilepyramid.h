@@ -0,0 +1,101 @@
+#ifndef TILEPYRAMID_H
+#define TILEPYRAMID_H
+
+#include <QImage>
+#include <QRect>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+// Multi-resolution tiles for a stitched surface, deep-zoom style:
+//
+//   <surface>/<name>_pyramid.json             size, tile size and level count
+//   <surface>/<name>_files/<level>/<col>_<row>.jpg
+//
+// Level 0 is full resolution and each further level halves both sides, down
+// to the first level that fits in a single tile. Viewers decode only the
+// tiles they show, at the level closest to the on-screen scale.
+class TilePyramid
+{
+public:
+    static int defaultTileSize() { return 256; }
+
+    bool load(const QString &surfacePath, const QString &name = "stitched");
+    bool isValid() const { return levels > 0; }
+
+    QSize imageSize() const { return fullSize; }
+    int tileSize() const { return tileEdge; }
+    int levelCount() const { return levels; }
+    QSize levelSize(int level) const;
+
+    // Finest level whose resolution is still at least scale (screen/image pixels)
+    int levelForScale(double scale) const;
+    QString tilePath(int level, int col, int row) const;
+    QRect tileRect(int level, int col, int row) const;  // In level pixels
+
+    // Composes the coarsest level that still covers targetSize, from its tiles
+    QImage readOverview(const QSize &targetSize) const;
+
+    // Overview of <surface>/<name>, falling back to a decoder-scaled read of
+    // <name>.jpg for surfaces without a pyramid
+    static QImage readSurfaceOverview(const QString &surfacePath, const QString &name, const QSize &targetSize);
+
+    static QString descriptorPath(const QString &surfacePath, const QString &name = "stitched");
+    static QString tileDirectory(const QString &surfacePath, const QString &name = "stitched");
+
+private:
+    QString directory;
+    QSize fullSize;
+    int tileEdge = 0;
+    int levels = 0;
+};
+
+// Writes a TilePyramid from rows fed top to bottom, so it can share a stitch
+// pass with JpegStripWriter. Only one tile row per level is held in memory;
+// each level is box-filtered from the one above as rows arrive.
+class TilePyramidWriter
+{
+public:
+    TilePyramidWriter();
+
+    bool open(const QString &surfacePath, const QString &name, int width, int height,
+              int tileSize = TilePyramid::defaultTileSize(), int quality = 85);
+    bool writeRows(const uchar *rows, int rowCount, qsizetype bytesPerLine);  // RGB888
+    bool finish();
+
+    int tilesWritten() const { return writtenTiles; }
+    QString errorString() const { return lastError; }
+
+    // Whole image in one call, for stitches that already hold the canvas
+    static bool writeImage(const QString &surfacePath, const QString &name, const QImage &image,
+                           int tileSize = TilePyramid::defaultTileSize(), int quality = 85);
+
+private:
+    struct Level {
+        int width = 0;
+        int height = 0;
+        QImage strip;              // One row of tiles being filled
+        int stripRows = 0;
+        int tileRow = 0;
+        int rowsReceived = 0;
+        QVector<uchar> pendingRow;  // Odd row waiting for its pair to go one level down
+        QVector<uchar> reducedRow;  // Box-filtered row handed to the next level
+        bool hasPending = false;
+    };
+
+    bool pushRow(int level, const uchar *row);
+    bool flushStrip(int level);
+    static void downsampleRows(int sourceWidth, const uchar *top, const uchar *bottom, uchar *out);
+
+    QString surfacePath;
+    QString name;
+    QString directory;
+    int tileEdge;
+    int jpegQuality;
+    QSize fullSize;
+    QVector<Level> levels;
+    int writtenTiles;
+    QString lastError;
+};
+
+#endif // TILEPYRAMID_H
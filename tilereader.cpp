@@ -0,0 +1,127 @@
+#include "tilereader.h"
+#include "capturestore.h"
+#include <QImageReader>
+#include <QDebug>
+
+namespace {
+
+// Moves a crop that fits inside the source by offset without leaving the source
+QRect shiftedCrop(const QRect &crop, const QPoint &offset, const QSize &sourceSize)
+{
+    int x = qBound(0, crop.x() + offset.x(), sourceSize.width() - crop.width());
+    int y = qBound(0, crop.y() + offset.y(), sourceSize.height() - crop.height());
+    return QRect(QPoint(x, y), crop.size());
+}
+
+} // namespace
+
+QRect TileReader::centerCropRect(const QSize &sourceSize, const QSize &cropSize)
+{
+    int x = (sourceSize.width() - cropSize.width()) / 2;
+    int y = (sourceSize.height() - cropSize.height()) / 2;
+    return QRect(QPoint(x, y), cropSize);
+}
+
+QSize TileReader::cropMargin(const QSize &sourceSize, const QSize &cropSize)
+{
+    // The centred crop has the smaller margin on its top left
+    QRect crop = centerCropRect(sourceSize, cropSize);
+    return QSize(qMax(0, crop.x()), qMax(0, crop.y()));
+}
+
+QImage TileReader::readCenterCrop(const QString &imagePath, const QSize &cropSize, const QPoint &offset)
+{
+    if (CaptureStore::isNativeFormat(imagePath)) {
+        // QOI and raw captures: raw reads only the crop rows, QOI decodes and copies
+        QSize sourceSize = CaptureStore::readSize(imagePath);
+        QRect crop = centerCropRect(sourceSize, cropSize);
+        if (sourceSize.isValid() && QRect(QPoint(0, 0), sourceSize).contains(crop)) {
+            return CaptureStore::readRegion(imagePath, shiftedCrop(crop, offset, sourceSize));
+        }
+        QImage source = CaptureStore::read(imagePath);
+        return source.isNull() ? source : source.scaled(cropSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+
+    QImageReader reader(imagePath);
+    QSize sourceSize = reader.size();  // Parsed from the header, no pixel decode
+
+    if (!sourceSize.isValid()) {
+        // Format without a cheap size query: decode it all and crop afterwards
+        QImage source = reader.read();
+        if (source.isNull()) {
+            qDebug() << "Failed to read tile:" << imagePath << reader.errorString();
+            return QImage();
+        }
+        QRect crop = centerCropRect(source.size(), cropSize);
+        if (!QRect(QPoint(0, 0), source.size()).contains(crop)) {
+            return source.scaled(cropSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        }
+        return source.copy(shiftedCrop(crop, offset, source.size()));
+    }
+
+    QRect crop = centerCropRect(sourceSize, cropSize);
+    if (QRect(QPoint(0, 0), sourceSize).contains(crop)) {
+        crop = shiftedCrop(crop, offset, sourceSize);
+        reader.setClipRect(crop);
+    } else {
+        // Ensure valid crop region; let the decoder downscale while reading
+        reader.setScaledSize(sourceSize.scaled(cropSize, Qt::KeepAspectRatio));
+        reader.setQuality(100);
+    }
+
+    QImage tile = reader.read();
+    if (tile.isNull()) {
+        qDebug() << "Failed to read tile:" << imagePath << reader.errorString();
+    }
+    return tile;
+}
+
+QImage TileReader::readRegion(const QString &imagePath, const QRect &region)
+{
+    if (CaptureStore::isNativeFormat(imagePath)) {
+        return CaptureStore::readRegion(imagePath, region);
+    }
+
+    QImageReader reader(imagePath);
+    QSize sourceSize = reader.size();
+    QRect clip = sourceSize.isValid() ? region.intersected(QRect(QPoint(0, 0), sourceSize)) : region;
+    if (clip.isEmpty()) {
+        return QImage();
+    }
+
+    reader.setClipRect(clip);
+    QImage image = reader.read();
+    if (image.isNull()) {
+        qDebug() << "Failed to read tile region:" << imagePath << reader.errorString();
+    }
+    return image;
+}
+
+QImage TileReader::readDownsampled(const QString &imagePath, int factor)
+{
+    factor = qMax(1, factor);
+    if (CaptureStore::isNativeFormat(imagePath)) {
+        // Lossless captures have no decoder-side scaling, so reduce after a full decode
+        QImage source = CaptureStore::read(imagePath);
+        if (source.isNull()) return QImage();
+        return source.scaled(source.size() / factor, Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
+            .convertToFormat(QImage::Format_Grayscale8);
+    }
+
+    QImageReader reader(imagePath);
+    QSize sourceSize = reader.size();
+
+    if (sourceSize.isValid()) {
+        reader.setScaledSize(sourceSize / factor);
+    }
+
+    QImage image = reader.read();
+    if (image.isNull()) {
+        qDebug() << "Failed to read downsampled tile:" << imagePath << reader.errorString();
+        return QImage();
+    }
+    if (!sourceSize.isValid()) {
+        image = image.scaled(image.size() / factor, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    return image.convertToFormat(QImage::Format_Grayscale8);
+}
@@ -0,0 +1,40 @@
+#ifndef TILEREADER_H
+#define TILEREADER_H
+
+#include <QImage>
+#include <QPoint>
+#include <QRect>
+#include <QSize>
+#include <QString>
+
+// Decodes only the part of a captured tile that ends up in the stitched surface.
+// JPEG captures are read through QImageReader's clip rect, so the decoder skips
+// the rows outside the crop instead of decoding the full frame and copying.
+// QOI and raw captures (see CaptureStore) are decoded without Qt's plugins.
+class TileReader
+{
+public:
+    // Region of each capture used for stitching (matches the capture reference box)
+    static QSize defaultCropSize() { return QSize(1100, 778); }
+
+    static QRect centerCropRect(const QSize &sourceSize, const QSize &cropSize = defaultCropSize());
+    // How far the centred crop can move in either direction and stay inside
+    // the capture; empty if the capture is smaller than the crop
+    static QSize cropMargin(const QSize &sourceSize, const QSize &cropSize = defaultCropSize());
+
+    // Decodes the centred crop moved by offset. The crop is kept inside the
+    // capture, so large offsets are clamped to the available margin. Captures
+    // smaller than the crop are scaled down to fit it instead, matching the old
+    // cropCenterRegion() behaviour.
+    static QImage readCenterCrop(const QString &imagePath, const QSize &cropSize = defaultCropSize(),
+                                 const QPoint &offset = QPoint());
+
+    // Decodes an arbitrary region; the region is clipped to the image bounds
+    static QImage readRegion(const QString &imagePath, const QRect &region);
+
+    // Decodes the whole capture at 1/factor size as 8-bit grey. JPEG captures
+    // are downscaled inside the decoder, which is much cheaper than a full decode.
+    static QImage readDownsampled(const QString &imagePath, int factor);
+};
+
+#endif // TILEREADER_H
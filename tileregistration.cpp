@@ -0,0 +1,286 @@
+#include "tileregistration.h"
+#include "phasecorrelation.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPair>
+#include <QDebug>
+#include <QtConcurrent>
+
+namespace {
+
+const int minimumOverlap = 16;       // Downsampled pixels; narrower overlaps are not measured
+const float minimumPeak = 0.08f;     // Random texture correlates at ~0.02
+const double maximumOffset = 120.0;  // Capture pixels; corrections are clamped to the crop margin after solving
+
+// Power of two FFT size for an overlap; a slightly smaller power is used
+// (cropping the patch) rather than padding almost twice the data
+int fftSizeFor(int length)
+{
+    int size = PhaseCorrelator::nextPowerOfTwo(length);
+    if (size / 2 >= length * 3 / 4) size /= 2;
+    return size;
+}
+
+} // namespace
+
+TileRegistration::TileRegistration(int imagesInX, int imagesInY, const QSize &cellSize, int downsample)
+    : imagesInX(imagesInX)
+    , imagesInY(imagesInY)
+    , cellSize(cellSize)
+    , downsampleFactor(qMax(1, downsample))
+    , tiles(imagesInX * imagesInY)
+    , tileCorrections(imagesInX * imagesInY)
+    , lastElapsedMs(0)
+{
+}
+
+void TileRegistration::setTile(int position, const QImage &downsampledTile)
+{
+    if (position < 0 || position >= tiles.size()) return;
+    tiles[position] = downsampledTile.convertToFormat(QImage::Format_Grayscale8);
+}
+
+bool TileRegistration::hasTile(int position) const
+{
+    return position >= 0 && position < tiles.size() && !tiles[position].isNull();
+}
+
+bool TileRegistration::hasCorrections() const
+{
+    for (const QPoint &correction : tileCorrections) {
+        if (!correction.isNull()) return true;
+    }
+    return false;
+}
+
+void TileRegistration::run(QThreadPool *pool)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // Right and bottom neighbour of every tile
+    QVector<QPair<int, int>> candidates;
+    for (int position = 0; position < tiles.size(); ++position) {
+        int col = position % imagesInX;
+        int right = position + 1;
+        int below = position + imagesInX;
+        if (col + 1 < imagesInX && hasTile(position) && hasTile(right)) {
+            candidates.append(qMakePair(position, right));
+        }
+        if (below < tiles.size() && hasTile(position) && hasTile(below)) {
+            candidates.append(qMakePair(position, below));
+        }
+    }
+
+    auto measure = [this](const QPair<int, int> &candidate) {
+        return measurePair(candidate.first, candidate.second);
+    };
+    if (pool) {
+        pairOffsets = QtConcurrent::blockingMapped<QVector<PairOffset>>(pool, candidates, measure);
+    } else {
+        pairOffsets.clear();
+        for (const QPair<int, int> &candidate : candidates) {
+            pairOffsets.append(measure(candidate));
+        }
+    }
+
+    solve();
+    lastElapsedMs = timer.elapsed();
+
+    int accepted = 0;
+    for (const PairOffset &pair : pairOffsets) {
+        if (pair.accepted) ++accepted;
+    }
+    qDebug() << "Registered" << accepted << "of" << pairOffsets.size() << "tile pairs in"
+             << lastElapsedMs << "ms" << (PhaseCorrelator::usesSimd() ? "(SIMD)" : "(scalar)");
+}
+
+TileRegistration::PairOffset TileRegistration::measurePair(int from, int to) const
+{
+    PairOffset pair;
+    pair.from = from;
+    pair.to = to;
+
+    const QImage &a = tiles[from];
+    const QImage &b = tiles[to];
+    if (a.isNull() || b.isNull() || a.size() != b.size()) return pair;
+
+    // Nominal step between the two captures, in downsampled pixels
+    const bool horizontal = (to == from + 1);
+    const double step = double(horizontal ? cellSize.width() : cellSize.height()) / downsampleFactor;
+    const int stepPixels = qRound(step);
+    const int overlapWidth = horizontal ? a.width() - stepPixels : a.width();
+    const int overlapHeight = horizontal ? a.height() : a.height() - stepPixels;
+    if (overlapWidth < minimumOverlap || overlapHeight < minimumOverlap) return pair;
+
+    // a's overlap starts one nominal step in, b's at its origin
+    const int offsetX = horizontal ? stepPixels : 0;
+    const int offsetY = horizontal ? 0 : stepPixels;
+    QVector<float> patchA(overlapWidth * overlapHeight);
+    QVector<float> patchB(overlapWidth * overlapHeight);
+    for (int y = 0; y < overlapHeight; ++y) {
+        const uchar *rowA = a.constScanLine(y + offsetY) + offsetX;
+        const uchar *rowB = b.constScanLine(y);
+        float *dstA = patchA.data() + y * overlapWidth;
+        float *dstB = patchB.data() + y * overlapWidth;
+        for (int x = 0; x < overlapWidth; ++x) {
+            dstA[x] = rowA[x];
+            dstB[x] = rowB[x];
+        }
+    }
+
+    PhaseCorrelator correlator(fftSizeFor(overlapWidth), fftSizeFor(overlapHeight));
+    PhaseCorrelator::Shift shift = correlator.correlate(patchA.constData(), patchB.constData(),
+                                                        overlapWidth, overlapHeight, overlapWidth);
+
+    // The patches were cut at the rounded step; report the deviation from the exact one
+    double dx = shift.dx + (horizontal ? stepPixels - step : 0.0);
+    double dy = shift.dy + (horizontal ? 0.0 : stepPixels - step);
+    pair.offset = QPointF(dx, dy) * downsampleFactor;
+    pair.peak = shift.peak;
+    pair.accepted = shift.peak >= minimumPeak
+        && qAbs(pair.offset.x()) <= maximumOffset
+        && qAbs(pair.offset.y()) <= maximumOffset;
+
+    return pair;
+}
+
+void TileRegistration::solve()
+{
+    // Least squares over all accepted pairs: correction[to] - correction[from]
+    // should equal the measured offset. Gauss-Seidel converges in a few dozen
+    // sweeps for a grid this small.
+    const int count = tiles.size();
+    QVector<QPointF> solution(count);
+
+    for (int iteration = 0; iteration < 500; ++iteration) {
+        double maxChange = 0.0;
+        for (int position = 0; position < count; ++position) {
+            QPointF sum;
+            double weightSum = 0.0;
+            for (const PairOffset &pair : pairOffsets) {
+                if (!pair.accepted) continue;
+                if (pair.to == position) {
+                    sum += (solution[pair.from] + pair.offset) * pair.peak;
+                } else if (pair.from == position) {
+                    sum += (solution[pair.to] - pair.offset) * pair.peak;
+                } else {
+                    continue;
+                }
+                weightSum += pair.peak;
+            }
+            if (weightSum <= 0.0) continue;
+
+            QPointF updated = sum / weightSum;
+            maxChange = qMax(maxChange, (updated - solution[position]).manhattanLength());
+            solution[position] = updated;
+        }
+        if (maxChange < 0.01) break;
+    }
+
+    // Only relative offsets are known. Centre each connected group of tiles on
+    // its nominal cells so the corrections stay within the crop margin.
+    QVector<int> group(count, -1);
+    int groupCount = 0;
+    for (int start = 0; start < count; ++start) {
+        if (group[start] >= 0) continue;
+        QVector<int> pending{start};
+        group[start] = groupCount;
+        while (!pending.isEmpty()) {
+            int position = pending.takeLast();
+            for (const PairOffset &pair : pairOffsets) {
+                if (!pair.accepted) continue;
+                int other = (pair.from == position) ? pair.to : (pair.to == position) ? pair.from : -1;
+                if (other >= 0 && group[other] < 0) {
+                    group[other] = groupCount;
+                    pending.append(other);
+                }
+            }
+        }
+        ++groupCount;
+    }
+
+    QVector<QPointF> groupSum(groupCount);
+    QVector<int> groupSize(groupCount, 0);
+    for (int position = 0; position < count; ++position) {
+        groupSum[group[position]] += solution[position];
+        ++groupSize[group[position]];
+    }
+
+    // The crop cannot move further than its margin; stitching and defect
+    // labelling both take the clamped offset
+    tileCorrections.fill(QPoint(), count);
+    for (int position = 0; position < count; ++position) {
+        int g = group[position];
+        QPoint correction = (solution[position] - groupSum[g] / groupSize[g]).toPoint();
+        if (cropMargin.isValid()) {
+            correction.setX(qBound(-cropMargin.width(), correction.x(), cropMargin.width()));
+            correction.setY(qBound(-cropMargin.height(), correction.y(), cropMargin.height()));
+        }
+        tileCorrections[position] = correction;
+    }
+}
+
+bool TileRegistration::save(const QString &surfacePath, const QVector<int> &sequence) const
+{
+    QJsonObject mainObject;
+    mainObject["downsample"] = downsampleFactor;
+    mainObject["elapsed_ms"] = lastElapsedMs;
+
+    QJsonArray tileArray;
+    for (int position = 0; position < tileCorrections.size(); ++position) {
+        QJsonObject tile;
+        tile["position"] = position;
+        tile["image_number"] = position < sequence.size() ? sequence[position] : -1;
+        tile["dx"] = tileCorrections[position].x();
+        tile["dy"] = tileCorrections[position].y();
+        tileArray.append(tile);
+    }
+    mainObject["tiles"] = tileArray;
+
+    QJsonArray pairArray;
+    for (const PairOffset &pair : pairOffsets) {
+        QJsonObject pairObject;
+        pairObject["from"] = pair.from;
+        pairObject["to"] = pair.to;
+        pairObject["dx"] = pair.offset.x();
+        pairObject["dy"] = pair.offset.y();
+        pairObject["peak"] = pair.peak;
+        pairObject["accepted"] = pair.accepted;
+        pairArray.append(pairObject);
+    }
+    mainObject["pairs"] = pairArray;
+
+    QFile file(QString("%1/registration.json").arg(surfacePath));
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Failed to save tile registration for" << surfacePath;
+        return false;
+    }
+    file.write(QJsonDocument(mainObject).toJson(QJsonDocument::Indented));
+    file.close();
+    return true;
+}
+
+QVector<QPoint> TileRegistration::loadCorrections(const QString &surfacePath, int tileCount)
+{
+    // Surfaces stitched before registration existed have no file: no corrections
+    QVector<QPoint> loaded(tileCount);
+
+    QFile file(QString("%1/registration.json").arg(surfacePath));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return loaded;
+    }
+
+    QJsonArray tileArray = QJsonDocument::fromJson(file.readAll()).object()["tiles"].toArray();
+    for (const QJsonValue &value : tileArray) {
+        QJsonObject tile = value.toObject();
+        int position = tile["position"].toInt(-1);
+        if (position >= 0 && position < tileCount) {
+            loaded[position] = QPoint(tile["dx"].toInt(), tile["dy"].toInt());
+        }
+    }
+    return loaded;
+}
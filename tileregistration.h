@@ -0,0 +1,75 @@
+#ifndef TILEREGISTRATION_H
+#define TILEREGISTRATION_H
+
+#include <QImage>
+#include <QPoint>
+#include <QPointF>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+class QThreadPool;
+
+// Measures how far each captured tile really sits from its nominal grid cell.
+// Neighbouring captures overlap well beyond the stitch crop, so the offset of
+// every left/right and top/bottom pair is estimated with phase correlation on
+// downsampled copies of the overlap. A least-squares solve over all pairs then
+// gives one correction per tile, in full resolution capture pixels.
+//
+// Stitching moves each tile's crop by -correction so the cell shows the right
+// content; defect coordinates move by +correction. Corrections are clamped to
+// the crop margin, so both use exactly the offset the crop can take.
+class TileRegistration
+{
+public:
+    struct PairOffset {
+        int from = -1;          // Left or top tile position
+        int to = -1;            // Right or bottom tile position
+        QPointF offset;         // Measured deviation from the nominal step
+        float peak = 0.0f;      // Correlation strength
+        bool accepted = false;  // Strong enough and within range to be used
+    };
+
+    // cellSize is the nominal step between neighbouring tiles in capture pixels
+    TileRegistration(int imagesInX, int imagesInY, const QSize &cellSize,
+                     int downsample = defaultDownsample());
+
+    static int defaultDownsample() { return 4; }
+    int downsample() const { return downsampleFactor; }
+
+    // How far the stitch crop can move inside a capture in each direction, in
+    // capture pixels; see TileReader::cropMargin(). Unlimited when not set.
+    void setCropMargin(const QSize &margin) { cropMargin = margin; }
+
+    // Grey tile at 1/downsample resolution, see TileReader::readDownsampled()
+    void setTile(int position, const QImage &downsampledTile);
+    bool hasTile(int position) const;
+
+    // Measures every pair whose tiles are both present and solves for the
+    // corrections. Pairs are measured concurrently on pool when given.
+    void run(QThreadPool *pool = nullptr);
+
+    QVector<QPoint> corrections() const { return tileCorrections; }
+    QVector<PairOffset> pairs() const { return pairOffsets; }
+    qint64 elapsedMs() const { return lastElapsedMs; }
+    bool hasCorrections() const;
+
+    bool save(const QString &surfacePath, const QVector<int> &sequence) const;
+    static QVector<QPoint> loadCorrections(const QString &surfacePath, int tileCount);
+
+private:
+    PairOffset measurePair(int from, int to) const;
+    void solve();
+
+    int imagesInX;
+    int imagesInY;
+    QSize cellSize;
+    QSize cropMargin;
+    int downsampleFactor;
+    QVector<QImage> tiles;
+    QVector<PairOffset> pairOffsets;
+    QVector<QPoint> tileCorrections;
+    qint64 lastElapsedMs;
+};
+
+#endif // TILEREGISTRATION_H